@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "CCodeDocument.h"
+
+// Timings of the editor's text model on large inputs, without a window: what a
+// keystroke, a paste, undo/redo, colorizing a whole file, reading the text back
+// and journaling the edits cost. Run as CodeDocumentBench [lines], 100000 lines by default.
+
+// Keystrokes typed by the typing benchmarks
+#define BENCH_KEYSTROKES 2000
+
+// Pastes, and lines in each
+#define BENCH_PASTES 200
+#define BENCH_PASTE_LINES 1000
+
+// Edits made, then undone and redone all at once
+#define BENCH_UNDO_EDITS 5000
+
+// GetText() calls over the whole document
+#define BENCH_GET_TEXT_CALLS 20
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void Report(const char* name, int count, double milliseconds)
+{
+	printf("%-24s %8d ops %10.2f ms %10.3f us/op\n", name, count, milliseconds, milliseconds * 1000.0 / count);
+}
+
+// A Lua file of aLines lines, a function of ten lines at a time with a bit of
+// everything the colorizer tells apart.
+static std::string MakeSource(int aLines)
+{
+	static const char* s_Function[] =
+	{
+		"local function update_%d(entity, dt)",
+		"\t-- moves the entity along its velocity",
+		"\tlocal speed = entity.speed * 1.5e2 + 0x1F",
+		"\tif speed > 0 and not entity.frozen then",
+		"\t\tentity.x = entity.x + math.cos(entity.angle) * speed * dt",
+		"\t\tentity.name = \"entity \" .. tostring(entity.id)",
+		"\telse",
+		"\t\tentity.tags = { [[long string]], 'quoted', nil, true }",
+		"\tend",
+		"end",
+	};
+	const int functionLines = sizeof(s_Function) / sizeof(s_Function[0]);
+
+	std::string text;
+	text.reserve((size_t)aLines * 48);
+
+	char line[128];
+	for (int i = 0; i < aLines; i++)
+	{
+		snprintf(line, sizeof(line), s_Function[i % functionLines], i / functionLines);
+		text += line;
+		if (i + 1 < aLines)
+			text += '\n';
+	}
+	return text;
+}
+
+static void LoadDocument(CCodeDocument& document, const std::string& text)
+{
+	document.SetLanguageDefinition(CCodeDocument::LanguageDefinition::Lua());
+	document.SetText(text);
+
+	while (document.IsColorizing())
+	{
+		document.Update();
+		std::this_thread::yield();
+	}
+}
+
+// A keystroke, and the frame that follows it unless aFrames is false
+static void Type(CCodeDocument& document, int aKeystrokes, bool aFrames = true)
+{
+	static const char s_Keys[] = "local value = item.count + 1\n";
+
+	for (int i = 0; i < aKeystrokes; i++)
+	{
+		document.EnterCharacter((unsigned char)s_Keys[i % (sizeof(s_Keys) - 1)], false);
+		if (aFrames)
+			document.Update();
+	}
+}
+
+static void BenchTyping(const std::string& text)
+{
+	CCodeDocument document;
+	LoadDocument(document, text);
+	document.SetCursorPosition(CCodeDocument::Coordinates(document.GetTotalLines() / 2, 0));
+
+	auto start = Clock::now();
+	Type(document, BENCH_KEYSTROKES);
+	Report("typing", BENCH_KEYSTROKES, Milliseconds(start));
+}
+
+static void BenchPaste(const std::string& text)
+{
+	CCodeDocument document;
+	LoadDocument(document, text);
+	document.SetCursorPosition(CCodeDocument::Coordinates(document.GetTotalLines() / 2, 0));
+
+	const std::string block = MakeSource(BENCH_PASTE_LINES) + "\n";
+
+	auto start = Clock::now();
+	for (int i = 0; i < BENCH_PASTES; i++)
+	{
+		document.Paste(block.c_str());
+		document.Update();
+	}
+	Report("paste", BENCH_PASTES, Milliseconds(start));
+}
+
+static void BenchUndoStorm(const std::string& text)
+{
+	CCodeDocument document;
+	LoadDocument(document, text);
+
+	// an edit on every other line, each its own undo record
+	for (int i = 0; i < BENCH_UNDO_EDITS; i++)
+	{
+		document.SetCursorPosition(CCodeDocument::Coordinates((i * 2) % document.GetTotalLines(), 0));
+		document.EnterCharacter('x', false);
+	}
+
+	auto start = Clock::now();
+	document.Undo(BENCH_UNDO_EDITS);
+	document.Update();
+	Report("undo storm", BENCH_UNDO_EDITS, Milliseconds(start));
+
+	start = Clock::now();
+	document.Redo(BENCH_UNDO_EDITS);
+	document.Update();
+	Report("redo storm", BENCH_UNDO_EDITS, Milliseconds(start));
+}
+
+static void BenchColorize(const std::string& text)
+{
+	CCodeDocument document;
+	document.SetLanguageDefinition(CCodeDocument::LanguageDefinition::Lua());
+
+	auto start = Clock::now();
+	document.SetText(text);
+	while (document.IsColorizing())
+	{
+		document.Update();
+		std::this_thread::yield();
+	}
+	Report("full-file colorize", document.GetTotalLines(), Milliseconds(start));
+}
+
+static void BenchGetText(const std::string& text)
+{
+	CCodeDocument document;
+	LoadDocument(document, text);
+
+	size_t size = 0;
+	auto start = Clock::now();
+	for (int i = 0; i < BENCH_GET_TEXT_CALLS; i++)
+		size += document.GetText().size();
+	Report("GetText", BENCH_GET_TEXT_CALLS, Milliseconds(start));
+
+	start = Clock::now();
+	for (int i = 0; i < BENCH_GET_TEXT_CALLS; i++)
+	{
+		int cursor = 0;
+		size_t chunkSize;
+		while (document.GetTextChunk(cursor, chunkSize) != nullptr)
+			size += chunkSize;
+	}
+	Report("GetTextChunk", BENCH_GET_TEXT_CALLS, Milliseconds(start));
+
+	if (size != (text.size() + 1) * 2 * BENCH_GET_TEXT_CALLS)
+		printf("GetText and GetTextChunk disagree on the size\n");
+}
+
+// The same keystrokes with and without a journal callback. The frames are left
+// out, so the journal's share of the edit itself shows; the callback appends the
+// records to memory, as the swap file does to its mapping.
+static void BenchJournal(const std::string& text)
+{
+	double milliseconds[2];
+	size_t journalSize = 0;
+
+	for (int journaled = 0; journaled < 2; journaled++)
+	{
+		CCodeDocument document;
+		LoadDocument(document, text);
+		document.SetCursorPosition(CCodeDocument::Coordinates(document.GetTotalLines() / 2, 0));
+
+		std::string journal;
+		if (journaled)
+		{
+			document.SetJournalCallback([&journal](const char* aData, size_t aSize) {
+				journal.append(aData, aSize);
+			});
+		}
+
+		auto start = Clock::now();
+		Type(document, BENCH_KEYSTROKES, false);
+		milliseconds[journaled] = Milliseconds(start);
+		journalSize = journal.size();
+	}
+
+	Report("typing, no journal", BENCH_KEYSTROKES, milliseconds[0]);
+	Report("typing, journaled", BENCH_KEYSTROKES, milliseconds[1]);
+	printf("journal overhead %.3f us/keystroke, %zu bytes journaled\n",
+		(milliseconds[1] - milliseconds[0]) * 1000.0 / BENCH_KEYSTROKES, journalSize);
+}
+
+int main(int argc, char** argv)
+{
+	const int lines = argc > 1 ? std::max(1, atoi(argv[1])) : 100000;
+	const std::string text = MakeSource(lines);
+
+	printf("%d lines, %zu bytes\n", lines, text.size());
+
+	BenchTyping(text);
+	BenchPaste(text);
+	BenchUndoStorm(text);
+	BenchColorize(text);
+	BenchGetText(text);
+	BenchJournal(text);
+
+	return 0;
+}
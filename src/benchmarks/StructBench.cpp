@@ -0,0 +1,40 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "Lua/CLuaStruct.h"
+
+#include "lua/Lua.hpp"
+
+// Runs struct_records.lua in a state with the standard libraries and the host's
+// struct global, as the loader sets one up. Run as StructBench [records].
+
+int main(int argc, char** argv)
+{
+	lua_State* L = luaL_newstate();
+	if (L == nullptr)
+	{
+		fprintf(stderr, "cannot create state\n");
+		return 1;
+	}
+
+	luaL_openlibs(L);
+	Lua::Struct.Register(L);
+
+	int status = luaL_loadfile(L, STRUCT_RECORDS_SCRIPT);
+	if (status == LUA_OK)
+	{
+		int nargs = 0;
+		if (argc > 1)
+		{
+			lua_pushinteger(L, atoi(argv[1]));
+			nargs = 1;
+		}
+		status = lua_pcall(L, nargs, 0, 0);
+	}
+
+	if (status != LUA_OK)
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+
+	lua_close(L);
+	return status == LUA_OK ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+-- Plain tables against struct instances for the same records: the memory they
+-- hold, and the time to create them, update a field of each and run a full
+-- collection over them. Needs the host's struct global, so it runs in the loader
+-- or under StructBench; the record count is the first argument, 100000 by default.
+
+local count = tonumber((...)) or 100000
+
+local Enemy = struct.define("Enemy", { "x", "y", "hp:integer", "alive:boolean", "name:any" })
+
+local function measure(name, create)
+	collectgarbage("collect")
+	collectgarbage("collect")
+	local before = collectgarbage("count")
+
+	local start = os.clock()
+	local records = create()
+	local created = os.clock() - start
+
+	collectgarbage("collect")
+	local kilobytes = collectgarbage("count") - before
+
+	start = os.clock()
+	for i = 1, count do
+		local e = records[i]
+		e.hp = e.hp - 1
+		e.x = e.x + e.y
+	end
+	local updated = os.clock() - start
+
+	start = os.clock()
+	collectgarbage("collect")
+	local collected = os.clock() - start
+
+	print(string.format("%-22s %10.0f KB %8.1f B/record   create %7.2f ms   update %7.2f ms   full gc %7.2f ms",
+		name, kilobytes, kilobytes * 1024 / count, created * 1000, updated * 1000, collected * 1000))
+
+	records = nil
+	return kilobytes
+end
+
+print(string.format("%d records", count))
+
+local constructed = measure("table constructor", function()
+	local records = {}
+	for i = 1, count do
+		records[i] = { x = i, y = i * 2, hp = 100, alive = true, name = "grunt" }
+	end
+	return records
+end)
+
+-- the hash part grows and rehashes as the fields come in
+local grown = measure("table, field by field", function()
+	local records = {}
+	for i = 1, count do
+		local e = {}
+		e.x = i
+		e.y = i * 2
+		e.hp = 100
+		e.alive = true
+		e.name = "grunt"
+		records[i] = e
+	end
+	return records
+end)
+
+local structs = measure("struct", function()
+	local records = {}
+	for i = 1, count do
+		records[i] = Enemy(i, i * 2, 100, true, "grunt")
+	end
+	return records
+end)
+
+print(string.format("tables take %.2fx (constructor) and %.2fx (field by field) the memory of structs",
+	constructed / structs, grown / structs))
@@ -1,10 +1,29 @@
 #include "CLuaManager.h"
 #include "CConsole.h"
 
+#include "Lua/CLuaAllocator.h"
+#include "Lua/CLuaLibSnapshot.h"
+#include "Lua/CLuaStruct.h"
+
 #include "lua/Lua.hpp"
 #include "LuaBridge.h"
 
+#include <cstring>
 #include <iostream>
+#include <string>
+
+static int LuaPanic(lua_State* L)
+{
+	const char* error = lua_tostring(L, -1);
+	Global::Console.Print("PANIC: unprotected error in call to Lua API (%s)", error ? error : "error object is not a string");
+	return 0;	// abort
+}
+
+// Globals the host adds to every script state, next to the standard libraries.
+static void OpenHostLibs(lua_State* L)
+{
+	Lua::Struct.Register(L);
+}
 
 bool CLuaManager::Initialize()
 {
@@ -13,39 +32,96 @@ bool CLuaManager::Initialize()
 
 void CLuaManager::Uninitialize()
 {
-	if (m_Scripts.empty())
-		return;
+	while (!m_Scripts.empty())
+		UnloadScript(m_Scripts.back().m_pLuaState);
 
-	for (size_t i = 0; i < m_Scripts.size(); i++)
-	{
-		UnloadScript(m_Scripts[i].m_pLuaState);
-//		delete& m_Scripts[i];
-	}
+	m_ThreadPool.Stop();
+}
+
+bool CLuaManager::LoadScript(const char* name, bool pure)
+{
+	lua_Script luaScript;
+	if (!CreateScript(luaScript, name, pure))
+		return false;
+
+	return RunScript(luaScript, luaL_loadfile(luaScript.m_pLuaState, name));
+}
+
+bool CLuaManager::LoadScriptFromBuffer(std::string_view buffer, const char* name, bool pure)
+{
+	lua_Script luaScript;
+	if (!CreateScript(luaScript, name, pure))
+		return false;
+
+	// "=" shows the name as is in messages, where luaL_loadfile's "@" marks a file
+	const std::string chunkName = std::string("=") + name;
+	return RunScript(luaScript, luaL_loadbuffer(luaScript.m_pLuaState, buffer.data(), buffer.size(), chunkName.c_str()));
+}
+
+bool CLuaManager::LoadScriptFromReader(lua_Reader reader, void* data, const char* name, bool pure)
+{
+	lua_Script luaScript;
+	if (!CreateScript(luaScript, name, pure))
+		return false;
+
+	const std::string chunkName = std::string("=") + name;
+	return RunScript(luaScript, lua_load(luaScript.m_pLuaState, reader, data, chunkName.c_str(), nullptr));
 }
 
-bool CLuaManager::LoadScript(const char* name)
+bool CLuaManager::CreateScript(lua_Script& luaScript, const char* name, bool pure)
 {
-	lua_Script luaScript = { 0 };
+	luaScript = { 0 };
 	luaScript.m_pName = name;
-	luaScript.m_pLuaState = luaL_newstate();
+	luaScript.m_bPure = pure;
+	luaScript.m_pAllocator = new CLuaAllocator(m_MemoryLimit, m_SampleRate);
+	luaScript.m_pLuaState = lua_newstate(CLuaAllocator::Alloc, luaScript.m_pAllocator);
 
-	luaL_openlibs(luaScript.m_pLuaState);
+	if (luaScript.m_pLuaState == nullptr)
+	{
+		Global::Console.Print("Error loading script '%s': cannot create state", name);
+		delete luaScript.m_pAllocator;
+
+		return false;
+	}
+
+	lua_atpanic(luaScript.m_pLuaState, LuaPanic);
+	luaScript.m_pAllocator->Attach(luaScript.m_pLuaState);
+
+	Lua::LibSnapshot.OpenLibs(luaScript.m_pLuaState, OpenHostLibs);
 
-	if (luaL_dofile(luaScript.m_pLuaState, luaScript.m_pName) != LUA_OK)
+	return true;
+}
+
+// Runs the chunk the load left on the stack, then the script's on_init.
+bool CLuaManager::RunScript(lua_Script& luaScript, int loadStatus)
+{
+	const char* name = luaScript.m_pName;
+
+	if (loadStatus != LUA_OK || lua_pcall(luaScript.m_pLuaState, 0, LUA_MULTRET, 0) != LUA_OK)
 	{
 		const char* error = lua_tostring(luaScript.m_pLuaState, -1);
 		Global::Console.Print("Error loading script '%s': %s", name, error);
 		lua_pop(luaScript.m_pLuaState, 1);
-		lua_close(luaScript.m_pLuaState);
+		CloseScript(luaScript);
 
 		return false;
 	}
-	else
+
+	// Drop whatever the chunk returned, only the lifecycle functions matter from here on.
+	lua_settop(luaScript.m_pLuaState, 0);
+	ResolveLifecycle(luaScript);
+
+	if (!CallLifecycle(luaScript, luaScript.m_iInitRef))
 	{
-		m_Scripts.push_back(luaScript);
+		Global::Console.Print("Error initializing script '%s': %s", name, lua_tostring(luaScript.m_pLuaState, -1));
+		CloseScript(luaScript);
 
-		return true;
+		return false;
 	}
+
+	m_Scripts.push_back(luaScript);
+
+	return true;
 }
 
 void CLuaManager::UnloadScript(lua_State* pLuaState)
@@ -56,23 +132,124 @@ void CLuaManager::UnloadScript(lua_State* pLuaState)
 		});
 
 	if (it != m_Scripts.end()) {
-		lua_close(it->m_pLuaState);
+		if (!CallLifecycle(*it, it->m_iUnloadRef))
+			Global::Console.Print("Error unloading script '%s': %s", it->m_pName, lua_tostring(it->m_pLuaState, -1));
+
+		CloseScript(*it);
 		m_Scripts.erase(it);
 	}
 }
 
+lua_State* CLuaManager::FindScript(const char* name) const
+{
+	auto it = std::find_if(m_Scripts.begin(), m_Scripts.end(),
+		[name](const lua_Script& script) {
+			return strcmp(script.m_pName, name) == 0;
+		});
+
+	return it != m_Scripts.end() ? it->m_pLuaState : nullptr;
+}
+
+void CLuaManager::SetParallelUpdate(bool enabled)
+{
+	m_bParallelUpdate = enabled;
+
+	if (enabled)
+		m_ThreadPool.Start();
+	else
+		m_ThreadPool.Stop();
+}
+
+void CLuaManager::ResolveLifecycle(lua_Script& script)
+{
+	lua_State* L = script.m_pLuaState;
+
+	auto resolve = [L](const char* name) {
+		if (lua_getglobal(L, name) != LUA_TFUNCTION)
+		{
+			lua_pop(L, 1);
+			return LUA_NOREF;
+		}
+
+		return luaL_ref(L, LUA_REGISTRYINDEX);
+	};
+
+	script.m_iInitRef = resolve("on_init");
+	script.m_iUpdateRef = resolve("on_update");
+	script.m_iUnloadRef = resolve("on_unload");
+}
+
+// Leaves the error message on the stack when the call fails.
+bool CLuaManager::CallLifecycle(lua_Script& script, int ref)
+{
+	if (ref == LUA_NOREF)
+		return true;
+
+	lua_rawgeti(script.m_pLuaState, LUA_REGISTRYINDEX, ref);
+	return lua_pcall(script.m_pLuaState, 0, 0, 0) == LUA_OK;
+}
+
+bool CLuaManager::UpdateScript(lua_Script& script)
+{
+	return CallLifecycle(script, script.m_iUpdateRef);
+}
+
+void CLuaManager::CloseScript(lua_Script& script)
+{
+	lua_close(script.m_pLuaState);
+	script.m_pLuaState = nullptr;
+
+	delete script.m_pAllocator;
+	script.m_pAllocator = nullptr;
+}
+
 void CLuaManager::Update()
 {
+	m_Failed.assign(m_Scripts.size(), 0);
+
+	if (m_bParallelUpdate)
+	{
+		m_PureScripts.clear();
+		for (size_t i = 0; i < m_Scripts.size(); i++)
+		{
+			if (m_Scripts[i].m_bPure && m_Scripts[i].m_iUpdateRef != LUA_NOREF)
+				m_PureScripts.push_back(i);
+		}
+
+		// Every script owns its lua_State, so pure ones can run side by side.
+		m_ThreadPool.ParallelFor(m_PureScripts.size(), [this](size_t i) {
+			const size_t index = m_PureScripts[i];
+			m_Failed[index] = !UpdateScript(m_Scripts[index]);
+		});
+	}
+
+	for (size_t i = 0; i < m_Scripts.size(); i++)
+	{
+		// Scripts without on_update cost nothing per frame.
+		if (m_Scripts[i].m_iUpdateRef == LUA_NOREF)
+			continue;
+
+		if (!m_bParallelUpdate || !m_Scripts[i].m_bPure)
+			m_Failed[i] = !UpdateScript(m_Scripts[i]);
+	}
+
+	// Reap on the calling thread, the console is not thread safe.
+	size_t index = 0;
 	auto it = m_Scripts.begin();
 	while (it != m_Scripts.end())
 	{
-		if (lua_pcall(it->m_pLuaState, 0, 0, 0) != LUA_OK)
+		// Also catches scripts that swallowed their out of memory error with pcall.
+		if (it->m_pAllocator->IsLimitHit())
+		{
+			Global::Console.Print("%s: killed, memory limit of %zu bytes exceeded", it->m_pName, it->m_pAllocator->GetLimit());
+			CloseScript(*it);
+			it = m_Scripts.erase(it);
+			index++;
+		}
+		else if (m_Failed[index++])
 		{
-			//const char* error = lua_tostring(it->m_pLuaState, -1);
-			//std::cerr << "Error executing script '" << it->m_pName << "': " << error << std::endl;
-			Global::Console.Print("%s: ended", it->m_pName);
-			lua_pop(it->m_pLuaState, 1);
-			lua_close(it->m_pLuaState);
+			Global::Console.Print("%s: ended: %s", it->m_pName, lua_tostring(it->m_pLuaState, -1));
+			CloseScript(*it);
 			it = m_Scripts.erase(it);
 		}
 		else
@@ -80,4 +257,16 @@ void CLuaManager::Update()
 			++it;
 		}
 	}
+}
+
+void CLuaManager::ReportMemory(size_t topSites)
+{
+	for (lua_Script& script : m_Scripts)
+	{
+		CLuaAllocator* pAllocator = script.m_pAllocator;
+		Global::Console.Print("%s: %zu bytes (peak %zu)", script.m_pName, pAllocator->GetUsage(), pAllocator->GetPeak());
+
+		for (const CLuaAllocator::Site& site : pAllocator->GetTopGrowingSites(topSites))
+			Global::Console.Print("    %+lld bytes  %s (~%lld live)", site.mGrowth, site.mName.c_str(), site.mBytes);
+	}
 }
\ No newline at end of file
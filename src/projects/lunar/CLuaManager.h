@@ -1,13 +1,27 @@
 #pragma once
 
+#include "Utils/ThreadPool.h"
+
+#include "lua/Lua.hpp"
+
+#include <cstddef>
+
+#include <string_view>
 #include <vector>
 
-struct lua_State;
+class CLuaAllocator;
 struct lua_Script
 {
 public:
 	lua_State* m_pLuaState;
+	CLuaAllocator* m_pAllocator;
 	const char* m_pName;
+	bool m_bPure;		// no GUI or host-mutating calls, may be updated off the main thread
+
+	// Registry refs to the script's lifecycle functions, LUA_NOREF when not defined.
+	int m_iInitRef;
+	int m_iUpdateRef;
+	int m_iUnloadRef;
 };
 
 class CLuaManager
@@ -16,13 +30,51 @@ public:
 	bool Initialize();
 	void Uninitialize();
 
-	bool LoadScript(const char* name);
+	bool LoadScript(const char* name, bool pure = false);
+	// Same, for code already in memory, or handed over piece by piece by a
+	// lua_Reader. The name is what errors show; like a file name, it has to
+	// outlive the script.
+	bool LoadScriptFromBuffer(std::string_view buffer, const char* name, bool pure = false);
+	bool LoadScriptFromReader(lua_Reader reader, void* data, const char* name, bool pure = false);
 	void UnloadScript(lua_State* pLuaState);
 
+	lua_State* FindScript(const char* name) const;
+
 	void Update();
 
+	// Opt-in: pure scripts are spread across a thread pool during Update,
+	// which only returns once all of them have finished.
+	void SetParallelUpdate(bool enabled);
+	bool IsParallelUpdate() const { return m_bParallelUpdate; }
+
+	// Applied to scripts loaded afterwards. A script that hits its memory limit
+	// gets an emergency GC first and is killed if that does not free enough.
+	void SetMemoryLimit(size_t bytes) { m_MemoryLimit = bytes; }
+	// Tag every Nth allocation with its Lua source:line, 0 to disable.
+	void SetAllocationSampling(unsigned int every) { m_SampleRate = every; }
+
+	// Prints usage per script and the sites that grew the most since the last report.
+	void ReportMemory(size_t topSites = 5);
+
+private:
+	bool CreateScript(lua_Script& script, const char* name, bool pure);
+	bool RunScript(lua_Script& script, int loadStatus);
+	void ResolveLifecycle(lua_Script& script);
+	bool CallLifecycle(lua_Script& script, int ref);
+	bool UpdateScript(lua_Script& script);
+	void CloseScript(lua_Script& script);
+
 public: // private:
 	std::vector<lua_Script> m_Scripts;
+
+private:
+	bool m_bParallelUpdate = false;
+	CUtil_ThreadPool m_ThreadPool;
+	std::vector<size_t> m_PureScripts;
+	std::vector<char> m_Failed;
+
+	size_t m_MemoryLimit = 0;
+	unsigned int m_SampleRate = 0;
 };
 
 namespace Global { inline CLuaManager LuaManager; }
\ No newline at end of file
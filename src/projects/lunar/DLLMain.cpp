@@ -14,12 +14,14 @@ void MainThread(HMODULE hInstance)
 
 	Interfaces::Direct3DDevice9 = **(IDirect3DDevice9***)(Util::Pattern.Find("shaderapidx9.dll", "55 8B EC 51 56 8B F1 83 7E 24 00") + 0x2B);
 
+	Global::LuaManager.Initialize();
 	Global::Hooks.Initialize();
 
 	while (!GetAsyncKeyState(VK_F11))
 		Sleep(420);
 	
 	Global::Hooks.Uninitialize();
+	Global::LuaManager.Uninitialize();
 	Global::Console.Close();
 
 	FreeLibraryAndExitThread(hInstance, EXIT_SUCCESS);
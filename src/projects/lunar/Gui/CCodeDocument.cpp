@@ -0,0 +1,4716 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <regex>
+#include <cmath>
+
+#include "CCodeDocument.h"
+
+// TODO
+// - multiline comments vs single-line: latter is blocking start of a ML
+
+// Per-frame caps on the render thread: lines copied into one background
+// colorize job, and lines the comment/string scan may cover before resuming
+// on the next frame.
+#define COLORIZE_JOB_LINES 4096
+#define COMMENT_SCAN_LINES 4096
+
+// Undo history budget, as counted by UndoRecord::GetMemoryUsage(). The oldest
+// records are dropped past it; the newest one is always kept.
+#define UNDO_BUFFER_BYTES (8 * 1024 * 1024)
+
+// Characters between two Line::mColumns stops: the most a byte/column
+// conversion walks.
+#define COLUMN_STOP_CHARACTERS 64
+
+// Completion suggestions fetched per query.
+#define COMPLETION_MAX_ITEMS 64
+
+// What a word of Colorizer::mWords is; one word can be several of these.
+enum WordTag : uint8_t
+{
+	WordTag_Keyword = 1 << 0,
+	WordTag_Identifier = 1 << 1,
+	WordTag_PreprocIdentifier = 1 << 2,
+	WordTag_BlockOpen = 1 << 3,
+	WordTag_BlockClose = 1 << 4,
+	WordTag_BlockLeader = 1 << 5,
+	WordTag_BlockFollower = 1 << 6
+};
+
+// The first byte of a journal record: what the rest of it holds.
+enum JournalKind : uint8_t
+{
+	JournalKind_Text,		// the whole text, as SetText() drops the undo history
+	JournalKind_Insert,		// the cursors, then text InsertText() put there outside the undo history
+	JournalKind_Edit,		// an undo record, to apply and add as AddUndo() got it
+	JournalKind_Undo,		// steps undone...
+	JournalKind_Redo,		// ...and redone
+	JournalKind_State,		// the cursors and selections
+	JournalKind_History		// the undo index and records, added without applying them
+};
+
+CCodeDocument::CCodeDocument()
+	: mUndoIndex(0)
+	, mUndoBytes(0)
+	, mUndoBatch(nullptr)
+	, mTabSize(4)
+	, mOverwrite(false)
+	, mReadOnly(false)
+	, mScrollToCursor(false)
+	, mScrollToTop(false)
+	, mTextChanged(false)
+	, mColorizerEnabled(true)
+	, mCursorPositionChanged(false)
+	, mColorRangeMin(0)
+	, mColorRangeMax(0)
+	, mColorizeGeneration(0)
+	, mViewLineMin(0)
+	, mViewLineMax(0)
+	, mViewColorizedMin(0)
+	, mViewColorizedMax(0)
+	, mViewColorizedGeneration(0)
+	, mCheckComments(true)
+	, mCheckCommentsMin(0)
+	, mCheckCommentsMax(0)
+	, mCompletionIndex(0)
+	, mHiddenLineCount(0)
+	, mFoldRegionsDirty(false)
+	, mPairsDirty(false)
+	, mChangedLineMin(0)
+	, mChangedLineMax(std::numeric_limits<int>::max())
+	, mFindCaseSensitive(true)
+	, mFindRegex(false)
+	, mFindGeneration(1)
+{
+	SetLanguageDefinition(LanguageDefinition::HLSL());
+	mLines.push_back(Line());
+	mLineStates.push_back(LineState());
+	mLineSymbols.emplace_back();
+}
+
+CCodeDocument::~CCodeDocument()
+{
+	if (mColorizeThread.joinable())
+		mColorizeThread.join();
+}
+
+void CCodeDocument::SetLanguageDefinition(const LanguageDefinition & aLanguageDef)
+{
+	mLanguageDefinition = aLanguageDef;
+
+	auto colorizer = std::make_shared<Colorizer>();
+	colorizer->mLanguageDefinition = aLanguageDef;
+	for (auto& r : mLanguageDefinition.mTokenRegexStrings)
+		colorizer->mRegexList.push_back(std::make_pair(std::regex(r.first, std::regex_constants::optimize), r.second));
+
+	auto& words = colorizer->mWords;
+	for (auto& k : mLanguageDefinition.mKeywords)
+		words.AddTag(words.Insert(k.data(), k.data() + k.size()), WordTag_Keyword);
+	for (auto& i : mLanguageDefinition.mIdentifiers)
+		words.AddTag(words.Insert(i.first.data(), i.first.data() + i.first.size()), WordTag_Identifier);
+	for (auto& i : mLanguageDefinition.mPreprocIdentifiers)
+		words.AddTag(words.Insert(i.first.data(), i.first.data() + i.first.size()), WordTag_PreprocIdentifier);
+	for (auto& k : mLanguageDefinition.mBlockOpeners)
+		words.AddTag(words.Insert(k.data(), k.data() + k.size()), WordTag_BlockOpen);
+	for (auto& k : mLanguageDefinition.mBlockClosers)
+		words.AddTag(words.Insert(k.data(), k.data() + k.size()), WordTag_BlockClose);
+	for (auto& k : mLanguageDefinition.mBlockLeaders)
+		words.AddTag(words.Insert(k.data(), k.data() + k.size()), WordTag_BlockLeader);
+	for (auto& k : mLanguageDefinition.mBlockFollowers)
+		words.AddTag(words.Insert(k.data(), k.data() + k.size()), WordTag_BlockFollower);
+
+	mColorizer = std::move(colorizer);
+
+	ResetSymbols();
+	Colorize();
+}
+
+std::string CCodeDocument::GetText(const Coordinates & aStart, const Coordinates & aEnd) const
+{
+	std::string result;
+
+	auto lstart = aStart.mLine;
+	auto lend = std::min(aEnd.mLine, (int)mLines.size());
+	auto istart = GetCharacterIndex(aStart);
+	auto iend = GetCharacterIndex(aEnd);
+
+	if (lstart >= (int)mLines.size() || (lstart == lend && istart >= iend))
+		return result;
+
+	// size it exactly, then copy whole line runs
+	size_t s = 0;
+	for (int i = lstart; i < lend; i++)
+		s += mLines[i].size() + 1;
+	if (lend < (int)mLines.size())
+		s += std::min((size_t)iend, mLines[lend].size());
+
+	result.resize(s);
+	char* out = result.data();
+
+	for (int i = lstart; i <= lend && i < (int)mLines.size(); i++)
+	{
+		auto& line = mLines[i];
+		size_t from = i == lstart ? std::min((size_t)istart, line.size()) : 0;
+		size_t to = i == lend ? std::min((size_t)iend, line.size()) : line.size();
+
+		if (to > from)
+		{
+			memcpy(out, line.mText.data() + from, to - from);
+			out += to - from;
+		}
+
+		if (i < lend)
+			*out++ = '\n';
+	}
+
+	result.resize(out - result.data());
+	return result;
+}
+
+CCodeDocument::Coordinates CCodeDocument::GetActualCursorCoordinates() const
+{
+	return SanitizeCoordinates(mState.mCursorPosition);
+}
+
+CCodeDocument::Coordinates CCodeDocument::SanitizeCoordinates(const Coordinates & aValue) const
+{
+	auto line = aValue.mLine;
+	auto column = aValue.mColumn;
+	if (line >= (int)mLines.size())
+	{
+		if (mLines.empty())
+		{
+			line = 0;
+			column = 0;
+		}
+		else
+		{
+			line = (int)mLines.size() - 1;
+			column = GetLineMaxColumn(line);
+		}
+		return Coordinates(line, column);
+	}
+	else
+	{
+		column = mLines.empty() ? 0 : std::min(column, GetLineMaxColumn(line));
+		return Coordinates(line, column);
+	}
+}
+
+// https://en.wikipedia.org/wiki/UTF-8
+// We assume that the char is a standalone character (<128) or a leading byte of an UTF-8 code sequence (non-10xxxxxx code)
+int CCodeDocument::UTF8CharLength(Char c)
+{
+	if ((c & 0xFE) == 0xFC)
+		return 6;
+	if ((c & 0xFC) == 0xF8)
+		return 5;
+	if ((c & 0xF8) == 0xF0)
+		return 4;
+	else if ((c & 0xF0) == 0xE0)
+		return 3;
+	else if ((c & 0xE0) == 0xC0)
+		return 2;
+	return 1;
+}
+
+bool CCodeDocument::IsIdentifierChar(Char c)
+{
+	return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+// "Borrowed" from ImGui source
+static inline int ImTextCharToUtf8(char* buf, int buf_size, unsigned int c)
+{
+	if (c < 0x80)
+	{
+		buf[0] = (char)c;
+		return 1;
+	}
+	if (c < 0x800)
+	{
+		if (buf_size < 2) return 0;
+		buf[0] = (char)(0xc0 + (c >> 6));
+		buf[1] = (char)(0x80 + (c & 0x3f));
+		return 2;
+	}
+	if (c >= 0xdc00 && c < 0xe000)
+	{
+		return 0;
+	}
+	if (c >= 0xd800 && c < 0xdc00)
+	{
+		if (buf_size < 4) return 0;
+		buf[0] = (char)(0xf0 + (c >> 18));
+		buf[1] = (char)(0x80 + ((c >> 12) & 0x3f));
+		buf[2] = (char)(0x80 + ((c >> 6) & 0x3f));
+		buf[3] = (char)(0x80 + ((c) & 0x3f));
+		return 4;
+	}
+	//else if (c < 0x10000)
+	{
+		if (buf_size < 3) return 0;
+		buf[0] = (char)(0xe0 + (c >> 12));
+		buf[1] = (char)(0x80 + ((c >> 6) & 0x3f));
+		buf[2] = (char)(0x80 + ((c) & 0x3f));
+		return 3;
+	}
+}
+
+void CCodeDocument::Advance(Coordinates & aCoordinates) const
+{
+	if (aCoordinates.mLine < (int)mLines.size())
+	{
+		auto& line = mLines[aCoordinates.mLine];
+		auto cindex = GetCharacterIndex(aCoordinates);
+
+		if (cindex + 1 < (int)line.size())
+		{
+			auto delta = UTF8CharLength(line.GetChar(cindex));
+			cindex = std::min(cindex + delta, (int)line.size() - 1);
+		}
+		else
+		{
+			++aCoordinates.mLine;
+			cindex = 0;
+		}
+		aCoordinates.mColumn = GetCharacterColumn(aCoordinates.mLine, cindex);
+	}
+}
+
+void CCodeDocument::DeleteRange(const Coordinates & aStart, const Coordinates & aEnd)
+{
+	assert(aEnd >= aStart);
+	assert(!mReadOnly);
+
+	//printf("D(%d.%d)-(%d.%d)\n", aStart.mLine, aStart.mColumn, aEnd.mLine, aEnd.mColumn);
+
+	if (aEnd == aStart)
+		return;
+
+	auto start = GetCharacterIndex(aStart);
+	auto end = GetCharacterIndex(aEnd);
+
+	if (aStart.mLine == aEnd.mLine)
+	{
+		auto& line = mLines[aStart.mLine];
+		auto n = GetLineMaxColumn(aStart.mLine);
+		if (aEnd.mColumn >= n)
+			line.erase(start, line.size());
+		else
+			line.erase(start, end);
+	}
+	else
+	{
+		auto& firstLine = mLines[aStart.mLine];
+		auto& lastLine = mLines[aEnd.mLine];
+
+		firstLine.erase(start, firstLine.size());
+		lastLine.erase(0, end);
+
+		if (aStart.mLine < aEnd.mLine)
+			firstLine.append(lastLine);
+
+		if (aStart.mLine < aEnd.mLine)
+			RemoveLine(aStart.mLine + 1, aEnd.mLine + 1);
+	}
+
+	mTextChanged = true;
+}
+
+int CCodeDocument::InsertTextAt(Coordinates& /* inout */ aWhere, const char * aValue)
+{
+	assert(!mReadOnly);
+	assert(!mLines.empty());
+
+	// Split the text into lines first, so a paste costs one insert into the
+	// target line and one insert into mLines however many lines it spans.
+	Lines added(1);
+	int column = aWhere.mColumn;
+	for (const char * p = aValue; *p != '\0'; )
+	{
+		if (*p == '\r')
+		{
+			// skip
+			++p;
+		}
+		else if (*p == '\n')
+		{
+			added.emplace_back();
+			column = 0;
+			++p;
+		}
+		else
+		{
+			auto& line = added.back();
+			auto d = UTF8CharLength(*p);
+			while (d-- > 0 && *p != '\0')
+				line.push_back(*p++);
+			++column;
+		}
+	}
+
+	if (added.size() == 1 && added.back().empty())
+		return 0;
+
+	int cindex = GetCharacterIndex(aWhere);
+	const int totalLines = (int)added.size() - 1;
+
+	auto& line = mLines[aWhere.mLine];
+	if (totalLines > 0)
+	{
+		auto& last = added.back();
+		last.append(line, cindex);
+		line.erase(cindex, line.size());
+	}
+	line.insert(cindex, added.front(), 0, added.front().size());
+
+	if (totalLines > 0)
+	{
+		InsertLines(aWhere.mLine + 1, totalLines);
+		for (int i = 1; i <= totalLines; ++i)
+			mLines[aWhere.mLine + i].swap(added[i]);
+	}
+
+	aWhere.mLine += totalLines;
+	aWhere.mColumn = column;
+
+	mTextChanged = true;
+
+	return totalLines;
+}
+
+void CCodeDocument::AddUndo(UndoRecord& aValue)
+{
+	assert(!mReadOnly);
+	//printf("AddUndo: (@%d.%d) +\'%s' [%d.%d .. %d.%d], -\'%s', [%d.%d .. %d.%d] (@%d.%d)\n",
+	//	aValue.mBefore.mCursorPosition.mLine, aValue.mBefore.mCursorPosition.mColumn,
+	//	aValue.mAdded.c_str(), aValue.mAddedStart.mLine, aValue.mAddedStart.mColumn, aValue.mAddedEnd.mLine, aValue.mAddedEnd.mColumn,
+	//	aValue.mRemoved.c_str(), aValue.mRemovedStart.mLine, aValue.mRemovedStart.mColumn, aValue.mRemovedEnd.mLine, aValue.mRemovedEnd.mColumn,
+	//	aValue.mAfter.mCursorPosition.mLine, aValue.mAfter.mCursorPosition.mColumn
+	//	);
+
+	if (mUndoBatch != nullptr)
+	{
+		mUndoBatch->mParts.push_back(std::move(aValue));
+		return;
+	}
+
+	JournalEdit(aValue);
+
+	// Anything past mUndoIndex was undone and can't be redone any more
+	const bool redoDropped = mUndoIndex < (int)mUndoBuffer.size();
+	while ((int)mUndoBuffer.size() > mUndoIndex)
+	{
+		mUndoBytes -= mUndoBuffer.back().GetMemoryUsage();
+		mUndoBuffer.pop_back();
+	}
+
+	if (!redoDropped && !mUndoBuffer.empty())
+	{
+		auto& last = mUndoBuffer.back();
+		const size_t lastBytes = last.GetMemoryUsage();
+
+		if (last.Merge(aValue))
+		{
+			mUndoBytes = mUndoBytes - lastBytes + last.GetMemoryUsage();
+			return;
+		}
+	}
+
+	mUndoBytes += aValue.GetMemoryUsage();
+	mUndoBuffer.push_back(std::move(aValue));
+	++mUndoIndex;
+
+	while (mUndoBytes > UNDO_BUFFER_BYTES && mUndoBuffer.size() > 1)
+	{
+		mUndoBytes -= mUndoBuffer.front().GetMemoryUsage();
+		mUndoBuffer.pop_front();
+		--mUndoIndex;
+	}
+}
+
+void CCodeDocument::ForEachCursor(const std::function<void()>& aAction)
+{
+	// Runs aAction with each cursor in turn made the only one, the last one first,
+	// so an edit never moves the cursors still to come. Those done already are
+	// kept as distances from the end of the text and of their line, which the
+	// edits in front of them leave alone. All the edits make one undo record.
+	struct Anchor
+	{
+		int mLines;
+		int mBytes;
+	};
+
+	auto toAnchor = [this](const Coordinates& aCoords)
+	{
+		auto coords = SanitizeCoordinates(aCoords);
+		return Anchor{ (int)mLines.size() - coords.mLine, (int)mLines[coords.mLine].size() - GetCharacterIndex(coords) };
+	};
+
+	auto fromAnchor = [this](const Anchor& aAnchor)
+	{
+		const int line = std::max(0, std::min((int)mLines.size() - aAnchor.mLines, (int)mLines.size() - 1));
+		const int index = std::max(0, (int)mLines[line].size() - aAnchor.mBytes);
+		return Coordinates(line, GetCharacterColumn(line, index));
+	};
+
+	UndoRecord batch;
+	batch.mBefore = mState;
+
+	std::vector<Cursor> cursors;
+	std::swap(cursors, mState.mExtraCursors);
+
+	const int primary = (int)(std::lower_bound(cursors.begin(), cursors.end(), mState.GetStart(),
+		[](const Cursor& aCursor, const Coordinates& aCoords) { return aCursor.GetStart() < aCoords; }) - cursors.begin());
+	cursors.insert(cursors.begin() + primary, mState);
+
+	std::vector<Anchor> anchors(cursors.size() * 3);
+
+	mUndoBatch = &batch;
+	for (int i = (int)cursors.size() - 1; i >= 0; --i)
+	{
+		static_cast<Cursor&>(mState) = cursors[i];
+		mInteractiveStart = mState.mSelectionStart;
+		mInteractiveEnd = mState.mSelectionEnd;
+
+		aAction();
+
+		anchors[i * 3 + 0] = toAnchor(mState.mSelectionStart);
+		anchors[i * 3 + 1] = toAnchor(mState.mSelectionEnd);
+		anchors[i * 3 + 2] = toAnchor(mState.mCursorPosition);
+	}
+	mUndoBatch = nullptr;
+
+	for (size_t i = 0; i < cursors.size(); ++i)
+	{
+		cursors[i].mSelectionStart = fromAnchor(anchors[i * 3 + 0]);
+		cursors[i].mSelectionEnd = fromAnchor(anchors[i * 3 + 1]);
+		cursors[i].mCursorPosition = fromAnchor(anchors[i * 3 + 2]);
+	}
+
+	static_cast<Cursor&>(mState) = cursors[primary];
+	cursors.erase(cursors.begin() + primary);
+	mState.mExtraCursors = std::move(cursors);
+	MergeCursors();
+
+	mInteractiveStart = mState.mSelectionStart;
+	mInteractiveEnd = mState.mSelectionEnd;
+	EnsureCursorVisible();
+
+	if (!batch.mParts.empty())
+	{
+		batch.mAfter = mState;
+		AddUndo(batch);
+	}
+}
+
+void CCodeDocument::MergeCursors()
+{
+	// Sorts the cursors and folds each one that overlaps or touches the one in
+	// front of it into that one. The caret of the primary cursor is kept, else
+	// the later one's.
+	auto& cursors = mState.mExtraCursors;
+	if (cursors.empty())
+		return;
+
+	auto before = [](const Cursor& aLeft, const Cursor& aRight) { return aLeft.GetStart() < aRight.GetStart(); };
+	std::sort(cursors.begin(), cursors.end(), before);
+
+	const int primary = (int)(std::lower_bound(cursors.begin(), cursors.end(), mState, before) - cursors.begin());
+	cursors.insert(cursors.begin() + primary, mState);
+
+	int primaryAt = 0;
+	int count = 0;
+	for (int i = 0; i < (int)cursors.size(); ++i)
+	{
+		if (count > 0 && cursors[i].GetStart() <= cursors[count - 1].GetEnd())
+		{
+			auto& into = cursors[count - 1];
+			const auto& caretFrom = (i == primary || primaryAt != count - 1) ? cursors[i] : into;
+
+			const auto start = into.GetStart();
+			const auto end = std::max(into.GetEnd(), cursors[i].GetEnd());
+			const auto caret = caretFrom.mCursorPosition == caretFrom.GetStart() && start != end ? start : end;
+
+			into.mSelectionStart = start;
+			into.mSelectionEnd = end;
+			into.mCursorPosition = caret;
+
+			if (i == primary)
+				primaryAt = count - 1;
+		}
+		else
+		{
+			if (i == primary)
+				primaryAt = count;
+			cursors[count++] = cursors[i];
+		}
+	}
+	cursors.resize(count);
+
+	static_cast<Cursor&>(mState) = cursors[primaryAt];
+	cursors.erase(cursors.begin() + primaryAt);
+}
+
+void CCodeDocument::AddCursorLine(int aDirection)
+{
+	// A cursor at the primary one's column, on the line past the first or the last cursor
+	auto& extras = mState.mExtraCursors;
+	int line = mState.mCursorPosition.mLine;
+	if (!extras.empty())
+		line = aDirection < 0 ? std::min(line, extras.front().mCursorPosition.mLine) : std::max(line, extras.back().mCursorPosition.mLine);
+
+	line += aDirection;
+	if (line < 0 || line >= (int)mLines.size())
+		return;
+
+	AddCursor(Coordinates(line, mState.mCursorPosition.mColumn));
+	EnsureCursorVisible();
+}
+
+CCodeDocument::Coordinates CCodeDocument::FindWordStart(const Coordinates & aFrom) const
+{
+	Coordinates at = aFrom;
+	if (at.mLine >= (int)mLines.size())
+		return at;
+
+	auto& line = mLines[at.mLine];
+	auto cindex = GetCharacterIndex(at);
+
+	if (cindex >= (int)line.size())
+		return at;
+
+	while (cindex > 0 && isspace(line.GetChar(cindex)))
+		--cindex;
+
+	auto cstart = line.GetColor(cindex);
+	while (cindex > 0)
+	{
+		auto c = line.GetChar(cindex);
+		if ((c & 0xC0) != 0x80)	// not UTF code sequence 10xxxxxx
+		{
+			if (c <= 32 && isspace(c))
+			{
+				cindex++;
+				break;
+			}
+			if (cstart != line.GetColor(size_t(cindex - 1)))
+				break;
+		}
+		--cindex;
+	}
+	return Coordinates(at.mLine, GetCharacterColumn(at.mLine, cindex));
+}
+
+CCodeDocument::Coordinates CCodeDocument::FindWordEnd(const Coordinates & aFrom) const
+{
+	Coordinates at = aFrom;
+	if (at.mLine >= (int)mLines.size())
+		return at;
+
+	auto& line = mLines[at.mLine];
+	auto cindex = GetCharacterIndex(at);
+
+	if (cindex >= (int)line.size())
+		return at;
+
+	bool prevspace = (bool)isspace(line.GetChar(cindex));
+	auto cstart = line.GetColor(cindex);
+	while (cindex < (int)line.size())
+	{
+		auto c = line.GetChar(cindex);
+		auto d = UTF8CharLength(c);
+		if (cstart != line.GetColor(cindex))
+			break;
+
+		if (prevspace != !!isspace(c))
+		{
+			if (isspace(c))
+				while (cindex < (int)line.size() && isspace(line.GetChar(cindex)))
+					++cindex;
+			break;
+		}
+		cindex += d;
+	}
+	return Coordinates(aFrom.mLine, GetCharacterColumn(aFrom.mLine, cindex));
+}
+
+CCodeDocument::Coordinates CCodeDocument::FindNextWord(const Coordinates & aFrom) const
+{
+	Coordinates at = aFrom;
+	if (at.mLine >= (int)mLines.size())
+		return at;
+
+	// skip to the next non-word character
+	auto cindex = GetCharacterIndex(aFrom);
+	bool isword = false;
+	bool skip = false;
+	if (cindex < (int)mLines[at.mLine].size())
+	{
+		auto& line = mLines[at.mLine];
+		isword = isalnum(line.GetChar(cindex));
+		skip = isword;
+	}
+
+	while (!isword || skip)
+	{
+		if (at.mLine >= mLines.size())
+		{
+			auto l = std::max(0, (int) mLines.size() - 1);
+			return Coordinates(l, GetLineMaxColumn(l));
+		}
+
+		auto& line = mLines[at.mLine];
+		if (cindex < (int)line.size())
+		{
+			isword = isalnum(line.GetChar(cindex));
+
+			if (isword && !skip)
+				return Coordinates(at.mLine, GetCharacterColumn(at.mLine, cindex));
+
+			if (!isword)
+				skip = false;
+
+			cindex++;
+		}
+		else
+		{
+			cindex = 0;
+			++at.mLine;
+			skip = false;
+			isword = false;
+		}
+	}
+
+	return at;
+}
+
+int CCodeDocument::GetCharacterIndex(const Coordinates& aCoordinates) const
+{
+	if (aCoordinates.mLine >= mLines.size())
+		return -1;
+	auto& line = mLines[aCoordinates.mLine];
+	auto& columns = GetLineColumns(aCoordinates.mLine);
+
+	// from the last stop before the column
+	auto stop = std::lower_bound(columns.begin(), columns.end(), aCoordinates.mColumn,
+		[](const Line::ColumnStop& aStop, int aColumn) { return aStop.mColumn < aColumn; });
+	if (stop == columns.begin())
+		return 0;
+	--stop;
+
+	int c = stop->mColumn;
+	int i = stop->mIndex;
+	for (; i < line.size() && c < aCoordinates.mColumn;)
+	{
+		if (line.GetChar(i) == '\t')
+			c = (c / mTabSize) * mTabSize + mTabSize;
+		else
+			++c;
+		i += UTF8CharLength(line.GetChar(i));
+	}
+	return i;
+}
+
+int CCodeDocument::GetCharacterColumn(int aLine, int aIndex) const
+{
+	if (aLine >= mLines.size())
+		return 0;
+	auto& line = mLines[aLine];
+	auto& columns = GetLineColumns(aLine);
+
+	// from the last stop before the index
+	auto stop = std::lower_bound(columns.begin(), columns.end(), aIndex,
+		[](const Line::ColumnStop& aStop, int aIndex) { return aStop.mIndex < aIndex; });
+	if (stop == columns.begin())
+		return 0;
+	--stop;
+
+	int col = stop->mColumn;
+	int i = stop->mIndex;
+	while (i < aIndex && i < (int)line.size())
+	{
+		auto c = line.GetChar(i);
+		i += UTF8CharLength(c);
+		if (c == '\t')
+			col = (col / mTabSize) * mTabSize + mTabSize;
+		else
+			col++;
+	}
+	return col;
+}
+
+int CCodeDocument::GetLineCharacterCount(int aLine) const
+{
+	if (aLine >= mLines.size())
+		return 0;
+	GetLineColumns(aLine);
+	return mLines[aLine].mCharacterCount;
+}
+
+int CCodeDocument::GetLineMaxColumn(int aLine) const
+{
+	if (aLine >= mLines.size())
+		return 0;
+	return GetLineColumns(aLine).back().mColumn;
+}
+
+// Builds the column stops of a line on first use after an edit, in one pass
+// that also counts its characters.
+const std::vector<CCodeDocument::Line::ColumnStop>& CCodeDocument::GetLineColumns(int aLine) const
+{
+	auto& line = mLines[aLine];
+	auto& columns = line.mColumns;
+	if (!columns.empty())
+		return columns;
+
+	int col = 0;
+	int count = 0;
+	unsigned i = 0;
+	for (; i < line.size(); ++count)
+	{
+		if (count % COLUMN_STOP_CHARACTERS == 0)
+			columns.push_back(Line::ColumnStop{ (int)i, col });
+
+		auto c = line.GetChar(i);
+		if (c == '\t')
+			col = (col / mTabSize) * mTabSize + mTabSize;
+		else
+			col++;
+		i += UTF8CharLength(c);
+	}
+	columns.push_back(Line::ColumnStop{ (int)i, col });
+
+	line.mCharacterCount = count;
+	return columns;
+}
+
+bool CCodeDocument::IsOnWordBoundary(const Coordinates & aAt) const
+{
+	if (aAt.mLine >= (int)mLines.size() || aAt.mColumn == 0)
+		return true;
+
+	auto& line = mLines[aAt.mLine];
+	auto cindex = GetCharacterIndex(aAt);
+	if (cindex >= (int)line.size())
+		return true;
+
+	if (mColorizerEnabled)
+		return line.GetColor(cindex) != line.GetColor(size_t(cindex - 1));
+
+	return isspace(line.GetChar(cindex)) != isspace(line.GetChar(cindex - 1));
+}
+
+void CCodeDocument::RemoveLine(int aStart, int aEnd)
+{
+	assert(!mReadOnly);
+	assert(aEnd >= aStart);
+	assert(mLines.size() > (size_t)(aEnd - aStart));
+
+	ErrorMarkers etmp;
+	for (auto& i : mErrorMarkers)
+	{
+		ErrorMarkers::value_type e(i.first >= aStart ? i.first - 1 : i.first, i.second);
+		if (e.first >= aStart && e.first <= aEnd)
+			continue;
+		etmp.insert(e);
+	}
+	mErrorMarkers = std::move(etmp);
+
+	Breakpoints btmp;
+	for (auto i : mBreakpoints)
+	{
+		if (i >= aStart && i <= aEnd)
+			continue;
+		btmp.insert(i >= aStart ? i - 1 : i);
+	}
+	mBreakpoints = std::move(btmp);
+
+	for (int i = aStart; i < aEnd; ++i)
+	{
+		for (int node : mLineSymbols[i])
+			mSymbols.Release(node);
+	}
+
+	mLines.erase(mLines.begin() + aStart, mLines.begin() + aEnd);
+	mLineStates.erase(mLineStates.begin() + aStart, mLineStates.begin() + aEnd);
+	mLineSymbols.erase(mLineSymbols.begin() + aStart, mLineSymbols.begin() + aEnd);
+	ShiftPendingRanges(aStart, aStart - aEnd);
+	ShiftFolds(aStart, aStart - aEnd);
+	assert(!mLines.empty());
+
+	mTextChanged = true;
+}
+
+void CCodeDocument::RemoveLine(int aIndex)
+{
+	assert(!mReadOnly);
+	assert(mLines.size() > 1);
+
+	ErrorMarkers etmp;
+	for (auto& i : mErrorMarkers)
+	{
+		ErrorMarkers::value_type e(i.first > aIndex ? i.first - 1 : i.first, i.second);
+		if (e.first - 1 == aIndex)
+			continue;
+		etmp.insert(e);
+	}
+	mErrorMarkers = std::move(etmp);
+
+	Breakpoints btmp;
+	for (auto i : mBreakpoints)
+	{
+		if (i == aIndex)
+			continue;
+		btmp.insert(i >= aIndex ? i - 1 : i);
+	}
+	mBreakpoints = std::move(btmp);
+
+	for (int node : mLineSymbols[aIndex])
+		mSymbols.Release(node);
+
+	mLines.erase(mLines.begin() + aIndex);
+	mLineStates.erase(mLineStates.begin() + aIndex);
+	mLineSymbols.erase(mLineSymbols.begin() + aIndex);
+	ShiftPendingRanges(aIndex, -1);
+	ShiftFolds(aIndex, -1);
+	assert(!mLines.empty());
+
+	mTextChanged = true;
+}
+
+CCodeDocument::Line& CCodeDocument::InsertLine(int aIndex)
+{
+	InsertLines(aIndex, 1);
+	return mLines[aIndex];
+}
+
+void CCodeDocument::InsertLines(int aIndex, int aCount)
+{
+	assert(!mReadOnly);
+
+	mLines.insert(mLines.begin() + aIndex, aCount, Line());
+	mLineStates.insert(mLineStates.begin() + aIndex, aCount, LineState());
+	mLineSymbols.insert(mLineSymbols.begin() + aIndex, aCount, std::vector<int>());
+	ShiftPendingRanges(aIndex, aCount);
+	ShiftFolds(aIndex, aCount);
+
+	ErrorMarkers etmp;
+	for (auto& i : mErrorMarkers)
+		etmp.insert(ErrorMarkers::value_type(i.first >= aIndex ? i.first + aCount : i.first, i.second));
+	mErrorMarkers = std::move(etmp);
+
+	Breakpoints btmp;
+	for (auto i : mBreakpoints)
+		btmp.insert(i >= aIndex ? i + aCount : i);
+	mBreakpoints = std::move(btmp);
+}
+
+// Keeps the not yet colorized / comment scanned line ranges on the same text
+// when lines are inserted (aDelta > 0) or removed (aDelta < 0) at aIndex.
+void CCodeDocument::ShiftPendingRanges(int aIndex, int aDelta)
+{
+	auto shift = [aIndex, aDelta](int& aLine)
+	{
+		if (aLine > aIndex && aLine != std::numeric_limits<int>::max())
+			aLine = std::max(aIndex, aLine + aDelta);
+	};
+
+	shift(mColorRangeMin);
+	shift(mColorRangeMax);
+	shift(mCheckCommentsMin);
+	shift(mCheckCommentsMax);
+
+	// the lines below moved up or down
+	if (aDelta != 0)
+		MarkLinesChanged(aIndex, std::numeric_limits<int>::max());
+}
+
+std::string CCodeDocument::GetWordUnderCursor() const
+{
+	auto c = GetCursorPosition();
+	return GetWordAt(c);
+}
+
+std::string CCodeDocument::GetWordAt(const Coordinates & aCoords) const
+{
+	auto start = FindWordStart(aCoords);
+	auto end = FindWordEnd(aCoords);
+
+	std::string r;
+
+	auto istart = GetCharacterIndex(start);
+	auto iend = GetCharacterIndex(end);
+
+	for (auto it = istart; it < iend; ++it)
+		r.push_back(mLines[aCoords.mLine].mText[it]);
+
+	return r;
+}
+
+void CCodeDocument::SetText(const std::string & aText)
+{
+	const char* text = aText.data();
+	const char* end = text + aText.size();
+
+	mLines.clear();
+	mLines.reserve(std::count(text, end, '\n') + 1);
+
+	// Lines are cut with memchr and built in one go each; carriage returns are dropped
+	for (const char* p = text; ; )
+	{
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		const char* lineEnd = eol != nullptr ? eol : end;
+
+		mLines.emplace_back();
+		auto& line = mLines.back();
+
+		if (memchr(p, '\r', lineEnd - p) == nullptr)
+			line.assign(p, lineEnd - p);
+		else
+		{
+			std::string stripped(p, lineEnd);
+			stripped.erase(std::remove(stripped.begin(), stripped.end(), '\r'), stripped.end());
+			line.assign(stripped.data(), stripped.size());
+		}
+
+		if (eol == nullptr)
+			break;
+		p = eol + 1;
+	}
+
+	mLineStates.assign(mLines.size(), LineState());
+	ResetSymbols();
+
+	mTextChanged = true;
+	mScrollToTop = true;
+
+	mUndoBuffer.clear();
+	mUndoIndex = 0;
+	mUndoBytes = 0;
+	mState.mExtraCursors.clear();
+
+	mFoldedLines.clear();
+	mFoldRegions.clear();
+	BuildHiddenLines();
+	mFoldRegionsDirty = true;
+	mPairsDirty = true;
+	MarkLinesChanged(0, std::numeric_limits<int>::max());
+
+	Colorize();
+	JournalText();
+}
+
+void CCodeDocument::SetTextLines(const std::vector<std::string> & aLines)
+{
+	mLines.clear();
+
+	if (aLines.empty())
+	{
+		mLines.emplace_back(Line());
+	}
+	else
+	{
+		mLines.resize(aLines.size());
+
+		for (size_t i = 0; i < aLines.size(); ++i)
+		{
+			const std::string & aLine = aLines[i];
+
+			mLines[i].assign(aLine.data(), aLine.size());
+		}
+	}
+
+	mLineStates.assign(mLines.size(), LineState());
+	ResetSymbols();
+
+	mTextChanged = true;
+	mScrollToTop = true;
+
+	mUndoBuffer.clear();
+	mUndoIndex = 0;
+	mUndoBytes = 0;
+	mState.mExtraCursors.clear();
+
+	mFoldedLines.clear();
+	mFoldRegions.clear();
+	BuildHiddenLines();
+	mFoldRegionsDirty = true;
+	mPairsDirty = true;
+	MarkLinesChanged(0, std::numeric_limits<int>::max());
+
+	Colorize();
+	JournalText();
+}
+
+void CCodeDocument::EnterCharacter(unsigned int aChar, bool aShift)
+{
+	assert(!mReadOnly);
+
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { EnterCharacter(aChar, aShift); });
+		return;
+	}
+
+	UndoRecord u;
+
+	u.mBefore = mState;
+
+	if (HasSelection())
+	{
+		if (aChar == '\t' && mState.mSelectionStart.mLine != mState.mSelectionEnd.mLine)
+		{
+
+			auto start = mState.mSelectionStart;
+			auto end = mState.mSelectionEnd;
+			auto originalEnd = end;
+
+			if (start > end)
+				std::swap(start, end);
+			start.mColumn = 0;
+			//			end.mColumn = end.mLine < mLines.size() ? mLines[end.mLine].size() : 0;
+			if (end.mColumn == 0 && end.mLine > 0)
+				--end.mLine;
+			if (end.mLine >= (int)mLines.size())
+				end.mLine = mLines.empty() ? 0 : (int)mLines.size() - 1;
+			end.mColumn = GetLineMaxColumn(end.mLine);
+
+			//if (end.mColumn >= GetLineMaxColumn(end.mLine))
+			//	end.mColumn = GetLineMaxColumn(end.mLine) - 1;
+
+			u.mRemovedStart = start;
+			u.mRemovedEnd = end;
+			u.mRemoved = GetText(start, end);
+
+			bool modified = false;
+
+			for (int i = start.mLine; i <= end.mLine; i++)
+			{
+				auto& line = mLines[i];
+				if (aShift)
+				{
+					if (!line.empty())
+					{
+						if (line.GetChar(0) == '\t')
+						{
+							line.erase(0, 1);
+							modified = true;
+						}
+						else
+						{
+							for (int j = 0; j < mTabSize && !line.empty() && line.GetChar(0) == ' '; j++)
+							{
+								line.erase(0, 1);
+								modified = true;
+							}
+						}
+					}
+				}
+				else
+				{
+					line.insert(0, "\t", 1, CCodeDocument::PaletteIndex::Background);
+					modified = true;
+				}
+			}
+
+			if (modified)
+			{
+				start = Coordinates(start.mLine, GetCharacterColumn(start.mLine, 0));
+				Coordinates rangeEnd;
+				if (originalEnd.mColumn != 0)
+				{
+					end = Coordinates(end.mLine, GetLineMaxColumn(end.mLine));
+					rangeEnd = end;
+					u.mAdded = GetText(start, end);
+				}
+				else
+				{
+					end = Coordinates(originalEnd.mLine, 0);
+					rangeEnd = Coordinates(end.mLine - 1, GetLineMaxColumn(end.mLine - 1));
+					u.mAdded = GetText(start, rangeEnd);
+				}
+
+				u.mAddedStart = start;
+				u.mAddedEnd = rangeEnd;
+				u.mAfter = mState;
+
+				mState.mSelectionStart = start;
+				mState.mSelectionEnd = end;
+				AddUndo(u);
+
+				mTextChanged = true;
+
+				EnsureCursorVisible();
+			}
+
+			return;
+		} // c == '\t'
+		else
+		{
+			u.mRemoved = GetSelectedText();
+			u.mRemovedStart = mState.mSelectionStart;
+			u.mRemovedEnd = mState.mSelectionEnd;
+			DeleteSelection();
+		}
+	} // HasSelection
+
+	auto coord = GetActualCursorCoordinates();
+	u.mAddedStart = coord;
+
+	assert(!mLines.empty());
+
+	if (aChar == '\n')
+	{
+		InsertLine(coord.mLine + 1);
+		auto& line = mLines[coord.mLine];
+		auto& newLine = mLines[coord.mLine + 1];
+
+		if (mLanguageDefinition.mAutoIndentation)
+			for (size_t it = 0; it < line.size() && isascii(line.GetChar(it)) && isblank(line.GetChar(it)); ++it)
+				newLine.push_back(line.mText[it], line.GetColor(it));
+
+		const size_t whitespaceSize = newLine.size();
+		auto cindex = GetCharacterIndex(coord);
+		newLine.append(line, cindex);
+		line.erase(cindex, line.size());
+		SetCursorPosition(Coordinates(coord.mLine + 1, GetCharacterColumn(coord.mLine + 1, (int)whitespaceSize)));
+		u.mAdded = (char)aChar;
+	}
+	else
+	{
+		char buf[7];
+		int e = ImTextCharToUtf8(buf, 7, aChar);
+		if (e > 0)
+		{
+			buf[e] = '\0';
+			auto& line = mLines[coord.mLine];
+			auto cindex = GetCharacterIndex(coord);
+
+			if (mOverwrite && cindex < (int)line.size())
+			{
+				auto d = UTF8CharLength(line.GetChar(cindex));
+
+				u.mRemovedStart = mState.mCursorPosition;
+				u.mRemovedEnd = Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex + d));
+
+				while (d-- > 0 && cindex < (int)line.size())
+				{
+					u.mRemoved += line.GetChar(cindex);
+					line.erase(cindex, cindex + 1);
+				}
+			}
+
+			line.insert(cindex, buf, e);
+			cindex += e;
+			u.mAdded = buf;
+
+			SetCursorPosition(Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex)));
+		}
+		else
+			return;
+	}
+
+	mTextChanged = true;
+
+	u.mAddedEnd = GetActualCursorCoordinates();
+	u.mAfter = mState;
+
+	AddUndo(u);
+
+	Colorize(coord.mLine - 1, 3);
+	EnsureCursorVisible();
+}
+
+void CCodeDocument::SetReadOnly(bool aValue)
+{
+	mReadOnly = aValue;
+}
+
+void CCodeDocument::SetColorizerEnable(bool aValue)
+{
+	mColorizerEnabled = aValue;
+	MarkLinesChanged(0, std::numeric_limits<int>::max());
+}
+
+void CCodeDocument::SetCursorPosition(const Coordinates & aPosition)
+{
+	mState.mExtraCursors.clear();
+
+	if (mState.mCursorPosition != aPosition)
+	{
+		mState.mCursorPosition = aPosition;
+		mCursorPositionChanged = true;
+		EnsureCursorVisible();
+	}
+}
+
+void CCodeDocument::SetSelectionStart(const Coordinates & aPosition)
+{
+	mState.mSelectionStart = SanitizeCoordinates(aPosition);
+	if (mState.mSelectionStart > mState.mSelectionEnd)
+		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
+}
+
+void CCodeDocument::SetSelectionEnd(const Coordinates & aPosition)
+{
+	mState.mSelectionEnd = SanitizeCoordinates(aPosition);
+	if (mState.mSelectionStart > mState.mSelectionEnd)
+		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
+}
+
+void CCodeDocument::SetSelection(const Coordinates & aStart, const Coordinates & aEnd, SelectionMode aMode)
+{
+	auto oldSelStart = mState.mSelectionStart;
+	auto oldSelEnd = mState.mSelectionEnd;
+
+	mState.mExtraCursors.clear();
+	mState.mSelectionStart = SanitizeCoordinates(aStart);
+	mState.mSelectionEnd = SanitizeCoordinates(aEnd);
+	if (mState.mSelectionStart > mState.mSelectionEnd)
+		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
+
+	switch (aMode)
+	{
+	case CCodeDocument::SelectionMode::Normal:
+		break;
+	case CCodeDocument::SelectionMode::Word:
+	{
+		mState.mSelectionStart = FindWordStart(mState.mSelectionStart);
+		if (!IsOnWordBoundary(mState.mSelectionEnd))
+			mState.mSelectionEnd = FindWordEnd(FindWordStart(mState.mSelectionEnd));
+		break;
+	}
+	case CCodeDocument::SelectionMode::Line:
+	{
+		const auto lineNo = mState.mSelectionEnd.mLine;
+		const auto lineSize = (size_t)lineNo < mLines.size() ? mLines[lineNo].size() : 0;
+		mState.mSelectionStart = Coordinates(mState.mSelectionStart.mLine, 0);
+		mState.mSelectionEnd = Coordinates(lineNo, GetLineMaxColumn(lineNo));
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (mState.mSelectionStart != oldSelStart ||
+		mState.mSelectionEnd != oldSelEnd)
+		mCursorPositionChanged = true;
+}
+
+void CCodeDocument::AddCursor(const Coordinates & aPosition)
+{
+	Cursor cursor;
+	cursor.mSelectionStart = cursor.mSelectionEnd = cursor.mCursorPosition = SanitizeCoordinates(aPosition);
+
+	mState.mExtraCursors.push_back(cursor);
+	MergeCursors();
+	mCursorPositionChanged = true;
+}
+
+void CCodeDocument::SetColumnSelection(const Coordinates & aStart, const Coordinates & aEnd)
+{
+	// One cursor per line, each selecting the columns between aStart and aEnd
+	// that its line reaches; the one on the line of aEnd is the primary cursor.
+	const auto start = SanitizeCoordinates(aStart);
+	const auto end = SanitizeCoordinates(aEnd);
+	const int step = start.mLine <= end.mLine ? 1 : -1;
+
+	auto& extras = mState.mExtraCursors;
+	extras.clear();
+
+	for (int line = start.mLine; ; line += step)
+	{
+		Cursor cursor;
+		cursor.mSelectionStart = SanitizeCoordinates(Coordinates(line, std::min(aStart.mColumn, aEnd.mColumn)));
+		cursor.mSelectionEnd = SanitizeCoordinates(Coordinates(line, std::max(aStart.mColumn, aEnd.mColumn)));
+		cursor.mCursorPosition = SanitizeCoordinates(Coordinates(line, aEnd.mColumn));
+
+		if (line == end.mLine)
+		{
+			static_cast<Cursor&>(mState) = cursor;
+			break;
+		}
+		extras.push_back(cursor);
+	}
+
+	if (step < 0)
+		std::reverse(extras.begin(), extras.end());
+
+	mCursorPositionChanged = true;
+	EnsureCursorVisible();
+}
+
+void CCodeDocument::ClearExtraCursors()
+{
+	mState.mExtraCursors.clear();
+}
+
+void CCodeDocument::SetTabSize(int aValue)
+{
+	mTabSize = std::max(0, std::min(32, aValue));
+	for (auto& line : mLines)
+		line.mColumns.clear();
+	MarkLinesChanged(0, std::numeric_limits<int>::max());
+}
+
+void CCodeDocument::InsertText(const std::string & aValue)
+{
+	InsertText(aValue.c_str());
+}
+
+void CCodeDocument::InsertText(const char * aValue)
+{
+	if (aValue == nullptr)
+		return;
+
+	// this one is outside the undo history, so the journal has it apart
+	if (mJournalCallback)
+	{
+		mJournalRecord.assign(1, (char)JournalKind_Insert);
+		WriteJournalState(mJournalRecord, mState);
+		mJournalRecord.append(aValue);
+		SendJournalRecord();
+	}
+
+	InsertTextAtCursor(aValue);
+}
+
+void CCodeDocument::InsertTextAtCursor(const char* aValue)
+{
+	auto pos = GetActualCursorCoordinates();
+	auto start = std::min(pos, mState.mSelectionStart);
+	int totalLines = pos.mLine - start.mLine;
+
+	totalLines += InsertTextAt(pos, aValue);
+
+	SetSelection(pos, pos);
+	SetCursorPosition(pos);
+	Colorize(start.mLine - 1, totalLines + 2);
+}
+
+void CCodeDocument::DeleteSelection()
+{
+	assert(mState.mSelectionEnd >= mState.mSelectionStart);
+
+	if (mState.mSelectionEnd == mState.mSelectionStart)
+		return;
+
+	DeleteRange(mState.mSelectionStart, mState.mSelectionEnd);
+
+	SetSelection(mState.mSelectionStart, mState.mSelectionStart);
+	SetCursorPosition(mState.mSelectionStart);
+	Colorize(mState.mSelectionStart.mLine, 1);
+}
+
+void CCodeDocument::MoveUp(int aAmount, bool aSelect)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveUp(aAmount, aSelect); });
+		return;
+	}
+
+	auto oldPos = mState.mCursorPosition;
+	mState.mCursorPosition.mLine = RowToLine(std::max(0, LineToRow(mState.mCursorPosition.mLine) - aAmount));
+	if (oldPos != mState.mCursorPosition)
+	{
+		if (aSelect)
+		{
+			if (oldPos == mInteractiveStart)
+				mInteractiveStart = mState.mCursorPosition;
+			else if (oldPos == mInteractiveEnd)
+				mInteractiveEnd = mState.mCursorPosition;
+			else
+			{
+				mInteractiveStart = mState.mCursorPosition;
+				mInteractiveEnd = oldPos;
+			}
+		}
+		else
+			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+		SetSelection(mInteractiveStart, mInteractiveEnd);
+
+		EnsureCursorVisible();
+	}
+}
+
+void CCodeDocument::MoveDown(int aAmount, bool aSelect)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveDown(aAmount, aSelect); });
+		return;
+	}
+
+	assert(mState.mCursorPosition.mColumn >= 0);
+	auto oldPos = mState.mCursorPosition;
+	mState.mCursorPosition.mLine = RowToLine(std::max(0, std::min(GetVisibleLineCount() - 1, LineToRow(mState.mCursorPosition.mLine) + aAmount)));
+
+	if (mState.mCursorPosition != oldPos)
+	{
+		if (aSelect)
+		{
+			if (oldPos == mInteractiveEnd)
+				mInteractiveEnd = mState.mCursorPosition;
+			else if (oldPos == mInteractiveStart)
+				mInteractiveStart = mState.mCursorPosition;
+			else
+			{
+				mInteractiveStart = oldPos;
+				mInteractiveEnd = mState.mCursorPosition;
+			}
+		}
+		else
+			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+		SetSelection(mInteractiveStart, mInteractiveEnd);
+
+		EnsureCursorVisible();
+	}
+}
+
+static bool IsUTFSequence(char c)
+{
+	return (c & 0xC0) == 0x80;
+}
+
+void CCodeDocument::MoveLeft(int aAmount, bool aSelect, bool aWordMode)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveLeft(aAmount, aSelect, aWordMode); });
+		return;
+	}
+
+	if (mLines.empty())
+		return;
+
+	auto oldPos = mState.mCursorPosition;
+	mState.mCursorPosition = GetActualCursorCoordinates();
+	auto line = mState.mCursorPosition.mLine;
+	auto cindex = GetCharacterIndex(mState.mCursorPosition);
+
+	while (aAmount-- > 0)
+	{
+		if (cindex == 0)
+		{
+			if (line > 0)
+			{
+				--line;
+				if ((int)mLines.size() > line)
+					cindex = (int)mLines[line].size();
+				else
+					cindex = 0;
+			}
+		}
+		else
+		{
+			--cindex;
+			if (cindex > 0)
+			{
+				if ((int)mLines.size() > line)
+				{
+					while (cindex > 0 && IsUTFSequence(mLines[line].GetChar(cindex)))
+						--cindex;
+				}
+			}
+		}
+
+		mState.mCursorPosition = Coordinates(line, GetCharacterColumn(line, cindex));
+		if (aWordMode)
+		{
+			mState.mCursorPosition = FindWordStart(mState.mCursorPosition);
+			cindex = GetCharacterIndex(mState.mCursorPosition);
+		}
+	}
+
+	mState.mCursorPosition = Coordinates(line, GetCharacterColumn(line, cindex));
+
+	assert(mState.mCursorPosition.mColumn >= 0);
+	if (aSelect)
+	{
+		if (oldPos == mInteractiveStart)
+			mInteractiveStart = mState.mCursorPosition;
+		else if (oldPos == mInteractiveEnd)
+			mInteractiveEnd = mState.mCursorPosition;
+		else
+		{
+			mInteractiveStart = mState.mCursorPosition;
+			mInteractiveEnd = oldPos;
+		}
+	}
+	else
+		mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+	SetSelection(mInteractiveStart, mInteractiveEnd, aSelect && aWordMode ? SelectionMode::Word : SelectionMode::Normal);
+
+	EnsureCursorVisible();
+}
+
+void CCodeDocument::MoveRight(int aAmount, bool aSelect, bool aWordMode)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveRight(aAmount, aSelect, aWordMode); });
+		return;
+	}
+
+	auto oldPos = mState.mCursorPosition;
+
+	if (mLines.empty() || oldPos.mLine >= mLines.size())
+		return;
+
+	auto cindex = GetCharacterIndex(mState.mCursorPosition);
+	while (aAmount-- > 0)
+	{
+		auto lindex = mState.mCursorPosition.mLine;
+		auto& line = mLines[lindex];
+
+		if (cindex >= line.size())
+		{
+			if (mState.mCursorPosition.mLine < mLines.size() - 1)
+			{
+				mState.mCursorPosition.mLine = std::max(0, std::min((int)mLines.size() - 1, mState.mCursorPosition.mLine + 1));
+				mState.mCursorPosition.mColumn = 0;
+			}
+			else
+				return;
+		}
+		else
+		{
+			cindex += UTF8CharLength(line.GetChar(cindex));
+			mState.mCursorPosition = Coordinates(lindex, GetCharacterColumn(lindex, cindex));
+			if (aWordMode)
+				mState.mCursorPosition = FindNextWord(mState.mCursorPosition);
+		}
+	}
+
+	if (aSelect)
+	{
+		if (oldPos == mInteractiveEnd)
+			mInteractiveEnd = SanitizeCoordinates(mState.mCursorPosition);
+		else if (oldPos == mInteractiveStart)
+			mInteractiveStart = mState.mCursorPosition;
+		else
+		{
+			mInteractiveStart = oldPos;
+			mInteractiveEnd = mState.mCursorPosition;
+		}
+	}
+	else
+		mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+	SetSelection(mInteractiveStart, mInteractiveEnd, aSelect && aWordMode ? SelectionMode::Word : SelectionMode::Normal);
+
+	EnsureCursorVisible();
+}
+
+void CCodeDocument::MoveTop(bool aSelect)
+{
+	auto oldPos = mState.mCursorPosition;
+	SetCursorPosition(Coordinates(0, 0));
+
+	if (mState.mCursorPosition != oldPos)
+	{
+		if (aSelect)
+		{
+			mInteractiveEnd = oldPos;
+			mInteractiveStart = mState.mCursorPosition;
+		}
+		else
+			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+		SetSelection(mInteractiveStart, mInteractiveEnd);
+	}
+}
+
+void CCodeDocument::CCodeDocument::MoveBottom(bool aSelect)
+{
+	auto oldPos = GetCursorPosition();
+	auto newPos = Coordinates((int)mLines.size() - 1, 0);
+	SetCursorPosition(newPos);
+	if (aSelect)
+	{
+		mInteractiveStart = oldPos;
+		mInteractiveEnd = newPos;
+	}
+	else
+		mInteractiveStart = mInteractiveEnd = newPos;
+	SetSelection(mInteractiveStart, mInteractiveEnd);
+}
+
+void CCodeDocument::MoveHome(bool aSelect)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveHome(aSelect); });
+		return;
+	}
+
+	auto oldPos = mState.mCursorPosition;
+	SetCursorPosition(Coordinates(mState.mCursorPosition.mLine, 0));
+
+	if (mState.mCursorPosition != oldPos)
+	{
+		if (aSelect)
+		{
+			if (oldPos == mInteractiveStart)
+				mInteractiveStart = mState.mCursorPosition;
+			else if (oldPos == mInteractiveEnd)
+				mInteractiveEnd = mState.mCursorPosition;
+			else
+			{
+				mInteractiveStart = mState.mCursorPosition;
+				mInteractiveEnd = oldPos;
+			}
+		}
+		else
+			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+		SetSelection(mInteractiveStart, mInteractiveEnd);
+	}
+}
+
+void CCodeDocument::MoveEnd(bool aSelect)
+{
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { MoveEnd(aSelect); });
+		return;
+	}
+
+	auto oldPos = mState.mCursorPosition;
+	SetCursorPosition(Coordinates(mState.mCursorPosition.mLine, GetLineMaxColumn(oldPos.mLine)));
+
+	if (mState.mCursorPosition != oldPos)
+	{
+		if (aSelect)
+		{
+			if (oldPos == mInteractiveEnd)
+				mInteractiveEnd = mState.mCursorPosition;
+			else if (oldPos == mInteractiveStart)
+				mInteractiveStart = mState.mCursorPosition;
+			else
+			{
+				mInteractiveStart = oldPos;
+				mInteractiveEnd = mState.mCursorPosition;
+			}
+		}
+		else
+			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
+		SetSelection(mInteractiveStart, mInteractiveEnd);
+	}
+}
+
+void CCodeDocument::Delete()
+{
+	assert(!mReadOnly);
+
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { Delete(); });
+		return;
+	}
+
+	if (mLines.empty())
+		return;
+
+	UndoRecord u;
+	u.mBefore = mState;
+
+	if (HasSelection())
+	{
+		u.mRemoved = GetSelectedText();
+		u.mRemovedStart = mState.mSelectionStart;
+		u.mRemovedEnd = mState.mSelectionEnd;
+
+		DeleteSelection();
+	}
+	else
+	{
+		auto pos = GetActualCursorCoordinates();
+		SetCursorPosition(pos);
+		auto& line = mLines[pos.mLine];
+
+		if (pos.mColumn == GetLineMaxColumn(pos.mLine))
+		{
+			if (pos.mLine == (int)mLines.size() - 1)
+				return;
+
+			u.mRemoved = '\n';
+			u.mRemovedStart = u.mRemovedEnd = GetActualCursorCoordinates();
+			Advance(u.mRemovedEnd);
+
+			auto& nextLine = mLines[pos.mLine + 1];
+			line.append(nextLine);
+			RemoveLine(pos.mLine + 1);
+		}
+		else
+		{
+			auto cindex = GetCharacterIndex(pos);
+			auto cend = std::min(cindex + UTF8CharLength(line.GetChar(cindex)), (int)line.size());
+			u.mRemovedStart = GetActualCursorCoordinates();
+			u.mRemovedEnd = Coordinates(pos.mLine, GetCharacterColumn(pos.mLine, cend));
+			u.mRemoved = GetText(u.mRemovedStart, u.mRemovedEnd);
+
+			line.erase(cindex, cend);
+		}
+
+		mTextChanged = true;
+
+		Colorize(pos.mLine, 1);
+	}
+
+	u.mAfter = mState;
+	AddUndo(u);
+}
+
+void CCodeDocument::Backspace()
+{
+	assert(!mReadOnly);
+
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() { Backspace(); });
+		return;
+	}
+
+	if (mLines.empty())
+		return;
+
+	UndoRecord u;
+	u.mBefore = mState;
+
+	if (HasSelection())
+	{
+		u.mRemoved = GetSelectedText();
+		u.mRemovedStart = mState.mSelectionStart;
+		u.mRemovedEnd = mState.mSelectionEnd;
+
+		DeleteSelection();
+	}
+	else
+	{
+		auto pos = GetActualCursorCoordinates();
+		SetCursorPosition(pos);
+
+		if (mState.mCursorPosition.mColumn == 0)
+		{
+			if (mState.mCursorPosition.mLine == 0)
+				return;
+
+			u.mRemoved = '\n';
+			u.mRemovedStart = u.mRemovedEnd = Coordinates(pos.mLine - 1, GetLineMaxColumn(pos.mLine - 1));
+			Advance(u.mRemovedEnd);
+
+			auto& line = mLines[mState.mCursorPosition.mLine];
+			auto& prevLine = mLines[mState.mCursorPosition.mLine - 1];
+			auto prevSize = GetLineMaxColumn(mState.mCursorPosition.mLine - 1);
+			prevLine.append(line);
+
+			ErrorMarkers etmp;
+			for (auto& i : mErrorMarkers)
+				etmp.insert(ErrorMarkers::value_type(i.first - 1 == mState.mCursorPosition.mLine ? i.first - 1 : i.first, i.second));
+			mErrorMarkers = std::move(etmp);
+
+			RemoveLine(mState.mCursorPosition.mLine);
+			--mState.mCursorPosition.mLine;
+			mState.mCursorPosition.mColumn = prevSize;
+		}
+		else
+		{
+			auto& line = mLines[mState.mCursorPosition.mLine];
+			auto cindex = GetCharacterIndex(pos) - 1;
+			auto cend = cindex + 1;
+			while (cindex > 0 && IsUTFSequence(line.GetChar(cindex)))
+				--cindex;
+
+			//if (cindex > 0 && UTF8CharLength(line.GetChar(cindex)) > 1)
+			//	--cindex;
+
+			// a tab spans several columns, so the start is the column of its byte
+			u.mRemovedEnd = GetActualCursorCoordinates();
+			u.mRemovedStart = Coordinates(u.mRemovedEnd.mLine, GetCharacterColumn(u.mRemovedEnd.mLine, cindex));
+			mState.mCursorPosition = u.mRemovedStart;
+
+			while (cindex < line.size() && cend-- > cindex)
+			{
+				u.mRemoved += line.GetChar(cindex);
+				line.erase(cindex, cindex + 1);
+			}
+		}
+
+		mTextChanged = true;
+
+		EnsureCursorVisible();
+		Colorize(mState.mCursorPosition.mLine, 1);
+	}
+
+	u.mAfter = mState;
+	AddUndo(u);
+}
+
+void CCodeDocument::SelectWordUnderCursor()
+{
+	auto c = GetCursorPosition();
+	SetSelection(FindWordStart(c), FindWordEnd(c));
+}
+
+void CCodeDocument::SelectAll()
+{
+	SetSelection(Coordinates(0, 0), Coordinates((int)mLines.size(), 0));
+}
+
+bool CCodeDocument::HasSelection() const
+{
+	return mState.mSelectionEnd > mState.mSelectionStart;
+}
+
+std::string CCodeDocument::GetCopyText() const
+{
+	if (HasExtraCursors())
+	{
+		// A line per cursor, top to bottom, so pasting with as many cursors hands them back out
+		std::string text;
+		auto append = [&](const Cursor& aCursor)
+		{
+			if (aCursor.mSelectionEnd > aCursor.mSelectionStart)
+				text += GetText(aCursor.mSelectionStart, aCursor.mSelectionEnd);
+			else
+				text += mLines[aCursor.mCursorPosition.mLine].mText;
+			text += '\n';
+		};
+
+		auto& extras = mState.mExtraCursors;
+		bool primaryDone = false;
+		for (size_t i = 0; i < extras.size(); ++i)
+		{
+			if (!primaryDone && mState.GetStart() < extras[i].GetStart())
+			{
+				append(mState);
+				primaryDone = true;
+			}
+			append(extras[i]);
+		}
+		if (!primaryDone)
+			append(mState);
+
+		text.pop_back();
+		return text;
+	}
+
+	if (HasSelection())
+		return GetSelectedText();
+
+	return mLines[GetActualCursorCoordinates().mLine].mText;
+}
+
+void CCodeDocument::DeleteSelections()
+{
+	if (IsReadOnly())
+		return;
+
+	if (HasExtraCursors())
+	{
+		ForEachCursor([&]() {
+			if (HasSelection())
+				Delete();
+		});
+	}
+	else if (HasSelection())
+	{
+		UndoRecord u;
+		u.mBefore = mState;
+		u.mRemoved = GetSelectedText();
+		u.mRemovedStart = mState.mSelectionStart;
+		u.mRemovedEnd = mState.mSelectionEnd;
+
+		DeleteSelection();
+
+		u.mAfter = mState;
+		AddUndo(u);
+	}
+}
+
+void CCodeDocument::Paste(const char* aText)
+{
+	if (IsReadOnly() || aText == nullptr || *aText == '\0')
+		return;
+
+	if (HasExtraCursors())
+	{
+		// With as many lines as cursors each cursor gets its own, else all of them
+		std::vector<std::string> lines;
+		const std::string text = aText;
+		for (size_t start = 0; start <= text.size(); )
+		{
+			auto end = text.find('\n', start);
+			if (end == std::string::npos)
+				end = text.size();
+			lines.emplace_back(text, start, end - start);
+			start = end + 1;
+		}
+
+		if ((int)lines.size() == GetCursorCount())
+		{
+			int index = (int)lines.size();
+			ForEachCursor([&]() { PasteText(lines[--index].c_str()); });
+		}
+		else
+			ForEachCursor([&]() { PasteText(text.c_str()); });
+	}
+	else
+		PasteText(aText);
+}
+
+void CCodeDocument::PasteText(const char* aText)
+{
+	UndoRecord u;
+	u.mBefore = mState;
+
+	if (HasSelection())
+	{
+		u.mRemoved = GetSelectedText();
+		u.mRemovedStart = mState.mSelectionStart;
+		u.mRemovedEnd = mState.mSelectionEnd;
+		DeleteSelection();
+	}
+
+	u.mAdded = aText;
+	u.mAddedStart = GetActualCursorCoordinates();
+
+	InsertTextAtCursor(aText);
+
+	u.mAddedEnd = GetActualCursorCoordinates();
+	u.mAfter = mState;
+
+	if (!u.mAdded.empty() || !u.mRemoved.empty())
+		AddUndo(u);
+}
+
+bool CCodeDocument::CanUndo() const
+{
+	return !mReadOnly && mUndoIndex > 0;
+}
+
+bool CCodeDocument::CanRedo() const
+{
+	return !mReadOnly && mUndoIndex < (int)mUndoBuffer.size();
+}
+
+void CCodeDocument::Undo(int aSteps)
+{
+	int steps = 0;
+	for (; CanUndo() && steps < aSteps; ++steps)
+		mUndoBuffer[--mUndoIndex].Undo(this);
+	JournalSteps(JournalKind_Undo, steps);
+}
+
+void CCodeDocument::Redo(int aSteps)
+{
+	int steps = 0;
+	for (; CanRedo() && steps < aSteps; ++steps)
+		mUndoBuffer[mUndoIndex++].Redo(this);
+	JournalSteps(JournalKind_Redo, steps);
+}
+
+static char FoldCase(char aChar)
+{
+	return aChar >= 'A' && aChar <= 'Z' ? aChar - 'A' + 'a' : aChar;
+}
+
+bool CCodeDocument::SetFindQuery(const std::string & aQuery, bool aCaseSensitive, bool aRegex)
+{
+	if (aQuery == mFindQuery && aCaseSensitive == mFindCaseSensitive && aRegex == mFindRegex)
+		return true;
+
+	mFindQuery.clear();
+	mFindNeedle.clear();
+	mFindCaseSensitive = aCaseSensitive;
+	mFindRegex = aRegex;
+
+	// every line's cached matches belong to the previous query now
+	if (++mFindGeneration == 0)
+		++mFindGeneration;
+
+	if (aRegex && !aQuery.empty())
+	{
+		auto flags = std::regex_constants::ECMAScript | std::regex_constants::optimize;
+		if (!aCaseSensitive)
+			flags |= std::regex_constants::icase;
+
+		try
+		{
+			mFindPattern = std::regex(aQuery, flags);
+		}
+		catch (const std::regex_error&)
+		{
+			return false;
+		}
+	}
+
+	mFindQuery = aQuery;
+	mFindNeedle = aQuery;
+	if (!aCaseSensitive)
+		std::transform(mFindNeedle.begin(), mFindNeedle.end(), mFindNeedle.begin(), FoldCase);
+
+	return true;
+}
+
+const std::vector<int>& CCodeDocument::GetLineMatches(int aLine) const
+{
+	auto& line = mLines[aLine];
+	if (line.mMatchesQuery == mFindGeneration)
+		return line.mMatches;
+
+	line.mMatches.clear();
+	line.mMatchesQuery = mFindGeneration;
+
+	if (mFindQuery.empty() || line.empty())
+		return line.mMatches;
+
+	const char* text = line.mText.data();
+	const char* textEnd = text + line.size();
+
+	if (mFindRegex)
+	{
+		// empty matches (a bare "x*") would highlight nothing and can't be replaced sensibly
+		for (std::cregex_iterator it(text, textEnd, mFindPattern), end; it != end; ++it)
+		{
+			if (it->length(0) > 0)
+			{
+				line.mMatches.push_back((int)it->position(0));
+				line.mMatches.push_back((int)(it->position(0) + it->length(0)));
+			}
+		}
+		return line.mMatches;
+	}
+
+	if (!mFindCaseSensitive)
+	{
+		mFindBuffer.assign(text, line.size());
+		std::transform(mFindBuffer.begin(), mFindBuffer.end(), mFindBuffer.begin(), FoldCase);
+		text = mFindBuffer.data();
+		textEnd = text + mFindBuffer.size();
+	}
+
+	// memchr finds candidates for the first byte, the last byte filters most of
+	// them out before the full compare
+	const char* needle = mFindNeedle.data();
+	const size_t length = mFindNeedle.size();
+	const char* last = textEnd - length;
+
+	for (const char* p = text; p <= last; )
+	{
+		p = (const char*)memchr(p, needle[0], last - p + 1);
+		if (p == nullptr)
+			break;
+
+		if (p[length - 1] == needle[length - 1] && memcmp(p, needle, length) == 0)
+		{
+			line.mMatches.push_back((int)(p - text));
+			line.mMatches.push_back((int)(p - text + length));
+			p += length;
+		}
+		else
+			++p;
+	}
+
+	return line.mMatches;
+}
+
+bool CCodeDocument::FindNext(bool aBackwards)
+{
+	if (mFindQuery.empty() || mLines.empty())
+		return false;
+
+	// Forward searches start at the cursor, which sits at the end of a match
+	// found before; backward ones start in front of the selection.
+	const auto from = aBackwards && HasSelection() ? mState.mSelectionStart : GetActualCursorCoordinates();
+	const int fromIndex = GetCharacterIndex(from);
+	const int lineCount = (int)mLines.size();
+
+	for (int i = 0; i <= lineCount; ++i)
+	{
+		const int lineNo = aBackwards ? ((from.mLine - i) % lineCount + lineCount) % lineCount : (from.mLine + i) % lineCount;
+		auto& matches = GetLineMatches(lineNo);
+
+		int found = -1;
+		for (int m = 0; m < (int)matches.size(); m += 2)
+		{
+			// the cursor's own line is looked at twice: past the cursor first, before it after wrapping around
+			const bool inRange = i == 0 ? (aBackwards ? matches[m] < fromIndex : matches[m] >= fromIndex)
+				: i == lineCount ? (aBackwards ? matches[m] >= fromIndex : matches[m] < fromIndex)
+				: true;
+
+			if (inRange)
+			{
+				found = m;
+				if (!aBackwards)
+					break;
+			}
+		}
+
+		if (found >= 0)
+		{
+			const Coordinates start(lineNo, GetCharacterColumn(lineNo, matches[found]));
+			const Coordinates end(lineNo, GetCharacterColumn(lineNo, matches[found + 1]));
+			SetSelection(start, end);
+			SetCursorPosition(end);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int CCodeDocument::FindAll()
+{
+	int count = 0;
+	for (int i = 0; i < (int)mLines.size(); ++i)
+		count += (int)GetLineMatches(i).size() / 2;
+
+	return count;
+}
+
+int CCodeDocument::ReplaceAll(const std::string & aReplacement)
+{
+	if (mReadOnly || mFindQuery.empty())
+		return 0;
+
+	int firstLine = -1;
+	int lastLine = -1;
+	for (int i = 0; i < (int)mLines.size(); ++i)
+	{
+		if (!GetLineMatches(i).empty())
+		{
+			if (firstLine < 0)
+				firstLine = i;
+			lastLine = i;
+		}
+	}
+
+	if (firstLine < 0)
+		return 0;
+
+	// The lines from the first to the last match are rebuilt as one string, so the
+	// whole replacement is a single removed/added pair in the undo history.
+	std::string replaced;
+	int count = 0;
+	for (int i = firstLine; i <= lastLine; ++i)
+	{
+		auto& line = mLines[i];
+		auto& matches = GetLineMatches(i);
+		const char* text = line.mText.data();
+		int copied = 0;
+
+		if (mFindRegex)
+		{
+			// expanded per match so $1 and the like refer to that match
+			for (std::cregex_iterator it(text, text + line.size(), mFindPattern), end; it != end; ++it)
+			{
+				if (it->length(0) == 0)
+					continue;
+
+				replaced.append(text + copied, text + it->position(0));
+				replaced += it->format(aReplacement);
+				copied = (int)(it->position(0) + it->length(0));
+				++count;
+			}
+		}
+		else
+		{
+			for (size_t m = 0; m < matches.size(); m += 2)
+			{
+				replaced.append(text + copied, text + matches[m]);
+				replaced += aReplacement;
+				copied = matches[m + 1];
+				++count;
+			}
+		}
+
+		replaced.append(text + copied, text + line.size());
+		if (i < lastLine)
+			replaced += '\n';
+	}
+
+	UndoRecord u;
+	u.mBefore = mState;
+
+	u.mRemovedStart = Coordinates(firstLine, 0);
+	u.mRemovedEnd = Coordinates(lastLine, GetLineMaxColumn(lastLine));
+	u.mRemoved = GetText(u.mRemovedStart, u.mRemovedEnd);
+
+	DeleteRange(u.mRemovedStart, u.mRemovedEnd);
+
+	u.mAdded = std::move(replaced);
+	u.mAddedStart = u.mRemovedStart;
+	u.mAddedEnd = u.mAddedStart;
+	InsertTextAt(u.mAddedEnd, u.mAdded.c_str());
+
+	SetSelection(u.mAddedStart, u.mAddedStart);
+	SetCursorPosition(SanitizeCoordinates(mState.mCursorPosition));
+	mTextChanged = true;
+
+	u.mAfter = mState;
+	AddUndo(u);
+
+	Colorize(u.mAddedStart.mLine - 1, u.mAddedEnd.mLine - u.mAddedStart.mLine + 2);
+	EnsureCursorVisible();
+
+	return count;
+}
+
+void CCodeDocument::GetCompletions(const std::string & aPrefix, std::vector<std::string>& aResults, size_t aMaxResults) const
+{
+	mSymbols.Complete(aPrefix.data(), aPrefix.data() + aPrefix.size(), aResults, aMaxResults);
+}
+
+// Opens, refreshes or closes the completion popup for the word ending at the cursor.
+void CCodeDocument::UpdateCompletions()
+{
+	mCompletions.clear();
+	mCompletionIndex = 0;
+
+	if (HasSelection() || HasExtraCursors())
+		return;
+
+	auto pos = GetActualCursorCoordinates();
+	auto& line = mLines[pos.mLine];
+	const int end = GetCharacterIndex(pos);
+	int start = end;
+	while (start > 0 && IsIdentifierChar(line.GetChar(start - 1)))
+		--start;
+
+	if (start == end || isdigit(line.GetChar(start)))
+		return;
+
+	// Recount the line as it is now, or words it held before this edit, like
+	// the longer one just backspaced over, would be offered.
+	if (mColorizerEnabled)
+		ColorizeRange(pos.mLine, pos.mLine + 1);
+
+	mCompletionStart = Coordinates(pos.mLine, GetCharacterColumn(pos.mLine, start));
+	mSymbols.Complete(line.mText.data() + start, line.mText.data() + end, mCompletions, COMPLETION_MAX_ITEMS + 1);
+
+	// the word as typed comes first if it's listed, and is no suggestion
+	if (!mCompletions.empty() && (int)mCompletions.front().size() == end - start)
+		mCompletions.erase(mCompletions.begin());
+	else if (mCompletions.size() > COMPLETION_MAX_ITEMS)
+		mCompletions.pop_back();
+}
+
+void CCodeDocument::AcceptCompletion()
+{
+	assert(!mReadOnly);
+
+	UndoRecord u;
+	u.mBefore = mState;
+
+	u.mRemovedStart = mCompletionStart;
+	u.mRemovedEnd = GetActualCursorCoordinates();
+	u.mRemoved = GetText(u.mRemovedStart, u.mRemovedEnd);
+	DeleteRange(u.mRemovedStart, u.mRemovedEnd);
+
+	u.mAdded = mCompletions[mCompletionIndex];
+	u.mAddedStart = u.mAddedEnd = mCompletionStart;
+	InsertTextAt(u.mAddedEnd, u.mAdded.c_str());
+
+	SetSelection(u.mAddedEnd, u.mAddedEnd);
+	SetCursorPosition(u.mAddedEnd);
+
+	u.mAfter = mState;
+	AddUndo(u);
+
+	Colorize(u.mAddedStart.mLine, 1);
+	mCompletions.clear();
+}
+
+void CCodeDocument::SetFolded(int aLine, bool aFolded)
+{
+	if (!aFolded)
+	{
+		mFoldedLines.erase(aLine);
+		BuildHiddenLines();
+		return;
+	}
+
+	auto region = FindFoldRegion(aLine);
+	if (region == nullptr)
+		return;
+
+	mFoldedLines.insert(aLine);
+	BuildHiddenLines();
+
+	// the cursor can't stay on the lines folded away
+	if (mState.mCursorPosition.mLine > region->mStart && mState.mCursorPosition.mLine < region->mEnd)
+	{
+		const Coordinates header(aLine, GetLineMaxColumn(aLine));
+		mInteractiveStart = mInteractiveEnd = header;
+		SetSelection(header, header);
+		SetCursorPosition(header);
+	}
+}
+
+void CCodeDocument::UnfoldAll()
+{
+	mFoldedLines.clear();
+	BuildHiddenLines();
+}
+
+void CCodeDocument::UpdateFolds()
+{
+	if (!mFoldRegionsDirty)
+		return;
+
+	mFoldRegionsDirty = false;
+	BuildFoldRegions();
+	BuildHiddenLines();
+	RevealLine(mState.mCursorPosition.mLine);
+}
+
+void CCodeDocument::BuildFoldRegions()
+{
+	// Pairs the block counts the colorizer left on each line through a stack of
+	// the lines with blocks still open; a multi-line comment counts as a block
+	// from the line it starts on to the one it ends on. Only lines colorized
+	// again get new counts, so this is a pass over integers.
+	mFoldRegions.clear();
+
+	std::vector<int> open;
+	const int count = (int)mLines.size();
+	const bool withComments = mLineStates.size() == mLines.size();
+
+	for (int i = 0; i < count; ++i)
+	{
+		int closes = mLines[i].mBlockCloses;
+		int opens = mLines[i].mBlockOpens;
+
+		if (withComments)
+		{
+			const bool commentBefore = mLineStates[i].mInComment;
+			const bool commentAfter = i + 1 < count && mLineStates[i + 1].mInComment;
+			closes += commentBefore && !commentAfter ? 1 : 0;
+			opens += !commentBefore && commentAfter ? 1 : 0;
+		}
+
+		for (; closes > 0 && !open.empty(); --closes)
+		{
+			if (i - open.back() >= 2)
+				mFoldRegions.push_back(FoldRegion{ open.back(), i });
+			open.pop_back();
+		}
+		open.insert(open.end(), opens, i);
+	}
+
+	std::sort(mFoldRegions.begin(), mFoldRegions.end(), [](const FoldRegion& aLeft, const FoldRegion& aRight) {
+		return aLeft.mStart < aRight.mStart || (aLeft.mStart == aRight.mStart && aLeft.mEnd > aRight.mEnd);
+	});
+	mFoldRegions.erase(std::unique(mFoldRegions.begin(), mFoldRegions.end(), [](const FoldRegion& aLeft, const FoldRegion& aRight) {
+		return aLeft.mStart == aRight.mStart;
+	}), mFoldRegions.end());
+
+	// Folds of blocks that are gone are dropped, once the colorizer has caught up
+	if (mColorRangeMin >= mColorRangeMax && mColorizeJob == nullptr && !mCheckComments)
+	{
+		for (auto it = mFoldedLines.begin(); it != mFoldedLines.end(); )
+		{
+			if (FindFoldRegion(*it) == nullptr)
+				it = mFoldedLines.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+void CCodeDocument::BuildHiddenLines()
+{
+	mHiddenLines.clear();
+	mHiddenLineCount = 0;
+
+	if (mFoldedLines.empty())
+		return;
+
+	// a block folded inside a folded one adds nothing
+	int coveredEnd = -1;
+	for (auto& region : mFoldRegions)
+	{
+		if (region.mStart < coveredEnd || region.mEnd - region.mStart < 2 || mFoldedLines.count(region.mStart) == 0)
+			continue;
+
+		mHiddenLines.push_back(HiddenLines{ region.mStart + 1, region.mEnd, mHiddenLineCount });
+		mHiddenLineCount += region.mEnd - region.mStart - 1;
+		coveredEnd = region.mEnd;
+	}
+}
+
+// Keeps the folds on the same text when lines are inserted (aDelta > 0) or
+// removed (aDelta < 0) at aIndex, until the regions are built again.
+void CCodeDocument::ShiftFolds(int aIndex, int aDelta)
+{
+	mFoldRegionsDirty = true;
+	mPairsDirty = true;
+
+	if (aDelta == 0 || (mFoldRegions.empty() && mFoldedLines.empty()))
+		return;
+
+	auto shift = [aIndex, aDelta](int aLine) { return aLine < aIndex ? aLine : std::max(aIndex, aLine + aDelta); };
+
+	for (auto& region : mFoldRegions)
+	{
+		region.mStart = shift(region.mStart);
+		region.mEnd = shift(region.mEnd);
+	}
+
+	std::unordered_set<int> folded;
+	for (int line : mFoldedLines)
+		folded.insert(shift(line));
+	mFoldedLines = std::move(folded);
+
+	BuildHiddenLines();
+}
+
+void CCodeDocument::BuildPairs()
+{
+	// Pairs the tokens the colorizer left on each line through a stack of the
+	// brackets and one of the blocks still open, once per change of the text, so
+	// the match at the cursor is a lookup in between. A leader (if, while, for)
+	// waits on the stack for the follower (then, do) that opens its block, and a
+	// function in the condition meanwhile stacks on top of it.
+	mPairsDirty = false;
+
+	struct Open
+	{
+		int mLine;
+		int mToken;
+		bool mWaiting;
+	};
+
+	std::vector<Open> brackets;
+	std::vector<Open> blocks;
+
+	auto pair = [this](const Open& aOpen, int aLine, int aToken)
+	{
+		auto& open = mLines[aOpen.mLine].mPairs[aOpen.mToken];
+		auto& close = mLines[aLine].mPairs[aToken];
+		open.mPartnerLine = aLine;
+		open.mPartner = aToken;
+		close.mPartnerLine = aOpen.mLine;
+		close.mPartner = aOpen.mToken;
+	};
+
+	for (int i = 0; i < (int)mLines.size(); ++i)
+	{
+		auto& line = mLines[i];
+
+		for (int k = 0; k < (int)line.mPairs.size(); ++k)
+		{
+			auto& token = line.mPairs[k];
+			token.mPartnerLine = -1;
+			token.mPartner = -1;
+
+			// the comment scan may have reached the token since it was colorized; the
+			// line is queued to be tokenized again, which also brings back tokens a
+			// closed comment uncovers
+			if (token.mIndex + token.mLength > (int)line.size() || line.GetComment(token.mIndex) != CommentKind::None)
+				continue;
+
+			if (token.mBracket != 0)
+			{
+				// a closer of another kind is left unpaired, the stack as it was
+				const char open = token.mBracket == ')' ? '(' : token.mBracket == ']' ? '[' : token.mBracket == '}' ? '{' : 0;
+				if (open == 0)
+					brackets.push_back(Open{ i, k, false });
+				else if (!brackets.empty() && mLines[brackets.back().mLine].mPairs[brackets.back().mToken].mBracket == open)
+				{
+					pair(brackets.back(), i, k);
+					brackets.pop_back();
+				}
+				continue;
+			}
+
+			const uint8_t tags = token.mTags;
+			if ((tags & WordTag_BlockLeader) != 0 && (tags & WordTag_BlockClose) != 0)
+			{
+				// elseif goes on with the block of its if
+				if (!blocks.empty())
+					blocks.back().mWaiting = true;
+			}
+			else if (tags & WordTag_BlockLeader)
+				blocks.push_back(Open{ i, k, true });
+			else if ((tags & WordTag_BlockFollower) != 0 && !blocks.empty() && blocks.back().mWaiting)
+				blocks.back().mWaiting = false;
+			else if (tags & WordTag_BlockClose)
+			{
+				if (!blocks.empty())
+				{
+					pair(blocks.back(), i, k);
+					blocks.pop_back();
+				}
+			}
+			else if (tags & WordTag_BlockOpen)
+				blocks.push_back(Open{ i, k, false });
+		}
+	}
+}
+
+// Finds the pair token under aWhere, or else the one ending at it, and the
+// token it pairs with.
+bool CCodeDocument::FindMatchingPair(const Coordinates& aWhere, int& aLine, int& aToken, int& aMatchLine, int& aMatch)
+{
+	if (aWhere.mLine < 0 || aWhere.mLine >= (int)mLines.size())
+		return false;
+
+	auto& pairs = mLines[aWhere.mLine].mPairs;
+	const int index = GetCharacterIndex(aWhere);
+
+	int found = -1;
+	for (int i = 0; i < (int)pairs.size() && pairs[i].mIndex <= index; ++i)
+	{
+		if (index < pairs[i].mIndex + pairs[i].mLength)
+		{
+			found = i;
+			break;
+		}
+		if (index == pairs[i].mIndex + pairs[i].mLength)
+			found = i;
+	}
+
+	if (found < 0)
+		return false;
+
+	if (mPairsDirty)
+		BuildPairs();
+
+	auto& token = pairs[found];
+	if (token.mPartnerLine < 0)
+		return false;
+
+	aLine = aWhere.mLine;
+	aToken = found;
+	aMatchLine = token.mPartnerLine;
+	aMatch = token.mPartner;
+	return true;
+}
+
+const CCodeDocument::FoldRegion* CCodeDocument::FindFoldRegion(int aLine) const
+{
+	auto it = std::lower_bound(mFoldRegions.begin(), mFoldRegions.end(), aLine,
+		[](const FoldRegion& aRegion, int aValue) { return aRegion.mStart < aValue; });
+
+	if (it == mFoldRegions.end() || it->mStart != aLine || it->mEnd - it->mStart < 2)
+		return nullptr;
+	return &*it;
+}
+
+// The innermost block around aLine that is folded, or isn't.
+const CCodeDocument::FoldRegion* CCodeDocument::FindEnclosingFoldRegion(int aLine, bool aFolded) const
+{
+	auto it = std::upper_bound(mFoldRegions.begin(), mFoldRegions.end(), aLine,
+		[](int aValue, const FoldRegion& aRegion) { return aValue < aRegion.mStart; });
+
+	while (it != mFoldRegions.begin())
+	{
+		--it;
+		if (it->mEnd >= aLine && it->mEnd - it->mStart >= 2 && IsFolded(it->mStart) == aFolded)
+			return &*it;
+	}
+	return nullptr;
+}
+
+bool CCodeDocument::IsLineHidden(int aLine) const
+{
+	auto it = std::upper_bound(mHiddenLines.begin(), mHiddenLines.end(), aLine,
+		[](int aValue, const HiddenLines& aHidden) { return aValue < aHidden.mFirst; });
+	return it != mHiddenLines.begin() && aLine < (it - 1)->mEnd;
+}
+
+// Unfolds the blocks that hide aLine.
+void CCodeDocument::RevealLine(int aLine)
+{
+	if (!IsLineHidden(aLine))
+		return;
+
+	for (auto& region : mFoldRegions)
+	{
+		if (region.mStart >= aLine)
+			break;
+		if (aLine < region.mEnd)
+			mFoldedLines.erase(region.mStart);
+	}
+
+	BuildHiddenLines();
+}
+
+// The screen row of a line; a hidden line is on the row of its block's first line.
+int CCodeDocument::LineToRow(int aLine) const
+{
+	auto it = std::upper_bound(mHiddenLines.begin(), mHiddenLines.end(), aLine,
+		[](int aValue, const HiddenLines& aHidden) { return aValue < aHidden.mFirst; });
+	if (it == mHiddenLines.begin())
+		return aLine;
+
+	--it;
+	if (aLine < it->mEnd)
+		return it->mFirst - 1 - it->mHiddenBefore;
+	return aLine - it->mHiddenBefore - (it->mEnd - it->mFirst);
+}
+
+int CCodeDocument::RowToLine(int aRow) const
+{
+	// the last run of hidden lines that starts at or before the row
+	auto it = std::upper_bound(mHiddenLines.begin(), mHiddenLines.end(), aRow,
+		[](int aValue, const HiddenLines& aHidden) { return aValue < aHidden.mFirst - aHidden.mHiddenBefore; });
+	if (it == mHiddenLines.begin())
+		return aRow;
+
+	--it;
+	return aRow + it->mHiddenBefore + (it->mEnd - it->mFirst);
+}
+
+void CCodeDocument::MarkLinesChanged(int aFromLine, int aToLine)
+{
+	mChangedLineMin = std::min(mChangedLineMin, aFromLine);
+	mChangedLineMax = std::max(mChangedLineMax, aToLine);
+}
+
+bool CCodeDocument::TakeChangedLines(int& aFromLine, int& aToLine)
+{
+	if (mChangedLineMin >= mChangedLineMax)
+		return false;
+
+	aFromLine = mChangedLineMin;
+	aToLine = mChangedLineMax;
+	mChangedLineMin = std::numeric_limits<int>::max();
+	mChangedLineMax = 0;
+	return true;
+}
+
+std::string CCodeDocument::GetText() const
+{
+	return GetText(Coordinates(), Coordinates((int)mLines.size(), 0));
+}
+
+const char* CCodeDocument::GetTextChunk(int& aCursor, size_t& aSize) const
+{
+	static const char newline = '\n';
+
+	// even cursors are lines, odd ones the newline after them; empty lines are skipped
+	while (aCursor / 2 < (int)mLines.size())
+	{
+		auto& line = mLines[aCursor / 2];
+
+		if (aCursor++ % 2 != 0)
+		{
+			aSize = 1;
+			return &newline;
+		}
+
+		if (!line.empty())
+		{
+			aSize = line.size();
+			return line.mText.data();
+		}
+	}
+
+	aSize = 0;
+	return nullptr;
+}
+
+std::vector<std::string> CCodeDocument::GetTextLines() const
+{
+	std::vector<std::string> result;
+
+	result.reserve(mLines.size());
+
+	for (auto & line : mLines)
+	{
+		std::string text;
+
+		text.resize(line.size());
+
+		for (size_t i = 0; i < line.size(); ++i)
+			text[i] = line.GetChar(i);
+
+		result.emplace_back(std::move(text));
+	}
+
+	return result;
+}
+
+std::string CCodeDocument::GetSelectedText() const
+{
+	return GetText(mState.mSelectionStart, mState.mSelectionEnd);
+}
+
+std::string CCodeDocument::GetCurrentLineText()const
+{
+	auto lineLength = GetLineMaxColumn(mState.mCursorPosition.mLine);
+	return GetText(
+		Coordinates(mState.mCursorPosition.mLine, 0),
+		Coordinates(mState.mCursorPosition.mLine, lineLength));
+}
+
+void CCodeDocument::Update()
+{
+	ColorizeInternal();
+	UpdateFolds();
+}
+
+bool CCodeDocument::IsColorizing() const
+{
+	return mColorizerEnabled && (mCheckComments || mColorRangeMin < mColorRangeMax || mColorizeJob != nullptr);
+}
+
+void CCodeDocument::Colorize(int aFromLine, int aLines)
+{
+	int toLine = aLines == -1 ? (int)mLines.size() : std::min((int)mLines.size(), aFromLine + aLines);
+	mColorRangeMin = std::min(mColorRangeMin, aFromLine);
+	mColorRangeMax = std::max(mColorRangeMax, toLine);
+	mColorRangeMin = std::max(0, mColorRangeMin);
+	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
+	mCheckCommentsMin = std::max(0, std::min(mCheckCommentsMin, aFromLine));
+	mCheckCommentsMax = std::max(mCheckCommentsMax, toLine);
+	mCheckComments = true;
+	++mColorizeGeneration;
+}
+
+void CCodeDocument::ColorizeRange(int aFromLine, int aToLine)
+{
+	int endLine = std::max(0, std::min((int)mLines.size(), aToLine));
+	if (aFromLine >= endLine)
+		return;
+
+	IdentifierSpans identifiers;
+	ColorizeLines(mLines.data() + aFromLine, mLines.data() + endLine, *mColorizer, identifiers);
+
+	for (int i = aFromLine; i < endLine; ++i)
+		IndexLineSymbols(i, identifiers, i - aFromLine);
+
+	mFoldRegionsDirty = true;
+	mPairsDirty = true;
+	MarkLinesChanged(aFromLine, endLine);
+}
+
+void CCodeDocument::ColorizeLines(Line* aBegin, Line* aEnd, const Colorizer& aColorizer, IdentifierSpans& aIdentifiers)
+{
+	auto& languageDefinition = aColorizer.mLanguageDefinition;
+
+	std::cmatch results;
+
+	aIdentifiers.mSpans.clear();
+	aIdentifiers.mLineStart.clear();
+
+	for (Line* it = aBegin; it != aEnd; ++it)
+	{
+		auto& line = *it;
+
+		aIdentifiers.mLineStart.push_back((int)aIdentifiers.mSpans.size());
+
+		line.mBlockOpens = 0;
+		line.mBlockCloses = 0;
+		line.mPairs.clear();
+
+		if (line.empty())
+			continue;
+
+		int blockOpens = 0;
+		int blockCloses = 0;
+
+		for (auto& attributes : line.mAttributes)
+			attributes &= ~Line::ColorMask;
+
+		const char * bufferBegin = line.mText.data();
+		const char * bufferEnd = bufferBegin + line.size();
+
+		auto last = bufferEnd;
+
+		for (auto first = bufferBegin; first != last; )
+		{
+			const char * token_begin = nullptr;
+			const char * token_end = nullptr;
+			PaletteIndex token_color = PaletteIndex::Default;
+
+			bool hasTokenizeResult = false;
+
+			if (languageDefinition.mTokenize != nullptr)
+			{
+				if (languageDefinition.mTokenize(first, last, token_begin, token_end, token_color))
+					hasTokenizeResult = true;
+			}
+
+			if (hasTokenizeResult == false)
+			{
+				// todo : remove
+				//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
+
+				for (auto& p : aColorizer.mRegexList)
+				{
+					if (std::regex_search(first, last, results, p.first, std::regex_constants::match_continuous))
+					{
+						hasTokenizeResult = true;
+
+						auto& v = *results.begin();
+						token_begin = v.first;
+						token_end = v.second;
+						token_color = p.second;
+						break;
+					}
+				}
+			}
+
+			if (hasTokenizeResult == false)
+			{
+				first++;
+			}
+			else
+			{
+				const size_t token_length = token_end - token_begin;
+
+				if (token_color == PaletteIndex::Identifier)
+				{
+					// todo : allmost all language definitions use lower case to specify keywords, so shouldn't this use ::tolower ?
+					const int word = aColorizer.mWords.Find(token_begin, token_end, !languageDefinition.mCaseSensitive);
+					const uint8_t tag = word >= 0 ? aColorizer.mWords.GetTag(word) : 0;
+
+					if (!line.IsPreprocessor(first - bufferBegin))
+					{
+						if (tag & WordTag_Keyword)
+							token_color = PaletteIndex::Keyword;
+						else if (tag & WordTag_Identifier)
+							token_color = PaletteIndex::KnownIdentifier;
+						else if (tag & WordTag_PreprocIdentifier)
+							token_color = PaletteIndex::PreprocIdentifier;
+					}
+					else
+					{
+						if (tag & WordTag_PreprocIdentifier)
+							token_color = PaletteIndex::PreprocIdentifier;
+					}
+
+					// words in comments aren't worth completing; the comment scan sends
+					// the line back here when a comment opens or closes around them
+					if (token_color == PaletteIndex::Identifier && line.GetComment(token_begin - bufferBegin) == CommentKind::None)
+					{
+						aIdentifiers.mSpans.push_back((int)(token_begin - bufferBegin));
+						aIdentifiers.mSpans.push_back((int)(token_end - bufferBegin));
+					}
+
+					// a closer matches an opener earlier on the line first (elseif closes one
+					// then and is followed by another)
+					if (token_color == PaletteIndex::Keyword && (tag & (WordTag_BlockOpen | WordTag_BlockClose)) != 0 &&
+						line.GetComment(token_begin - bufferBegin) == CommentKind::None)
+					{
+						if (tag & WordTag_BlockClose)
+						{
+							if (blockOpens > 0)
+								blockOpens--;
+							else
+								blockCloses++;
+						}
+						if (tag & WordTag_BlockOpen)
+							blockOpens++;
+					}
+
+					if (token_color == PaletteIndex::Keyword && (tag & (WordTag_BlockOpen | WordTag_BlockClose | WordTag_BlockLeader | WordTag_BlockFollower)) != 0 &&
+						token_length <= 0xff && line.GetComment(token_begin - bufferBegin) == CommentKind::None)
+					{
+						line.mPairs.push_back(Line::PairToken{ (int)(token_begin - bufferBegin), (uint8_t)token_length, 0, tag });
+					}
+				}
+				else if (token_color == PaletteIndex::Punctuation && line.GetComment(token_begin - bufferBegin) == CommentKind::None)
+				{
+					for (auto p = token_begin; p != token_end; ++p)
+					{
+						if (*p != '\0' && strchr("()[]{}", *p) != nullptr)
+							line.mPairs.push_back(Line::PairToken{ (int)(p - bufferBegin), 1, *p, 0 });
+					}
+				}
+
+				for (size_t j = 0; j < token_length; ++j)
+					line.SetColor((token_begin - bufferBegin) + j, token_color);
+
+				first = token_end;
+			}
+		}
+
+		line.mBlockOpens = (uint16_t)std::min(blockOpens, 0xffff);
+		line.mBlockCloses = (uint16_t)std::min(blockCloses, 0xffff);
+	}
+
+	aIdentifiers.mLineStart.push_back((int)aIdentifiers.mSpans.size());
+}
+
+// Recounts a line's identifiers in mSymbols from the spans the tokenizer found
+// in it, aIndex being the line's place in aIdentifiers.
+void CCodeDocument::IndexLineSymbols(int aLine, const IdentifierSpans& aIdentifiers, int aIndex)
+{
+	auto& symbols = mLineSymbols[aLine];
+	for (int node : symbols)
+		mSymbols.Release(node);
+	symbols.clear();
+
+	const char* text = mLines[aLine].mText.data();
+	for (int i = aIdentifiers.mLineStart[aIndex]; i < aIdentifiers.mLineStart[aIndex + 1]; i += 2)
+		symbols.push_back(mSymbols.Add(text + aIdentifiers.mSpans[i], text + aIdentifiers.mSpans[i + 1]));
+}
+
+// Starts the completion words over from the language's, for a new text or language.
+void CCodeDocument::ResetSymbols()
+{
+	mSymbols = mColorizer->mWords;
+	mLineSymbols.assign(mLines.size(), std::vector<int>());
+	mCompletions.clear();
+}
+
+void CCodeDocument::ColorizeInternal()
+{
+	if (mLines.empty() || !mColorizerEnabled)
+		return;
+
+	if (mCheckComments)
+	{
+		if (mLineStates.size() != mLines.size())
+		{
+			mLineStates.assign(mLines.size(), LineState());
+			mCheckCommentsMin = 0;
+			mCheckCommentsMax = (int)mLines.size();
+		}
+
+		// Lines before mCheckCommentsMin are untouched, so the state stored for it
+		// is still valid. Past the edited lines, stop as soon as the state flowing
+		// into a line is the one its flags were last computed with.
+		const int endLine = (int)mLines.size();
+		int currentLine = std::min(std::max(0, mCheckCommentsMin), endLine - 1);
+		const int scanLine = currentLine;
+		const int budgetLine = currentLine + COMMENT_SCAN_LINES;
+		LineState state = mLineStates[currentLine];
+		bool paused = false;
+		bool requeued = false;
+
+		for (; currentLine < endLine; ++currentLine)
+		{
+			if (currentLine >= mCheckCommentsMax && state == mLineStates[currentLine])
+				break;
+
+			// The tokenizer leaves out what's commented when it counts blocks, pairs
+			// and identifiers, so a line moving in or out of a comment is tokenized again.
+			if (!(state == mLineStates[currentLine]))
+			{
+				mColorRangeMin = std::min(mColorRangeMin, currentLine);
+				mColorRangeMax = std::max(mColorRangeMax, currentLine + 1);
+				requeued = true;
+			}
+
+			if (currentLine == budgetLine)
+			{
+				// resume here next frame; this line still has to be scanned with the new state
+				mLineStates[currentLine] = state;
+				mCheckCommentsMin = currentLine;
+				mCheckCommentsMax = std::max(mCheckCommentsMax, currentLine + 1);
+				paused = true;
+				break;
+			}
+
+			mLineStates[currentLine] = state;
+			state = mLanguageDefinition.mLongBrackets
+				? ScanLineLongBrackets(mLines[currentLine], state)
+				: ScanLineComments(mLines[currentLine], state);
+		}
+
+		if (!paused)
+		{
+			mCheckCommentsMin = std::numeric_limits<int>::max();
+			mCheckCommentsMax = 0;
+			mCheckComments = false;
+		}
+
+		// the view pass picks the requeued lines up this frame when they're on screen
+		if (requeued)
+			++mColorizeGeneration;
+
+		// multi-line comments fold too, and hide the pairs in them
+		mFoldRegionsDirty = true;
+		mPairsDirty = true;
+		MarkLinesChanged(scanLine, currentLine + 1);
+	}
+
+	CollectColorizeJob();
+
+	// Lines the comment scan hasn't reached yet would be snapshotted with stale preprocessor flags.
+	const int scannedLine = mCheckComments ? mCheckCommentsMin : std::numeric_limits<int>::max();
+	if (mColorRangeMin < mColorRangeMax && mColorRangeMin < scannedLine && mColorizeJob == nullptr)
+	{
+		const int to = std::min({ mColorRangeMin + COLORIZE_JOB_LINES, mColorRangeMax, scannedLine });
+		PostColorizeJob(mColorRangeMin, to);
+		mColorRangeMin = to;
+
+		if (mColorRangeMax == mColorRangeMin)
+		{
+			mColorRangeMin = std::numeric_limits<int>::max();
+			mColorRangeMax = 0;
+		}
+	}
+
+	// On-screen lines the bulk pass won't get to for a while, e.g. right after
+	// opening a large file at its end, are tokenized here first. The bulk pass
+	// still goes over them later, with comment state that has caught up.
+	const int viewMin = std::max(mViewLineMin, mColorRangeMin);
+	const int viewMax = std::min({ mViewLineMax, mColorRangeMax, (int)mLines.size() });
+	if (viewMin < viewMax && (mViewColorizedGeneration != mColorizeGeneration || viewMin < mViewColorizedMin || viewMax > mViewColorizedMax))
+	{
+		ColorizeRange(viewMin, viewMax);
+		mViewColorizedMin = viewMin;
+		mViewColorizedMax = viewMax;
+		mViewColorizedGeneration = mColorizeGeneration;
+	}
+}
+
+void CCodeDocument::PostColorizeJob(int aFromLine, int aToLine)
+{
+	aToLine = std::min(aToLine, (int)mLines.size());
+	if (aFromLine >= aToLine)
+		return;
+
+	mColorizeJob = std::make_unique<ColorizeJob>();
+	ColorizeJob* job = mColorizeJob.get();
+	job->mColorizer = mColorizer;
+	job->mGeneration = mColorizeGeneration;
+	job->mFirstLine = aFromLine;
+	job->mLines.resize(aToLine - aFromLine);
+	for (int i = aFromLine; i < aToLine; ++i)
+	{
+		// the layout cache is no use to the tokenizer
+		job->mLines[i - aFromLine].mText = mLines[i].mText;
+		job->mLines[i - aFromLine].mAttributes = mLines[i].mAttributes;
+	}
+
+	auto run = [job]()
+	{
+		ColorizeLines(job->mLines.data(), job->mLines.data() + job->mLines.size(), *job->mColorizer, job->mIdentifiers);
+		job->mDone.store(true, std::memory_order_release);
+	};
+
+	// The thread only lives for one job, so nothing is left running between edits.
+	try
+	{
+		mColorizeThread = std::thread(run);
+	}
+	catch (const std::system_error&)
+	{
+		run();
+	}
+}
+
+void CCodeDocument::CollectColorizeJob()
+{
+	if (mColorizeJob == nullptr || !mColorizeJob->mDone.load(std::memory_order_acquire))
+		return;
+
+	if (mColorizeThread.joinable())
+		mColorizeThread.join();
+
+	std::unique_ptr<ColorizeJob> job = std::move(mColorizeJob);
+	const int jobEnd = job->mFirstLine + (int)job->mLines.size();
+
+	if (job->mColorizer != mColorizer)
+	{
+		// the language changed while the job ran
+		mColorRangeMin = std::min(mColorRangeMin, job->mFirstLine);
+		mColorRangeMax = std::max(mColorRangeMax, jobEnd);
+		return;
+	}
+
+	// With no edit since the snapshot every line can be taken as is; otherwise
+	// only lines whose text still matches, the rest are queued again.
+	const bool unchanged = job->mGeneration == mColorizeGeneration;
+	const int endLine = std::min(jobEnd, (int)mLines.size());
+	for (int i = job->mFirstLine; i < endLine; ++i)
+	{
+		auto& line = mLines[i];
+		auto& colored = job->mLines[i - job->mFirstLine];
+
+		if (line.size() != colored.size() || (!unchanged && line.mText != colored.mText))
+		{
+			mColorRangeMin = std::min(mColorRangeMin, i);
+			mColorRangeMax = std::max(mColorRangeMax, i + 1);
+			continue;
+		}
+
+		for (size_t j = 0; j < line.size(); ++j)
+			line.mAttributes[j] = (line.mAttributes[j] & ~Line::ColorMask) | (colored.mAttributes[j] & Line::ColorMask);
+		line.mBlockOpens = colored.mBlockOpens;
+		line.mBlockCloses = colored.mBlockCloses;
+		line.mPairs.swap(colored.mPairs);
+
+		IndexLineSymbols(i, job->mIdentifiers, i - job->mFirstLine);
+	}
+
+	mFoldRegionsDirty = true;
+	mPairsDirty = true;
+	MarkLinesChanged(job->mFirstLine, endLine);
+}
+
+CCodeDocument::LineState CCodeDocument::ScanLineComments(Line& aLine, LineState aState) const
+{
+	auto withinString = aState.mInString;
+	auto withinComment = aState.mInComment;
+	auto withinSingleLineComment = aState.mConcatenate && aState.mInSingleLineComment;
+	auto withinPreproc = aState.mConcatenate && aState.mInPreproc;
+	auto firstChar = !aState.mConcatenate || aState.mFirstChar;	// there is no other non-whitespace characters in the line before
+	auto concatenate = false;		// '\' on the very end of the line
+
+	auto& startStr = mLanguageDefinition.mCommentStart;
+	auto& endStr = mLanguageDefinition.mCommentEnd;
+	auto& singleStartStr = mLanguageDefinition.mSingleLineComment;
+
+	for (int currentIndex = 0; currentIndex < (int)aLine.size(); )
+	{
+		auto c = aLine.GetChar(currentIndex);
+
+		if (c != mLanguageDefinition.mPreprocChar && !isspace(c))
+			firstChar = false;
+
+		if (currentIndex == (int)aLine.size() - 1 && aLine.GetChar(aLine.size() - 1) == '\\')
+			concatenate = true;
+
+		if (withinString)
+		{
+			const auto kind = withinComment ? CommentKind::MultiLine : CommentKind::None;
+			aLine.SetComment(currentIndex, kind);
+
+			if (c == '\"')
+			{
+				if (currentIndex + 1 < (int)aLine.size() && aLine.GetChar(currentIndex + 1) == '\"')
+				{
+					currentIndex += 1;
+					if (currentIndex < (int)aLine.size())
+						aLine.SetComment(currentIndex, kind);
+				}
+				else
+					withinString = false;
+			}
+			else if (c == '\\')
+			{
+				currentIndex += 1;
+				if (currentIndex < (int)aLine.size())
+					aLine.SetComment(currentIndex, kind);
+			}
+		}
+		else
+		{
+			if (firstChar && c == mLanguageDefinition.mPreprocChar)
+				withinPreproc = true;
+
+			if (c == '\"')
+			{
+				withinString = true;
+				aLine.SetComment(currentIndex, withinComment ? CommentKind::MultiLine : CommentKind::None);
+			}
+			else
+			{
+				if (singleStartStr.size() > 0 &&
+					currentIndex + singleStartStr.size() <= aLine.size() &&
+					aLine.mText.compare(currentIndex, singleStartStr.size(), singleStartStr) == 0)
+				{
+					withinSingleLineComment = true;
+				}
+				else if (!withinSingleLineComment && currentIndex + startStr.size() <= aLine.size() &&
+					aLine.mText.compare(currentIndex, startStr.size(), startStr) == 0)
+				{
+					withinComment = true;
+				}
+
+				aLine.SetComment(currentIndex, withinSingleLineComment ? CommentKind::SingleLine
+					: withinComment ? CommentKind::MultiLine : CommentKind::None);
+
+				if (currentIndex + 1 >= (int)endStr.size() &&
+					aLine.mText.compare(currentIndex + 1 - endStr.size(), endStr.size(), endStr) == 0)
+				{
+					withinComment = false;
+				}
+			}
+		}
+		aLine.SetPreprocessor(currentIndex, withinPreproc);
+		currentIndex += UTF8CharLength(c);
+	}
+
+	LineState next;
+	next.mInString = withinString;
+	next.mInComment = withinComment;
+	next.mConcatenate = concatenate;
+	if (concatenate)
+	{
+		next.mInSingleLineComment = withinSingleLineComment;
+		next.mInPreproc = withinPreproc;
+		next.mFirstChar = firstChar;
+	}
+	return next;
+}
+
+// Matches a long bracket opening ([[, [=[, ...) at aIndex and returns its level, or -1.
+static int MatchLongBracketOpen(const CCodeDocument::Line& aLine, int aIndex, int& aEnd)
+{
+	int i = aIndex + 1;
+	while (i < (int)aLine.size() && aLine.GetChar(i) == '=')
+		i++;
+
+	if (i < (int)aLine.size() && aLine.GetChar(i) == '[')
+	{
+		aEnd = i + 1;
+		return i - aIndex - 1;
+	}
+
+	return -1;
+}
+
+CCodeDocument::LineState CCodeDocument::ScanLineLongBrackets(Line& aLine, LineState aState) const
+{
+	auto withinComment = aState.mInComment;
+	auto withinString = aState.mInLongString;
+	auto withinSingleLineComment = false;
+	int level = aState.mLongLevel;
+	int contentStart = 0;	// where the text of the open long bracket starts, a close can't overlap the opener
+	char quote = 0;			// short strings can't span lines (a trailing '\' aside, which is rare enough to ignore)
+
+	for (int currentIndex = 0; currentIndex < (int)aLine.size(); )
+	{
+		auto c = aLine.GetChar(currentIndex);
+		int openEnd = currentIndex + 1;
+
+		if (!withinComment && !withinString && !withinSingleLineComment)
+		{
+			if (quote != 0)
+			{
+				if (c == '\\')
+					openEnd = currentIndex + 2;
+				else if (c == quote)
+					quote = 0;
+			}
+			else if (c == '\"' || c == '\'')
+				quote = c;
+			else if (c == '-' && currentIndex + 1 < (int)aLine.size() && aLine.GetChar(currentIndex + 1) == '-')
+			{
+				int bracketEnd;
+				int bracketLevel = currentIndex + 2 < (int)aLine.size() && aLine.GetChar(currentIndex + 2) == '['
+					? MatchLongBracketOpen(aLine, currentIndex + 2, bracketEnd) : -1;
+
+				if (bracketLevel >= 0)
+				{
+					withinComment = true;
+					level = bracketLevel;
+					contentStart = openEnd = bracketEnd;
+				}
+				else
+					withinSingleLineComment = true;
+			}
+			else if (c == '[')
+			{
+				int bracketEnd;
+				int bracketLevel = MatchLongBracketOpen(aLine, currentIndex, bracketEnd);
+
+				if (bracketLevel >= 0)
+				{
+					withinString = true;
+					level = bracketLevel;
+					contentStart = openEnd = bracketEnd;
+				}
+			}
+		}
+
+		openEnd = std::min(std::max(openEnd, currentIndex + UTF8CharLength(c)), (int)aLine.size());
+		for (; currentIndex < openEnd; ++currentIndex)
+		{
+			aLine.SetComment(currentIndex, withinSingleLineComment ? CommentKind::SingleLine
+				: withinComment ? CommentKind::MultiLine
+				: withinString ? CommentKind::MultiLineString : CommentKind::None);
+			aLine.SetPreprocessor(currentIndex, false);
+
+			// ]==] closes the bracket once the character ending it has been marked
+			if ((withinComment || withinString) && aLine.GetChar(currentIndex) == ']' && currentIndex - level - 1 >= contentStart)
+			{
+				int i = currentIndex - 1;
+				while (i > currentIndex - level - 1 && aLine.GetChar(i) == '=')
+					i--;
+
+				if (i == currentIndex - level - 1 && aLine.GetChar(i) == ']')
+				{
+					withinComment = false;
+					withinString = false;
+				}
+			}
+		}
+	}
+
+	LineState next;
+	next.mInComment = withinComment;
+	next.mInLongString = withinString;
+	next.mLongLevel = (withinComment || withinString) ? (uint8_t)std::min(level, 255) : 0;
+	return next;
+}
+
+// Scrolling is up to the view: it scrolls to the primary cursor at the end of its
+// next Render(), so a ForEachCursor() edit scrolls once, when it's done.
+void CCodeDocument::EnsureCursorVisible()
+{
+	RevealLine(mState.mCursorPosition.mLine);
+	mScrollToCursor = true;
+}
+
+CCodeDocument::UndoRecord::UndoRecord(
+	const std::string& aAdded,
+	const CCodeDocument::Coordinates aAddedStart,
+	const CCodeDocument::Coordinates aAddedEnd,
+	const std::string& aRemoved,
+	const CCodeDocument::Coordinates aRemovedStart,
+	const CCodeDocument::Coordinates aRemovedEnd,
+	CCodeDocument::EditorState& aBefore,
+	CCodeDocument::EditorState& aAfter)
+	: mAdded(aAdded)
+	, mAddedStart(aAddedStart)
+	, mAddedEnd(aAddedEnd)
+	, mRemoved(aRemoved)
+	, mRemovedStart(aRemovedStart)
+	, mRemovedEnd(aRemovedEnd)
+	, mBefore(aBefore)
+	, mAfter(aAfter)
+{
+	assert(mAddedStart <= mAddedEnd);
+	assert(mRemovedStart <= mRemovedEnd);
+}
+
+void CCodeDocument::UndoRecord::Undo(CCodeDocument * aEditor)
+{
+	UndoText(aEditor);
+
+	aEditor->mState = mBefore;
+	aEditor->EnsureCursorVisible();
+}
+
+void CCodeDocument::UndoRecord::Redo(CCodeDocument * aEditor)
+{
+	RedoText(aEditor);
+
+	aEditor->mState = mAfter;
+	aEditor->EnsureCursorVisible();
+}
+
+void CCodeDocument::UndoRecord::UndoText(CCodeDocument * aEditor)
+{
+	for (auto it = mParts.rbegin(); it != mParts.rend(); ++it)
+		it->UndoText(aEditor);
+
+	if (!mAdded.empty())
+	{
+		aEditor->DeleteRange(mAddedStart, mAddedEnd);
+		aEditor->Colorize(mAddedStart.mLine - 1, mAddedEnd.mLine - mAddedStart.mLine + 2);
+	}
+
+	if (!mRemoved.empty())
+	{
+		auto start = mRemovedStart;
+		aEditor->InsertTextAt(start, mRemoved.c_str());
+		aEditor->Colorize(mRemovedStart.mLine - 1, mRemovedEnd.mLine - mRemovedStart.mLine + 2);
+	}
+}
+
+void CCodeDocument::UndoRecord::RedoText(CCodeDocument * aEditor)
+{
+	for (auto& part : mParts)
+		part.RedoText(aEditor);
+
+	if (!mRemoved.empty())
+	{
+		aEditor->DeleteRange(mRemovedStart, mRemovedEnd);
+		aEditor->Colorize(mRemovedStart.mLine - 1, mRemovedEnd.mLine - mRemovedStart.mLine + 2);
+	}
+
+	if (!mAdded.empty())
+	{
+		auto start = mAddedStart;
+		aEditor->InsertTextAt(start, mAdded.c_str());
+		aEditor->Colorize(mAddedStart.mLine - 1, mAddedEnd.mLine - mAddedStart.mLine + 2);
+	}
+}
+
+// True for a single character other than a line break, as a keystroke inserts or removes it.
+static bool IsSingleCharacter(const std::string& aText)
+{
+	return !aText.empty() && aText[0] != '\n' && CCodeDocument::UTF8CharLength(aText[0]) == (int)aText.size();
+}
+
+static bool IsBlank(char aChar)
+{
+	return aChar == ' ' || aChar == '\t';
+}
+
+bool CCodeDocument::UndoRecord::Merge(const UndoRecord& aNext)
+{
+	if (!mParts.empty() || !aNext.mParts.empty())
+	{
+		// A multi-cursor keystroke merges cursor by cursor. Each part's coordinates
+		// leave out the edits of the parts made after it, which only holds if no
+		// two cursors share a line.
+		if (mParts.size() != aNext.mParts.size())
+			return false;
+
+		auto lineOf = [](const UndoRecord& aPart) { return aPart.mAdded.empty() ? aPart.mRemovedStart.mLine : aPart.mAddedStart.mLine; };
+		for (size_t i = 1; i < aNext.mParts.size(); ++i)
+		{
+			if (lineOf(aNext.mParts[i]) == lineOf(aNext.mParts[i - 1]))
+				return false;
+		}
+
+		auto parts = mParts;
+		for (size_t i = 0; i < parts.size(); ++i)
+		{
+			if (!parts[i].Merge(aNext.mParts[i]))
+				return false;
+		}
+
+		mParts = std::move(parts);
+		mAfter = aNext.mAfter;
+		return true;
+	}
+
+	if (!mAdded.empty() && mRemoved.empty() && aNext.mRemoved.empty() && IsSingleCharacter(aNext.mAdded))
+	{
+		// typing: aNext was inserted right where this insertion ended
+		if (aNext.mAddedStart != mAddedEnd || mAdded.find('\n') != std::string::npos)
+			return false;
+		if (IsBlank(mAdded.back()) && !IsBlank(aNext.mAdded[0]))
+			return false;
+
+		mAdded += aNext.mAdded;
+		mAddedEnd = aNext.mAddedEnd;
+	}
+	else if (mAdded.empty() && !mRemoved.empty() && aNext.mAdded.empty() && IsSingleCharacter(aNext.mRemoved))
+	{
+		if (mRemoved.find('\n') != std::string::npos)
+			return false;
+
+		if (aNext.mRemovedEnd == mRemovedStart)
+		{
+			// backspace: aNext removed the character in front of this range
+			if (IsBlank(mRemoved.front()) && !IsBlank(aNext.mRemoved[0]))
+				return false;
+
+			mRemoved.insert(0, aNext.mRemoved);
+			mRemovedStart = aNext.mRemovedStart;
+		}
+		else if (aNext.mRemovedStart == mRemovedStart && aNext.mRemovedEnd.mLine == mRemovedStart.mLine && aNext.mRemoved[0] != '\t')
+		{
+			// delete: aNext removed the character that moved up to the same spot. Its
+			// width is the same in the text before this record, unless it is a tab.
+			if (IsBlank(mRemoved.back()) && !IsBlank(aNext.mRemoved[0]))
+				return false;
+
+			mRemoved += aNext.mRemoved;
+			mRemovedEnd.mColumn += aNext.mRemovedEnd.mColumn - aNext.mRemovedStart.mColumn;
+		}
+		else
+			return false;
+	}
+	else
+		return false;
+
+	mAfter = aNext.mAfter;
+	return true;
+}
+
+size_t CCodeDocument::UndoRecord::GetMemoryUsage() const
+{
+	// Short text lives inside the std::string itself, so single keystrokes
+	// cost no more than the record.
+	static const size_t inlineCapacity = std::string().capacity();
+
+	size_t bytes = sizeof(UndoRecord);
+	if (mAdded.capacity() > inlineCapacity)
+		bytes += mAdded.capacity() + 1;
+	if (mRemoved.capacity() > inlineCapacity)
+		bytes += mRemoved.capacity() + 1;
+
+	bytes += (mBefore.mExtraCursors.capacity() + mAfter.mExtraCursors.capacity()) * sizeof(Cursor);
+	bytes += (mParts.capacity() - mParts.size()) * sizeof(UndoRecord);
+	for (auto& part : mParts)
+		bytes += part.GetMemoryUsage();
+	return bytes;
+}
+
+// Journal records are the kind byte, then plain copies of the values: the
+// journal is read back by the same build, on the same machine.
+template<class T>
+static void WriteJournal(std::string& aOut, const T& aValue)
+{
+	aOut.append((const char*)&aValue, sizeof(T));
+}
+
+static void WriteJournal(std::string& aOut, const std::string& aValue)
+{
+	WriteJournal(aOut, (uint32_t)aValue.size());
+	aOut.append(aValue);
+}
+
+template<class T>
+static bool ReadJournal(const char*& aIn, const char* aEnd, T& aValue)
+{
+	if ((size_t)(aEnd - aIn) < sizeof(T))
+		return false;
+	memcpy(&aValue, aIn, sizeof(T));
+	aIn += sizeof(T);
+	return true;
+}
+
+static bool ReadJournal(const char*& aIn, const char* aEnd, std::string& aValue)
+{
+	uint32_t size;
+	if (!ReadJournal(aIn, aEnd, size) || (size_t)(aEnd - aIn) < size)
+		return false;
+	aValue.assign(aIn, size);
+	aIn += size;
+	return true;
+}
+
+void CCodeDocument::WriteJournalState(std::string& aOut, const EditorState& aState)
+{
+	WriteJournal(aOut, static_cast<const Cursor&>(aState));
+	WriteJournal(aOut, (uint32_t)aState.mExtraCursors.size());
+	aOut.append((const char*)aState.mExtraCursors.data(), aState.mExtraCursors.size() * sizeof(Cursor));
+}
+
+bool CCodeDocument::ReadJournalState(const char*& aIn, const char* aEnd, EditorState& aState)
+{
+	uint32_t count;
+	if (!ReadJournal(aIn, aEnd, static_cast<Cursor&>(aState)) || !ReadJournal(aIn, aEnd, count) || (size_t)(aEnd - aIn) / sizeof(Cursor) < count)
+		return false;
+
+	aState.mExtraCursors.resize(count);
+	memcpy(aState.mExtraCursors.data(), aIn, count * sizeof(Cursor));
+	aIn += count * sizeof(Cursor);
+	return true;
+}
+
+void CCodeDocument::WriteJournalRecord(std::string& aOut, const UndoRecord& aRecord)
+{
+	WriteJournal(aOut, aRecord.mAdded);
+	WriteJournal(aOut, aRecord.mAddedStart);
+	WriteJournal(aOut, aRecord.mAddedEnd);
+	WriteJournal(aOut, aRecord.mRemoved);
+	WriteJournal(aOut, aRecord.mRemovedStart);
+	WriteJournal(aOut, aRecord.mRemovedEnd);
+	WriteJournalState(aOut, aRecord.mBefore);
+	WriteJournalState(aOut, aRecord.mAfter);
+
+	WriteJournal(aOut, (uint32_t)aRecord.mParts.size());
+	for (auto& part : aRecord.mParts)
+		WriteJournalRecord(aOut, part);
+}
+
+bool CCodeDocument::ReadJournalRecord(const char*& aIn, const char* aEnd, UndoRecord& aRecord)
+{
+	uint32_t parts;
+	if (!ReadJournal(aIn, aEnd, aRecord.mAdded) || !ReadJournal(aIn, aEnd, aRecord.mAddedStart) || !ReadJournal(aIn, aEnd, aRecord.mAddedEnd) ||
+		!ReadJournal(aIn, aEnd, aRecord.mRemoved) || !ReadJournal(aIn, aEnd, aRecord.mRemovedStart) || !ReadJournal(aIn, aEnd, aRecord.mRemovedEnd) ||
+		!ReadJournalState(aIn, aEnd, aRecord.mBefore) || !ReadJournalState(aIn, aEnd, aRecord.mAfter) || !ReadJournal(aIn, aEnd, parts))
+		return false;
+
+	// a part takes a few dozen bytes at least, which bounds a corrupt count
+	if (parts > (size_t)(aEnd - aIn))
+		return false;
+
+	aRecord.mParts.resize(parts);
+	for (auto& part : aRecord.mParts)
+	{
+		if (!ReadJournalRecord(aIn, aEnd, part))
+			return false;
+	}
+	return true;
+}
+
+void CCodeDocument::SendJournalRecord()
+{
+	mJournalCallback(mJournalRecord.data(), mJournalRecord.size());
+}
+
+void CCodeDocument::JournalText()
+{
+	if (!mJournalCallback)
+		return;
+
+	mJournalRecord.assign(1, (char)JournalKind_Text);
+	for (int cursor = 0; ; )
+	{
+		size_t size;
+		const char* chunk = GetTextChunk(cursor, size);
+		if (chunk == nullptr)
+			break;
+		mJournalRecord.append(chunk, size);
+	}
+
+	// the chunks end every line with a newline, the text has none after the last
+	if (mJournalRecord.size() > 1)
+		mJournalRecord.pop_back();
+	SendJournalRecord();
+}
+
+void CCodeDocument::JournalState()
+{
+	if (!mJournalCallback)
+		return;
+
+	mJournalRecord.assign(1, (char)JournalKind_State);
+	WriteJournalState(mJournalRecord, mState);
+	SendJournalRecord();
+}
+
+void CCodeDocument::JournalSteps(uint8_t aKind, int aSteps)
+{
+	if (!mJournalCallback || aSteps == 0)
+		return;
+
+	mJournalRecord.assign(1, (char)aKind);
+	WriteJournal(mJournalRecord, aSteps);
+	SendJournalRecord();
+}
+
+void CCodeDocument::JournalEdit(const UndoRecord& aRecord)
+{
+	if (!mJournalCallback)
+		return;
+
+	mJournalRecord.assign(1, (char)JournalKind_Edit);
+	WriteJournalRecord(mJournalRecord, aRecord);
+	SendJournalRecord();
+}
+
+void CCodeDocument::WriteJournalSnapshot()
+{
+	if (!mJournalCallback)
+		return;
+
+	JournalText();
+
+	mJournalRecord.assign(1, (char)JournalKind_History);
+	WriteJournal(mJournalRecord, mUndoIndex);
+	WriteJournal(mJournalRecord, (uint32_t)mUndoBuffer.size());
+	for (auto& record : mUndoBuffer)
+		WriteJournalRecord(mJournalRecord, record);
+	SendJournalRecord();
+
+	JournalState();
+}
+
+bool CCodeDocument::ReplayJournal(const char* aData, size_t aSize)
+{
+	if (aSize == 0)
+		return false;
+
+	// nothing replayed goes back into the journal
+	JournalCallback callback;
+	std::swap(callback, mJournalCallback);
+
+	const char* in = aData + 1;
+	const char* end = aData + aSize;
+	bool ok = true;
+
+	switch (aData[0])
+	{
+	case JournalKind_Text:
+		SetText(std::string(in, end));
+		break;
+
+	case JournalKind_Insert:
+	{
+		EditorState state;
+		ok = ReadJournalState(in, end, state);
+		if (ok)
+		{
+			mState = state;
+			InsertText(std::string(in, end));
+		}
+		break;
+	}
+
+	case JournalKind_Edit:
+	{
+		UndoRecord record;
+		ok = ReadJournalRecord(in, end, record);
+		if (ok)
+		{
+			record.Redo(this);
+			AddUndo(record);
+		}
+		break;
+	}
+
+	case JournalKind_Undo:
+	case JournalKind_Redo:
+	{
+		int steps;
+		ok = ReadJournal(in, end, steps);
+		if (ok && aData[0] == JournalKind_Undo)
+			Undo(steps);
+		else if (ok)
+			Redo(steps);
+		break;
+	}
+
+	case JournalKind_State:
+	{
+		EditorState state;
+		ok = ReadJournalState(in, end, state);
+		if (ok)
+		{
+			mState = state;
+			mInteractiveStart = mState.mSelectionStart;
+			mInteractiveEnd = mState.mSelectionEnd;
+			mCursorPositionChanged = true;
+			EnsureCursorVisible();
+		}
+		break;
+	}
+
+	case JournalKind_History:
+	{
+		int index = 0;
+		uint32_t count;
+		ok = ReadJournal(in, end, index) && ReadJournal(in, end, count) && count <= (size_t)(end - in);
+
+		UndoBuffer buffer;
+		for (uint32_t i = 0; ok && i < count; ++i)
+		{
+			buffer.emplace_back();
+			ok = ReadJournalRecord(in, end, buffer.back());
+		}
+
+		if (ok && index >= 0 && index <= (int)count)
+		{
+			mUndoBuffer = std::move(buffer);
+			mUndoIndex = index;
+			mUndoBytes = 0;
+			for (auto& record : mUndoBuffer)
+				mUndoBytes += record.GetMemoryUsage();
+		}
+		else
+			ok = false;
+		break;
+	}
+
+	default:
+		ok = false;
+		break;
+	}
+
+	std::swap(callback, mJournalCallback);
+	return ok;
+}
+
+static bool TokenizeCStyleString(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	const char * p = in_begin;
+
+	if (*p == '"')
+	{
+		p++;
+
+		while (p < in_end)
+		{
+			// handle end of string
+			if (*p == '"')
+			{
+				out_begin = in_begin;
+				out_end = p + 1;
+				return true;
+			}
+
+			// handle escape character for "
+			if (*p == '\\' && p + 1 < in_end && p[1] == '"')
+				p++;
+
+			p++;
+		}
+	}
+
+	return false;
+}
+
+static bool TokenizeCStyleCharacterLiteral(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	const char * p = in_begin;
+
+	if (*p == '\'')
+	{
+		p++;
+
+		// handle escape characters
+		if (p < in_end && *p == '\\')
+			p++;
+
+		if (p < in_end)
+			p++;
+
+		// handle end of character literal
+		if (p < in_end && *p == '\'')
+		{
+			out_begin = in_begin;
+			out_end = p + 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool TokenizeCStyleIdentifier(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	const char * p = in_begin;
+
+	if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_')
+	{
+		p++;
+
+		while ((p < in_end) && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
+			p++;
+
+		out_begin = in_begin;
+		out_end = p;
+		return true;
+	}
+
+	return false;
+}
+
+static bool TokenizeCStyleNumber(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	const char * p = in_begin;
+
+	const bool startsWithNumber = *p >= '0' && *p <= '9';
+
+	if (*p != '+' && *p != '-' && !startsWithNumber)
+		return false;
+
+	p++;
+
+	bool hasNumber = startsWithNumber;
+
+	while (p < in_end && (*p >= '0' && *p <= '9'))
+	{
+		hasNumber = true;
+
+		p++;
+	}
+
+	if (hasNumber == false)
+		return false;
+
+	bool isFloat = false;
+	bool isHex = false;
+	bool isBinary = false;
+
+	if (p < in_end)
+	{
+		if (*p == '.')
+		{
+			isFloat = true;
+
+			p++;
+
+			while (p < in_end && (*p >= '0' && *p <= '9'))
+				p++;
+		}
+		else if (*p == 'x' || *p == 'X')
+		{
+			// hex formatted integer of the type 0xef80
+
+			isHex = true;
+
+			p++;
+
+			while (p < in_end && ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F')))
+				p++;
+		}
+		else if (*p == 'b' || *p == 'B')
+		{
+			// binary formatted integer of the type 0b01011101
+
+			isBinary = true;
+
+			p++;
+
+			while (p < in_end && (*p >= '0' && *p <= '1'))
+				p++;
+		}
+	}
+
+	if (isHex == false && isBinary == false)
+	{
+		// floating point exponent
+		if (p < in_end && (*p == 'e' || *p == 'E'))
+		{
+			isFloat = true;
+
+			p++;
+
+			if (p < in_end && (*p == '+' || *p == '-'))
+				p++;
+
+			bool hasDigits = false;
+
+			while (p < in_end && (*p >= '0' && *p <= '9'))
+			{
+				hasDigits = true;
+
+				p++;
+			}
+
+			if (hasDigits == false)
+				return false;
+		}
+
+		// single precision floating point type
+		if (p < in_end && *p == 'f')
+			p++;
+	}
+
+	if (isFloat == false)
+	{
+		// integer size type
+		while (p < in_end && (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L'))
+			p++;
+	}
+
+	out_begin = in_begin;
+	out_end = p;
+	return true;
+}
+
+static bool TokenizeCStylePunctuation(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+{
+	(void)in_end;
+
+	switch (*in_begin)
+	{
+	case '[':
+	case ']':
+	case '{':
+	case '}':
+	case '!':
+	case '%':
+	case '^':
+	case '&':
+	case '*':
+	case '(':
+	case ')':
+	case '-':
+	case '+':
+	case '=':
+	case '~':
+	case '|':
+	case '<':
+	case '>':
+	case '?':
+	case ':':
+	case '/':
+	case ';':
+	case ',':
+	case '.':
+		out_begin = in_begin;
+		out_end = in_begin + 1;
+		return true;
+	}
+
+	return false;
+}
+
+// Character classes for the Lua tokenizer, so each token is picked with a single table lookup.
+enum LuaCharClass : uint8_t
+{
+	LuaChar_Other,
+	LuaChar_Blank,
+	LuaChar_Alpha,
+	LuaChar_Digit,
+	LuaChar_Quote,
+	LuaChar_Bracket,
+	LuaChar_Minus,
+	LuaChar_Dot,
+	LuaChar_Punctuation
+};
+
+static const struct LuaCharTable
+{
+	uint8_t mClass[256];
+
+	LuaCharTable() : mClass()
+	{
+		for (int c = 'a'; c <= 'z'; c++)
+			mClass[c] = LuaChar_Alpha;
+		for (int c = 'A'; c <= 'Z'; c++)
+			mClass[c] = LuaChar_Alpha;
+		for (int c = '0'; c <= '9'; c++)
+			mClass[c] = LuaChar_Digit;
+		for (const char * p = "+*/%^#&~|<>=(){}];:,"; *p; p++)
+			mClass[(uint8_t)*p] = LuaChar_Punctuation;
+
+		mClass[(uint8_t)'_'] = LuaChar_Alpha;
+		mClass[(uint8_t)' '] = LuaChar_Blank;
+		mClass[(uint8_t)'\t'] = LuaChar_Blank;
+		mClass[(uint8_t)'\v'] = LuaChar_Blank;
+		mClass[(uint8_t)'\f'] = LuaChar_Blank;
+		mClass[(uint8_t)'\r'] = LuaChar_Blank;
+		mClass[(uint8_t)'"'] = LuaChar_Quote;
+		mClass[(uint8_t)'\''] = LuaChar_Quote;
+		mClass[(uint8_t)'['] = LuaChar_Bracket;
+		mClass[(uint8_t)'-'] = LuaChar_Minus;
+		mClass[(uint8_t)'.'] = LuaChar_Dot;
+	}
+
+	uint8_t operator[](char c) const { return mClass[(uint8_t)c]; }
+} s_LuaChars;
+
+static inline bool IsLuaDigit(char c)
+{
+	return s_LuaChars[c] == LuaChar_Digit;
+}
+
+static inline bool IsLuaHexDigit(char c)
+{
+	return IsLuaDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Returns the level of a long bracket opening at in_begin ([[ or [==[), or -1.
+static int TokenizeLuaLongBracketOpen(const char * in_begin, const char * in_end, const char *& out_end)
+{
+	const char * p = in_begin + 1;
+	int level = 0;
+
+	while (p < in_end && *p == '=')
+	{
+		level++;
+		p++;
+	}
+
+	if (p < in_end && *p == '[')
+	{
+		out_end = p + 1;
+		return level;
+	}
+
+	return -1;
+}
+
+// Skips past the long bracket close of the given level, or to the end of the line if it isn't there.
+static const char * TokenizeLuaLongBracketClose(const char * p, const char * in_end, int level)
+{
+	while (p < in_end)
+	{
+		const char * close = (const char *)memchr(p, ']', in_end - p);
+		if (close == nullptr)
+			break;
+
+		const char * q = close + 1;
+		int equals = 0;
+		while (q < in_end && *q == '=')
+		{
+			equals++;
+			q++;
+		}
+
+		if (equals == level && q < in_end && *q == ']')
+			return q + 1;
+
+		p = close + 1;
+	}
+
+	return in_end;
+}
+
+static void TokenizeLuaExponent(const char *& p, const char * in_end, char lower, char upper)
+{
+	if (p < in_end && (*p == lower || *p == upper))
+	{
+		const char * e = p + 1;
+
+		if (e < in_end && (*e == '+' || *e == '-'))
+			e++;
+
+		if (e < in_end && IsLuaDigit(*e))
+		{
+			while (e < in_end && IsLuaDigit(*e))
+				e++;
+			p = e;
+		}
+	}
+}
+
+static const char * TokenizeLuaNumber(const char * in_begin, const char * in_end)
+{
+	const char * p = in_begin;
+
+	if (*p == '0' && p + 1 < in_end && (p[1] == 'x' || p[1] == 'X'))
+	{
+		// hexadecimal, with an optional fraction and binary exponent (0x1.8p-3)
+		p += 2;
+
+		while (p < in_end && IsLuaHexDigit(*p))
+			p++;
+
+		if (p < in_end && *p == '.')
+		{
+			p++;
+			while (p < in_end && IsLuaHexDigit(*p))
+				p++;
+		}
+
+		TokenizeLuaExponent(p, in_end, 'p', 'P');
+	}
+	else
+	{
+		while (p < in_end && IsLuaDigit(*p))
+			p++;
+
+		if (p < in_end && *p == '.')
+		{
+			p++;
+			while (p < in_end && IsLuaDigit(*p))
+				p++;
+		}
+
+		TokenizeLuaExponent(p, in_end, 'e', 'E');
+	}
+
+	return p;
+}
+
+static bool TokenizeLua(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, CCodeDocument::PaletteIndex & paletteIndex)
+{
+	using PaletteIndex = CCodeDocument::PaletteIndex;
+
+	while (in_begin < in_end && s_LuaChars[*in_begin] == LuaChar_Blank)
+		in_begin++;
+
+	out_begin = in_begin;
+	paletteIndex = PaletteIndex::Punctuation;
+
+	if (in_begin == in_end)
+	{
+		out_end = in_end;
+		paletteIndex = PaletteIndex::Default;
+		return true;
+	}
+
+	const char * p = in_begin;
+	const char * open = nullptr;
+	int level = -1;
+
+	switch (s_LuaChars[*p])
+	{
+	case LuaChar_Alpha:
+		p++;
+		while (p < in_end && (s_LuaChars[*p] == LuaChar_Alpha || s_LuaChars[*p] == LuaChar_Digit))
+			p++;
+		out_end = p;
+		paletteIndex = PaletteIndex::Identifier;
+		return true;
+
+	case LuaChar_Digit:
+		out_end = TokenizeLuaNumber(p, in_end);
+		paletteIndex = PaletteIndex::Number;
+		return true;
+
+	case LuaChar_Quote:
+		// an unterminated string runs to the end of the line, like the Lua lexer reports it
+		for (p++; p < in_end && *p != *in_begin; p++)
+		{
+			if (*p == '\\' && p + 1 < in_end)
+				p++;
+		}
+		out_end = p < in_end ? p + 1 : in_end;
+		paletteIndex = PaletteIndex::String;
+		return true;
+
+	case LuaChar_Bracket:
+		level = TokenizeLuaLongBracketOpen(p, in_end, open);
+		if (level >= 0)
+		{
+			out_end = TokenizeLuaLongBracketClose(open, in_end, level);
+			paletteIndex = PaletteIndex::String;
+		}
+		else
+			out_end = p + 1;
+		return true;
+
+	case LuaChar_Minus:
+		if (p + 1 < in_end && p[1] == '-')
+		{
+			p += 2;
+			if (p < in_end && *p == '[')
+				level = TokenizeLuaLongBracketOpen(p, in_end, open);
+
+			out_end = level >= 0 ? TokenizeLuaLongBracketClose(open, in_end, level) : in_end;
+			paletteIndex = PaletteIndex::Comment;
+		}
+		else
+			out_end = p + 1;
+		return true;
+
+	case LuaChar_Dot:
+		if (p + 1 < in_end && IsLuaDigit(p[1]))
+		{
+			out_end = TokenizeLuaNumber(p, in_end);
+			paletteIndex = PaletteIndex::Number;
+			return true;
+		}
+
+		// . .. ...
+		for (p++; p < in_end && p < in_begin + 3 && *p == '.'; p++);
+		out_end = p;
+		return true;
+
+	case LuaChar_Punctuation:
+		// == ~= <= >= << >> // ::
+		if (p + 1 < in_end)
+		{
+			const char c0 = p[0];
+			const char c1 = p[1];
+
+			if ((c1 == '=' && (c0 == '=' || c0 == '~' || c0 == '<' || c0 == '>')) ||
+				(c0 == c1 && (c0 == '<' || c0 == '>' || c0 == '/' || c0 == ':')))
+			{
+				out_end = p + 2;
+				return true;
+			}
+		}
+		out_end = p + 1;
+		return true;
+
+	default:
+		// Stray bytes (UTF-8 included) are consumed here as well, so the
+		// colorizer never has to fall back to the regex list for Lua.
+		out_end = p + 1;
+		paletteIndex = PaletteIndex::Default;
+		return true;
+	}
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::CPlusPlus()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const cppKeywords[] = {
+			"alignas", "alignof", "and", "and_eq", "asm", "atomic_cancel", "atomic_commit", "atomic_noexcept", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
+			"compl", "concept", "const", "constexpr", "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float",
+			"for", "friend", "goto", "if", "import", "inline", "int", "long", "module", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
+			"register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "synchronized", "template", "this", "thread_local",
+			"throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
+		};
+		for (auto& k : cppKeywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
+			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "printf", "sprintf", "snprintf", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper",
+			"std", "string", "vector", "map", "unordered_map", "set", "unordered_set", "min", "max"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
+				in_begin++;
+
+			if (in_begin == in_end)
+			{
+				out_begin = in_end;
+				out_end = in_end;
+				paletteIndex = PaletteIndex::Default;
+			}
+			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::CharLiteral;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = true;
+
+		langDef.mName = "C++";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::HLSL()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"AppendStructuredBuffer", "asm", "asm_fragment", "BlendState", "bool", "break", "Buffer", "ByteAddressBuffer", "case", "cbuffer", "centroid", "class", "column_major", "compile", "compile_fragment",
+			"CompileShader", "const", "continue", "ComputeShader", "ConsumeStructuredBuffer", "default", "DepthStencilState", "DepthStencilView", "discard", "do", "double", "DomainShader", "dword", "else",
+			"export", "extern", "false", "float", "for", "fxgroup", "GeometryShader", "groupshared", "half", "Hullshader", "if", "in", "inline", "inout", "InputPatch", "int", "interface", "line", "lineadj",
+			"linear", "LineStream", "matrix", "min16float", "min10float", "min16int", "min12int", "min16uint", "namespace", "nointerpolation", "noperspective", "NULL", "out", "OutputPatch", "packoffset",
+			"pass", "pixelfragment", "PixelShader", "point", "PointStream", "precise", "RasterizerState", "RenderTargetView", "return", "register", "row_major", "RWBuffer", "RWByteAddressBuffer", "RWStructuredBuffer",
+			"RWTexture1D", "RWTexture1DArray", "RWTexture2D", "RWTexture2DArray", "RWTexture3D", "sample", "sampler", "SamplerState", "SamplerComparisonState", "shared", "snorm", "stateblock", "stateblock_state",
+			"static", "string", "struct", "switch", "StructuredBuffer", "tbuffer", "technique", "technique10", "technique11", "texture", "Texture1D", "Texture1DArray", "Texture2D", "Texture2DArray", "Texture2DMS",
+			"Texture2DMSArray", "Texture3D", "TextureCube", "TextureCubeArray", "true", "typedef", "triangle", "triangleadj", "TriangleStream", "uint", "uniform", "unorm", "unsigned", "vector", "vertexfragment",
+			"VertexShader", "void", "volatile", "while",
+			"bool1","bool2","bool3","bool4","double1","double2","double3","double4", "float1", "float2", "float3", "float4", "int1", "int2", "int3", "int4", "in", "out", "inout",
+			"uint1", "uint2", "uint3", "uint4", "dword1", "dword2", "dword3", "dword4", "half1", "half2", "half3", "half4",
+			"float1x1","float2x1","float3x1","float4x1","float1x2","float2x2","float3x2","float4x2",
+			"float1x3","float2x3","float3x3","float4x3","float1x4","float2x4","float3x4","float4x4",
+			"half1x1","half2x1","half3x1","half4x1","half1x2","half2x2","half3x2","half4x2",
+			"half1x3","half2x3","half3x3","half4x3","half1x4","half2x4","half3x4","half4x4",
+		};
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"abort", "abs", "acos", "all", "AllMemoryBarrier", "AllMemoryBarrierWithGroupSync", "any", "asdouble", "asfloat", "asin", "asint", "asint", "asuint",
+			"asuint", "atan", "atan2", "ceil", "CheckAccessFullyMapped", "clamp", "clip", "cos", "cosh", "countbits", "cross", "D3DCOLORtoUBYTE4", "ddx",
+			"ddx_coarse", "ddx_fine", "ddy", "ddy_coarse", "ddy_fine", "degrees", "determinant", "DeviceMemoryBarrier", "DeviceMemoryBarrierWithGroupSync",
+			"distance", "dot", "dst", "errorf", "EvaluateAttributeAtCentroid", "EvaluateAttributeAtSample", "EvaluateAttributeSnapped", "exp", "exp2",
+			"f16tof32", "f32tof16", "faceforward", "firstbithigh", "firstbitlow", "floor", "fma", "fmod", "frac", "frexp", "fwidth", "GetRenderTargetSampleCount",
+			"GetRenderTargetSamplePosition", "GroupMemoryBarrier", "GroupMemoryBarrierWithGroupSync", "InterlockedAdd", "InterlockedAnd", "InterlockedCompareExchange",
+			"InterlockedCompareStore", "InterlockedExchange", "InterlockedMax", "InterlockedMin", "InterlockedOr", "InterlockedXor", "isfinite", "isinf", "isnan",
+			"ldexp", "length", "lerp", "lit", "log", "log10", "log2", "mad", "max", "min", "modf", "msad4", "mul", "noise", "normalize", "pow", "printf",
+			"Process2DQuadTessFactorsAvg", "Process2DQuadTessFactorsMax", "Process2DQuadTessFactorsMin", "ProcessIsolineTessFactors", "ProcessQuadTessFactorsAvg",
+			"ProcessQuadTessFactorsMax", "ProcessQuadTessFactorsMin", "ProcessTriTessFactorsAvg", "ProcessTriTessFactorsMax", "ProcessTriTessFactorsMin",
+			"radians", "rcp", "reflect", "refract", "reversebits", "round", "rsqrt", "saturate", "sign", "sin", "sincos", "sinh", "smoothstep", "sqrt", "step",
+			"tan", "tanh", "tex1D", "tex1D", "tex1Dbias", "tex1Dgrad", "tex1Dlod", "tex1Dproj", "tex2D", "tex2D", "tex2Dbias", "tex2Dgrad", "tex2Dlod", "tex2Dproj",
+			"tex3D", "tex3D", "tex3Dbias", "tex3Dgrad", "tex3Dlod", "tex3Dproj", "texCUBE", "texCUBE", "texCUBEbias", "texCUBEgrad", "texCUBElod", "texCUBEproj", "transpose", "trunc"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = true;
+
+		langDef.mName = "HLSL";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::GLSL()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
+			"signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
+			"_Noreturn", "_Static_assert", "_Thread_local"
+		};
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
+			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = true;
+
+		langDef.mName = "GLSL";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::C()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
+			"signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
+			"_Noreturn", "_Static_assert", "_Thread_local"
+		};
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
+			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
+		{
+			paletteIndex = PaletteIndex::Max;
+
+			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
+				in_begin++;
+
+			if (in_begin == in_end)
+			{
+				out_begin = in_end;
+				out_end = in_end;
+				paletteIndex = PaletteIndex::Default;
+			}
+			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::String;
+			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::CharLiteral;
+			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Identifier;
+			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Number;
+			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
+				paletteIndex = PaletteIndex::Punctuation;
+
+			return paletteIndex != PaletteIndex::Max;
+		};
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = true;
+
+		langDef.mName = "C";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::SQL()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"ADD", "EXCEPT", "PERCENT", "ALL", "EXEC", "PLAN", "ALTER", "EXECUTE", "PRECISION", "AND", "EXISTS", "PRIMARY", "ANY", "EXIT", "PRINT", "AS", "FETCH", "PROC", "ASC", "FILE", "PROCEDURE",
+			"AUTHORIZATION", "FILLFACTOR", "PUBLIC", "BACKUP", "FOR", "RAISERROR", "BEGIN", "FOREIGN", "READ", "BETWEEN", "FREETEXT", "READTEXT", "BREAK", "FREETEXTTABLE", "RECONFIGURE",
+			"BROWSE", "FROM", "REFERENCES", "BULK", "FULL", "REPLICATION", "BY", "FUNCTION", "RESTORE", "CASCADE", "GOTO", "RESTRICT", "CASE", "GRANT", "RETURN", "CHECK", "GROUP", "REVOKE",
+			"CHECKPOINT", "HAVING", "RIGHT", "CLOSE", "HOLDLOCK", "ROLLBACK", "CLUSTERED", "IDENTITY", "ROWCOUNT", "COALESCE", "IDENTITY_INSERT", "ROWGUIDCOL", "COLLATE", "IDENTITYCOL", "RULE",
+			"COLUMN", "IF", "SAVE", "COMMIT", "IN", "SCHEMA", "COMPUTE", "INDEX", "SELECT", "CONSTRAINT", "INNER", "SESSION_USER", "CONTAINS", "INSERT", "SET", "CONTAINSTABLE", "INTERSECT", "SETUSER",
+			"CONTINUE", "INTO", "SHUTDOWN", "CONVERT", "IS", "SOME", "CREATE", "JOIN", "STATISTICS", "CROSS", "KEY", "SYSTEM_USER", "CURRENT", "KILL", "TABLE", "CURRENT_DATE", "LEFT", "TEXTSIZE",
+			"CURRENT_TIME", "LIKE", "THEN", "CURRENT_TIMESTAMP", "LINENO", "TO", "CURRENT_USER", "LOAD", "TOP", "CURSOR", "NATIONAL", "TRAN", "DATABASE", "NOCHECK", "TRANSACTION",
+			"DBCC", "NONCLUSTERED", "TRIGGER", "DEALLOCATE", "NOT", "TRUNCATE", "DECLARE", "NULL", "TSEQUAL", "DEFAULT", "NULLIF", "UNION", "DELETE", "OF", "UNIQUE", "DENY", "OFF", "UPDATE",
+			"DESC", "OFFSETS", "UPDATETEXT", "DISK", "ON", "USE", "DISTINCT", "OPEN", "USER", "DISTRIBUTED", "OPENDATASOURCE", "VALUES", "DOUBLE", "OPENQUERY", "VARYING","DROP", "OPENROWSET", "VIEW",
+			"DUMMY", "OPENXML", "WAITFOR", "DUMP", "OPTION", "WHEN", "ELSE", "OR", "WHERE", "END", "ORDER", "WHILE", "ERRLVL", "OUTER", "WITH", "ESCAPE", "OVER", "WRITETEXT"
+		};
+
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"ABS",  "ACOS",  "ADD_MONTHS",  "ASCII",  "ASCIISTR",  "ASIN",  "ATAN",  "ATAN2",  "AVG",  "BFILENAME",  "BIN_TO_NUM",  "BITAND",  "CARDINALITY",  "CASE",  "CAST",  "CEIL",
+			"CHARTOROWID",  "CHR",  "COALESCE",  "COMPOSE",  "CONCAT",  "CONVERT",  "CORR",  "COS",  "COSH",  "COUNT",  "COVAR_POP",  "COVAR_SAMP",  "CUME_DIST",  "CURRENT_DATE",
+			"CURRENT_TIMESTAMP",  "DBTIMEZONE",  "DECODE",  "DECOMPOSE",  "DENSE_RANK",  "DUMP",  "EMPTY_BLOB",  "EMPTY_CLOB",  "EXP",  "EXTRACT",  "FIRST_VALUE",  "FLOOR",  "FROM_TZ",  "GREATEST",
+			"GROUP_ID",  "HEXTORAW",  "INITCAP",  "INSTR",  "INSTR2",  "INSTR4",  "INSTRB",  "INSTRC",  "LAG",  "LAST_DAY",  "LAST_VALUE",  "LEAD",  "LEAST",  "LENGTH",  "LENGTH2",  "LENGTH4",
+			"LENGTHB",  "LENGTHC",  "LISTAGG",  "LN",  "LNNVL",  "LOCALTIMESTAMP",  "LOG",  "LOWER",  "LPAD",  "LTRIM",  "MAX",  "MEDIAN",  "MIN",  "MOD",  "MONTHS_BETWEEN",  "NANVL",  "NCHR",
+			"NEW_TIME",  "NEXT_DAY",  "NTH_VALUE",  "NULLIF",  "NUMTODSINTERVAL",  "NUMTOYMINTERVAL",  "NVL",  "NVL2",  "POWER",  "RANK",  "RAWTOHEX",  "REGEXP_COUNT",  "REGEXP_INSTR",
+			"REGEXP_REPLACE",  "REGEXP_SUBSTR",  "REMAINDER",  "REPLACE",  "ROUND",  "ROWNUM",  "RPAD",  "RTRIM",  "SESSIONTIMEZONE",  "SIGN",  "SIN",  "SINH",
+			"SOUNDEX",  "SQRT",  "STDDEV",  "SUBSTR",  "SUM",  "SYS_CONTEXT",  "SYSDATE",  "SYSTIMESTAMP",  "TAN",  "TANH",  "TO_CHAR",  "TO_CLOB",  "TO_DATE",  "TO_DSINTERVAL",  "TO_LOB",
+			"TO_MULTI_BYTE",  "TO_NCLOB",  "TO_NUMBER",  "TO_SINGLE_BYTE",  "TO_TIMESTAMP",  "TO_TIMESTAMP_TZ",  "TO_YMINTERVAL",  "TRANSLATE",  "TRIM",  "TRUNC", "TZ_OFFSET",  "UID",  "UPPER",
+			"USER",  "USERENV",  "VAR_POP",  "VAR_SAMP",  "VARIANCE",  "VSIZE "
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\\'[^\\\']*\\\'", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = false;
+		langDef.mAutoIndentation = false;
+
+		langDef.mName = "SQL";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::AngelScript()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"and", "abstract", "auto", "bool", "break", "case", "cast", "class", "const", "continue", "default", "do", "double", "else", "enum", "false", "final", "float", "for",
+			"from", "funcdef", "function", "get", "if", "import", "in", "inout", "int", "interface", "int8", "int16", "int32", "int64", "is", "mixin", "namespace", "not",
+			"null", "or", "out", "override", "private", "protected", "return", "set", "shared", "super", "switch", "this ", "true", "typedef", "uint", "uint8", "uint16", "uint32",
+			"uint64", "void", "while", "xor"
+		};
+
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"cos", "sin", "tab", "acos", "asin", "atan", "atan2", "cosh", "sinh", "tanh", "log", "log10", "pow", "sqrt", "abs", "ceil", "floor", "fraction", "closeTo", "fpFromIEEE", "fpToIEEE",
+			"complex", "opEquals", "opAddAssign", "opSubAssign", "opMulAssign", "opDivAssign", "opAdd", "opSub", "opMul", "opDiv"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::String));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
+		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+
+		langDef.mCommentStart = "/*";
+		langDef.mCommentEnd = "*/";
+		langDef.mSingleLineComment = "//";
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = true;
+
+		langDef.mName = "AngelScript";
+
+		inited = true;
+	}
+	return langDef;
+}
+
+const CCodeDocument::LanguageDefinition& CCodeDocument::LanguageDefinition::Lua()
+{
+	static bool inited = false;
+	static LanguageDefinition langDef;
+	if (!inited)
+	{
+		static const char* const keywords[] = {
+			"and", "break", "do", "", "else", "elseif", "end", "false", "for", "function", "if", "in", "", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
+		};
+
+		for (auto& k : keywords)
+			langDef.mKeywords.insert(k);
+
+		static const char* const identifiers[] = {
+			"assert", "collectgarbage", "dofile", "error", "getmetatable", "ipairs", "loadfile", "load", "loadstring",  "next",  "pairs",  "pcall",  "print",  "rawequal",  "rawlen",  "rawget",  "rawset",
+			"select",  "setmetatable",  "tonumber",  "tostring",  "type",  "xpcall",  "_G",  "_VERSION","arshift", "band", "bnot", "bor", "bxor", "btest", "extract", "lrotate", "lshift", "replace",
+			"rrotate", "rshift", "create", "resume", "running", "status", "wrap", "yield", "isyieldable", "debug","getuservalue", "gethook", "getinfo", "getlocal", "getregistry", "getmetatable",
+			"getupvalue", "upvaluejoin", "upvalueid", "setuservalue", "sethook", "setlocal", "setmetatable", "setupvalue", "traceback", "close", "flush", "input", "lines", "open", "output", "popen",
+			"read", "tmpfile", "type", "write", "close", "flush", "lines", "read", "seek", "setvbuf", "write", "__gc", "__tostring", "abs", "acos", "asin", "atan", "ceil", "cos", "deg", "exp", "tointeger",
+			"floor", "fmod", "ult", "log", "max", "min", "modf", "rad", "random", "randomseed", "sin", "sqrt", "string", "tan", "type", "atan2", "cosh", "sinh", "tanh",
+			"pow", "frexp", "ldexp", "log10", "pi", "huge", "maxinteger", "mininteger", "loadlib", "searchpath", "seeall", "preload", "cpath", "path", "searchers", "loaded", "module", "require", "clock",
+			"date", "difftime", "execute", "exit", "getenv", "remove", "rename", "setlocale", "time", "tmpname", "byte", "char", "dump", "find", "format", "gmatch", "gsub", "len", "lower", "match", "rep",
+			"reverse", "sub", "upper", "pack", "packsize", "unpack", "concat", "maxn", "insert", "pack", "unpack", "remove", "move", "sort", "offset", "codepoint", "char", "len", "codes", "charpattern",
+			"coroutine", "table", "io", "os", "string", "utf8", "bit32", "math", "debug", "package"
+		};
+		for (auto& k : identifiers)
+		{
+			Identifier id;
+			id.mDeclaration = "Built-in function";
+			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+		}
+
+		langDef.mTokenize = TokenizeLua;
+
+		langDef.mCommentStart = "--[[";
+		langDef.mCommentEnd = "]]";
+		langDef.mSingleLineComment = "--";
+		langDef.mLongBrackets = true;
+
+		// while/for ... do and if ... then open their block with the second keyword
+		langDef.mBlockOpeners = { "function", "do", "then", "repeat" };
+		langDef.mBlockClosers = { "end", "until", "elseif" };
+		langDef.mBlockLeaders = { "if", "elseif", "while", "for" };
+		langDef.mBlockFollowers = { "then", "do" };
+
+		langDef.mCaseSensitive = true;
+		langDef.mAutoIndentation = false;
+
+		langDef.mName = "Lua";
+
+		inited = true;
+	}
+	return langDef;
+}
@@ -0,0 +1,727 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <regex>
+#include <cassert>
+#include <cstdint>
+
+#include "CIdentifierTrie.h"
+
+// The text model of the code editor: lines, cursors, undo history, the
+// colorizer, folding, find/replace, completion and the journal. It knows
+// nothing of ImGui; CCodeEditor draws one and feeds it input, and anything
+// else can drive it through the calls below.
+class CCodeDocument
+{
+	friend class CCodeEditor;
+
+public:
+	enum class PaletteIndex
+	{
+		Default,
+		Keyword,
+		Number,
+		String,
+		CharLiteral,
+		Punctuation,
+		Preprocessor,
+		Identifier,
+		KnownIdentifier,
+		PreprocIdentifier,
+		Comment,
+		MultiLineComment,
+		Background,
+		Cursor,
+		Selection,
+		ErrorMarker,
+		Breakpoint,
+		LineNumber,
+		CurrentLineFill,
+		CurrentLineFillInactive,
+		CurrentLineEdge,
+		FindMatch,
+		MatchingPair,
+		Max
+	};
+
+	enum class SelectionMode
+	{
+		Normal,
+		Word,
+		Line
+	};
+
+	struct Breakpoint
+	{
+		int mLine;
+		bool mEnabled;
+		std::string mCondition;
+
+		Breakpoint()
+			: mLine(-1)
+			, mEnabled(false)
+		{}
+	};
+
+	// Represents a character coordinate from the user's point of view,
+	// i. e. consider an uniform grid (assuming fixed-width font) on the
+	// screen as it is rendered, and each cell has its own coordinate, starting from 0.
+	// Tabs are counted as [1..mTabSize] count empty spaces, depending on
+	// how many space is necessary to reach the next tab stop.
+	// For example, coordinate (1, 5) represents the character 'B' in a line "\tABC", when mTabSize = 4,
+	// because it is rendered as "    ABC" on the screen.
+	struct Coordinates
+	{
+		int mLine, mColumn;
+		Coordinates() : mLine(0), mColumn(0) {}
+		Coordinates(int aLine, int aColumn) : mLine(aLine), mColumn(aColumn)
+		{
+			assert(aLine >= 0);
+			assert(aColumn >= 0);
+		}
+		static Coordinates Invalid() { static Coordinates invalid(-1, -1); return invalid; }
+
+		bool operator ==(const Coordinates& o) const
+		{
+			return
+				mLine == o.mLine &&
+				mColumn == o.mColumn;
+		}
+
+		bool operator !=(const Coordinates& o) const
+		{
+			return
+				mLine != o.mLine ||
+				mColumn != o.mColumn;
+		}
+
+		bool operator <(const Coordinates& o) const
+		{
+			if (mLine != o.mLine)
+				return mLine < o.mLine;
+			return mColumn < o.mColumn;
+		}
+
+		bool operator >(const Coordinates& o) const
+		{
+			if (mLine != o.mLine)
+				return mLine > o.mLine;
+			return mColumn > o.mColumn;
+		}
+
+		bool operator <=(const Coordinates& o) const
+		{
+			if (mLine != o.mLine)
+				return mLine < o.mLine;
+			return mColumn <= o.mColumn;
+		}
+
+		bool operator >=(const Coordinates& o) const
+		{
+			if (mLine != o.mLine)
+				return mLine > o.mLine;
+			return mColumn >= o.mColumn;
+		}
+	};
+
+	struct Identifier
+	{
+		Coordinates mLocation;
+		std::string mDeclaration;
+	};
+
+	typedef std::string String;
+	typedef std::unordered_map<std::string, Identifier> Identifiers;
+	typedef std::unordered_set<std::string> Keywords;
+	typedef std::map<int, std::string> ErrorMarkers;
+	typedef std::unordered_set<int> Breakpoints;
+	typedef uint8_t Char;
+
+	// Takes one journal record; aData is only valid during the call.
+	typedef std::function<void(const char* aData, size_t aSize)> JournalCallback;
+
+	// How the comment/string scan overrides a character's token color.
+	enum class CommentKind : uint8_t
+	{
+		None,
+		SingleLine,
+		MultiLine,
+		MultiLineString
+	};
+
+	// One line of text as two parallel arrays: the UTF-8 bytes, and one attribute
+	// byte per text byte packing its color index (5 bits), its comment kind
+	// (2 bits) and the preprocessor flag. mOffsets caches the view's layout: the x of
+	// every byte from the line start (a multi-byte character repeats the x of
+	// its lead byte) followed by the line width. mMatches caches the find
+	// matches as [start, end) byte pairs, for the query mMatchesQuery names.
+	// mColumns indexes the text columns: a stop every COLUMN_STOP_CHARACTERS
+	// characters and one at the end, so byte/column conversions start from the
+	// nearest stop instead of the line start. Every edit drops all three.
+	// mPairs lists the brackets and block keywords the colorizer found; it is
+	// only replaced when the line is colorized again.
+	struct Line
+	{
+		struct ColumnStop
+		{
+			int mIndex;		// byte index of the character...
+			int mColumn;	// ...and the column it starts at
+		};
+
+		// A bracket or block keyword, and the one it pairs with once BuildPairs() ran
+		struct PairToken
+		{
+			int mIndex;				// byte index of the token...
+			uint8_t mLength;		// ...its length...
+			char mBracket;			// ...the bracket, 0 for a keyword...
+			uint8_t mTags;			// ...or the keyword's word tags
+			int mPartnerLine = -1;
+			int mPartner = -1;		// index into the partner line's mPairs
+		};
+
+		enum : uint8_t
+		{
+			ColorMask = 0x1f,
+			CommentShift = 5,
+			CommentMask = 0x60,
+			PreprocessorBit = 0x80
+		};
+
+		std::string mText;
+		std::vector<uint8_t> mAttributes;
+		mutable std::vector<float> mOffsets;
+		mutable std::vector<int> mMatches;
+		mutable unsigned int mMatchesQuery = 0;
+		mutable std::vector<ColumnStop> mColumns;
+		mutable int mCharacterCount = 0;
+		uint16_t mBlockOpens = 0;		// block keywords the line leaves open...
+		uint16_t mBlockCloses = 0;		// ...and those closing blocks opened on earlier lines, from the colorizer
+		std::vector<PairToken> mPairs;	// by mIndex, from the colorizer
+
+		size_t size() const { return mText.size(); }
+		bool empty() const { return mText.empty(); }
+
+		Char GetChar(size_t aIndex) const { return (Char)mText[aIndex]; }
+
+		PaletteIndex GetColor(size_t aIndex) const { return (PaletteIndex)(mAttributes[aIndex] & ColorMask); }
+		void SetColor(size_t aIndex, PaletteIndex aColor) { mAttributes[aIndex] = (mAttributes[aIndex] & ~ColorMask) | (uint8_t)aColor; }
+
+		CommentKind GetComment(size_t aIndex) const { return (CommentKind)((mAttributes[aIndex] & CommentMask) >> CommentShift); }
+		void SetComment(size_t aIndex, CommentKind aKind) { mAttributes[aIndex] = (mAttributes[aIndex] & ~CommentMask) | ((uint8_t)aKind << CommentShift); }
+
+		bool IsPreprocessor(size_t aIndex) const { return (mAttributes[aIndex] & PreprocessorBit) != 0; }
+		void SetPreprocessor(size_t aIndex, bool aValue) { mAttributes[aIndex] = aValue ? (mAttributes[aIndex] | PreprocessorBit) : (mAttributes[aIndex] & ~PreprocessorBit); }
+
+		void push_back(char aChar, PaletteIndex aColor = PaletteIndex::Default)
+		{
+			mText.push_back(aChar);
+			mAttributes.push_back((uint8_t)aColor);
+			Invalidate();
+		}
+
+		void insert(size_t aIndex, const char* aText, size_t aLength, PaletteIndex aColor = PaletteIndex::Default)
+		{
+			mText.insert(aIndex, aText, aLength);
+			mAttributes.insert(mAttributes.begin() + aIndex, aLength, (uint8_t)aColor);
+			Invalidate();
+		}
+
+		// Inserts [aFrom, aTo) of aLine, attributes included.
+		void insert(size_t aIndex, const Line& aLine, size_t aFrom, size_t aTo)
+		{
+			mText.insert(aIndex, aLine.mText, aFrom, aTo - aFrom);
+			mAttributes.insert(mAttributes.begin() + aIndex, aLine.mAttributes.begin() + aFrom, aLine.mAttributes.begin() + aTo);
+			Invalidate();
+		}
+
+		void append(const Line& aLine, size_t aFrom = 0) { insert(size(), aLine, aFrom, aLine.size()); }
+
+		void erase(size_t aFrom, size_t aTo)
+		{
+			mText.erase(aFrom, aTo - aFrom);
+			mAttributes.erase(mAttributes.begin() + aFrom, mAttributes.begin() + aTo);
+			Invalidate();
+		}
+
+		// Replaces the text, every character back to the default color.
+		void assign(const char* aText, size_t aLength)
+		{
+			mText.assign(aText, aLength);
+			mAttributes.assign(aLength, (uint8_t)PaletteIndex::Default);
+			Invalidate();
+		}
+
+		void reserve(size_t aSize)
+		{
+			mText.reserve(aSize);
+			mAttributes.reserve(aSize);
+		}
+
+		void swap(Line& aLine)
+		{
+			mText.swap(aLine.mText);
+			mAttributes.swap(aLine.mAttributes);
+			mOffsets.swap(aLine.mOffsets);
+			mMatches.swap(aLine.mMatches);
+			std::swap(mMatchesQuery, aLine.mMatchesQuery);
+			mColumns.swap(aLine.mColumns);
+			std::swap(mCharacterCount, aLine.mCharacterCount);
+			std::swap(mBlockOpens, aLine.mBlockOpens);
+			std::swap(mBlockCloses, aLine.mBlockCloses);
+			mPairs.swap(aLine.mPairs);
+		}
+
+		void Invalidate()
+		{
+			mOffsets.clear();
+			mMatchesQuery = 0;
+			mColumns.clear();
+		}
+	};
+
+	typedef std::vector<Line> Lines;
+
+	struct LanguageDefinition
+	{
+		typedef std::pair<std::string, PaletteIndex> TokenRegexString;
+		typedef std::vector<TokenRegexString> TokenRegexStrings;
+		typedef bool(*TokenizeCallback)(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex);
+
+		std::string mName;
+		Keywords mKeywords;
+		Identifiers mIdentifiers;
+		Identifiers mPreprocIdentifiers;
+		std::string mCommentStart, mCommentEnd, mSingleLineComment;
+		char mPreprocChar;
+		bool mAutoIndentation;
+		bool mLongBrackets;		// Lua style [==[ ]==] strings and --[==[ ]==] comments
+		Keywords mBlockOpeners, mBlockClosers;	// keywords that start and end a foldable block
+		Keywords mBlockLeaders;		// keywords whose block the next follower opens (while ... do)...
+		Keywords mBlockFollowers;	// ...and those followers; elseif is a leader that closes
+
+		TokenizeCallback mTokenize;
+
+		TokenRegexStrings mTokenRegexStrings;
+
+		bool mCaseSensitive;
+
+		LanguageDefinition()
+			: mPreprocChar('#'), mAutoIndentation(true), mLongBrackets(false), mTokenize(nullptr), mCaseSensitive(true)
+		{
+		}
+
+		static const LanguageDefinition& CPlusPlus();
+		static const LanguageDefinition& HLSL();
+		static const LanguageDefinition& GLSL();
+		static const LanguageDefinition& C();
+		static const LanguageDefinition& SQL();
+		static const LanguageDefinition& AngelScript();
+		static const LanguageDefinition& Lua();
+	};
+
+	CCodeDocument();
+	~CCodeDocument();
+
+	// Runs the work edits leave behind: the comment/string scan, collecting and
+	// posting background colorize jobs, and rebuilding the folds. The view calls
+	// it once a frame; IsColorizing() is true until the colors caught up.
+	void Update();
+	bool IsColorizing() const;
+
+	// The range of lines whose text or colors changed since the last call, for
+	// the view to repaint; false when none did.
+	bool TakeChangedLines(int& aFromLine, int& aToLine);
+
+	void SetLanguageDefinition(const LanguageDefinition& aLanguageDef);
+	const LanguageDefinition& GetLanguageDefinition() const { return mLanguageDefinition; }
+
+	void SetErrorMarkers(const ErrorMarkers& aMarkers) { mErrorMarkers = aMarkers; }
+	void SetBreakpoints(const Breakpoints& aMarkers) { mBreakpoints = aMarkers; }
+
+	void SetText(const std::string& aText);
+	std::string GetText() const;
+	// The bytes of GetText() a piece at a time, straight from the line storage:
+	// each line, then its newline. aCursor starts at 0; nullptr past the end.
+	const char* GetTextChunk(int& aCursor, size_t& aSize) const;
+
+	void SetTextLines(const std::vector<std::string>& aLines);
+	std::vector<std::string> GetTextLines() const;
+
+	std::string GetSelectedText() const;
+	std::string GetCurrentLineText()const;
+
+	int GetTotalLines() const { return (int)mLines.size(); }
+	bool IsOverwrite() const { return mOverwrite; }
+
+	void SetReadOnly(bool aValue);
+	bool IsReadOnly() const { return mReadOnly; }
+	bool IsTextChanged() const { return mTextChanged; }
+	bool IsCursorPositionChanged() const { return mCursorPositionChanged; }
+
+	bool IsColorizerEnabled() const { return mColorizerEnabled; }
+	void SetColorizerEnable(bool aValue);
+
+	Coordinates GetCursorPosition() const { return GetActualCursorCoordinates(); }
+	void SetCursorPosition(const Coordinates& aPosition);
+
+	void SetTabSize(int aValue);
+	inline int GetTabSize() const { return mTabSize; }
+
+	void InsertText(const std::string& aValue);
+	void InsertText(const char* aValue);
+
+	// A keystroke at every cursor: aChar replaces the selection, with auto
+	// indentation after a newline; a tab with a selection indents it, with
+	// aShift outdents it. Consecutive keystrokes undo as one word.
+	void EnterCharacter(unsigned int aChar, bool aShift);
+	void Backspace();
+
+	void MoveUp(int aAmount = 1, bool aSelect = false);
+	void MoveDown(int aAmount = 1, bool aSelect = false);
+	void MoveLeft(int aAmount = 1, bool aSelect = false, bool aWordMode = false);
+	void MoveRight(int aAmount = 1, bool aSelect = false, bool aWordMode = false);
+	void MoveTop(bool aSelect = false);
+	void MoveBottom(bool aSelect = false);
+	void MoveHome(bool aSelect = false);
+	void MoveEnd(bool aSelect = false);
+
+	void SetSelectionStart(const Coordinates& aPosition);
+	void SetSelectionEnd(const Coordinates& aPosition);
+	void SetSelection(const Coordinates& aStart, const Coordinates& aEnd, SelectionMode aMode = SelectionMode::Normal);
+	void SelectWordUnderCursor();
+	void SelectAll();
+	bool HasSelection() const;
+
+	// Multiple cursors. The calls above act on the primary cursor, and setting
+	// the cursor or the selection drops the others; typing, deleting, pasting
+	// and moving act on all of them, each edit as one undo step.
+	void AddCursor(const Coordinates& aPosition);
+	void SetColumnSelection(const Coordinates& aStart, const Coordinates& aEnd);
+	void ClearExtraCursors();
+	bool HasExtraCursors() const { return !mState.mExtraCursors.empty(); }
+	int GetCursorCount() const { return 1 + (int)mState.mExtraCursors.size(); }
+
+	// What copying puts on the clipboard: the selection, or the cursor's line
+	// without one; with several cursors, a line per cursor from top to bottom.
+	std::string GetCopyText() const;
+	// Deletes the selections, as cutting does after copying them.
+	void DeleteSelections();
+	// Replaces the selections with aText. With as many lines in aText as there
+	// are cursors, each cursor gets its own line.
+	void Paste(const char* aText);
+	void Delete();
+
+	bool CanUndo() const;
+	bool CanRedo() const;
+	void Undo(int aSteps = 1);
+	void Redo(int aSteps = 1);
+
+	// Find/replace. The query is a literal string or an ECMAScript regex; while
+	// it is set, its matches are highlighted. SetFindQuery returns false for a
+	// regex that doesn't compile, and clears the query.
+	bool SetFindQuery(const std::string& aQuery, bool aCaseSensitive = true, bool aRegex = false);
+	const std::string& GetFindQuery() const { return mFindQuery; }
+	bool FindNext(bool aBackwards = false);
+	int FindAll();
+	int ReplaceAll(const std::string& aReplacement);
+
+	// Completion over the language's keywords and known identifiers plus the
+	// identifiers of the text, kept up to date by the colorizer. Results are
+	// in byte order.
+	void GetCompletions(const std::string& aPrefix, std::vector<std::string>& aResults, size_t aMaxResults = 64) const;
+
+	// Folding of the blocks between the language's block keywords (Lua's
+	// function/do/then/repeat ... end/until) and of multi-line comments, by the
+	// line a block starts on. A folded block keeps its first and last lines on
+	// screen and hides the ones in between.
+	bool IsFoldable(int aLine) const { return FindFoldRegion(aLine) != nullptr; }
+	bool IsFolded(int aLine) const { return mFoldedLines.count(aLine) != 0; }
+	void SetFolded(int aLine, bool aFolded);
+	void ToggleFold(int aLine) { SetFolded(aLine, !IsFolded(aLine)); }
+	void UnfoldAll();
+
+	// Journal of the session, for a swap file to recover it from: each change to
+	// the text, the undo history or the cursors goes to the callback as it's
+	// made, as one opaque record. ReplayJournal() applies the records again, in
+	// order, to an editor in the state the journal started from, and returns
+	// false for one it can't read. WriteJournalSnapshot() writes the few records
+	// that rebuild the current text, cursors and undo history from scratch.
+	void SetJournalCallback(const JournalCallback& aCallback) { mJournalCallback = aCallback; }
+	bool ReplayJournal(const char* aData, size_t aSize);
+	void WriteJournalSnapshot();
+
+	// Length of the UTF-8 sequence aChar leads, and whether it can be part of a word
+	static int UTF8CharLength(Char aChar);
+	static bool IsIdentifierChar(Char aChar);
+
+private:
+	typedef std::vector<std::pair<std::regex, PaletteIndex>> RegexList;
+
+	// Everything the tokenizer pass reads, shared immutably with the background job.
+	struct Colorizer
+	{
+		LanguageDefinition mLanguageDefinition;
+		RegexList mRegexList;
+		CIdentifierTrie mWords;		// keywords and known (preprocessor) identifiers, tagged with their kind
+	};
+
+	// Identifier tokens found by ColorizeLines, as [start, end) byte pairs in
+	// mSpans; those of the i-th line are mSpans[mLineStart[i]..mLineStart[i + 1]).
+	struct IdentifierSpans
+	{
+		std::vector<int> mSpans;
+		std::vector<int> mLineStart;
+	};
+
+	// A copy of a range of lines handed to the colorizer thread. The worker
+	// writes the token colors into the copy; the render thread applies them
+	// once mDone is set, skipping lines whose text changed in the meantime.
+	struct ColorizeJob
+	{
+		std::shared_ptr<const Colorizer> mColorizer;
+		unsigned long long mGeneration = 0;
+		int mFirstLine = 0;
+		Lines mLines;
+		IdentifierSpans mIdentifiers;
+		std::atomic<bool> mDone = false;
+	};
+
+	struct Cursor
+	{
+		Coordinates mSelectionStart;
+		Coordinates mSelectionEnd;
+		Coordinates mCursorPosition;
+
+		Coordinates GetStart() const { return mCursorPosition < mSelectionStart ? mCursorPosition : mSelectionStart; }
+		Coordinates GetEnd() const { return mSelectionEnd < mCursorPosition ? mCursorPosition : mSelectionEnd; }
+	};
+
+	// The primary cursor, plus any others sorted by position. No two cursors
+	// overlap or touch.
+	struct EditorState : Cursor
+	{
+		std::vector<Cursor> mExtraCursors;
+	};
+
+	// A block from the line of its opening keyword to the line of the closing one
+	struct FoldRegion
+	{
+		int mStart;
+		int mEnd;
+	};
+
+	// A run of lines hidden by a folded block, and the count of those hidden
+	// before it, so screen rows and lines map to each other by binary search.
+	struct HiddenLines
+	{
+		int mFirst;
+		int mEnd;
+		int mHiddenBefore;
+	};
+
+	class UndoRecord
+	{
+	public:
+		UndoRecord() {}
+		~UndoRecord() {}
+
+		UndoRecord(
+			const std::string& aAdded,
+			const CCodeDocument::Coordinates aAddedStart,
+			const CCodeDocument::Coordinates aAddedEnd,
+
+			const std::string& aRemoved,
+			const CCodeDocument::Coordinates aRemovedStart,
+			const CCodeDocument::Coordinates aRemovedEnd,
+
+			CCodeDocument::EditorState& aBefore,
+			CCodeDocument::EditorState& aAfter);
+
+		void Undo(CCodeDocument* aEditor);
+		void Redo(CCodeDocument* aEditor);
+
+		// Folds a record for the keystroke that directly follows this one into it:
+		// typing, backspacing or deleting one character at a time at the same
+		// spot, up to a word boundary. Returns false if aNext must stay separate.
+		bool Merge(const UndoRecord& aNext);
+		size_t GetMemoryUsage() const;
+
+		std::string mAdded;
+		Coordinates mAddedStart;
+		Coordinates mAddedEnd;
+
+		std::string mRemoved;
+		Coordinates mRemovedStart;
+		Coordinates mRemovedEnd;
+
+		EditorState mBefore;
+		EditorState mAfter;
+
+		// A multi-cursor edit: one record per cursor, in the order they were
+		// made (last cursor first). The text members above are unused then.
+		std::vector<UndoRecord> mParts;
+
+	private:
+		void UndoText(CCodeDocument* aEditor);
+		void RedoText(CCodeDocument* aEditor);
+	};
+
+	typedef std::deque<UndoRecord> UndoBuffer;
+
+	// Comment/string scanner state at the start of a line, kept for every line so
+	// an edit only rescans until the state flowing into a line is unchanged.
+	struct LineState
+	{
+		uint8_t mLongLevel = 0;
+		bool mInString : 1;
+		bool mInComment : 1;
+		bool mInLongString : 1;
+		bool mConcatenate : 1;
+		bool mInSingleLineComment : 1;
+		bool mInPreproc : 1;
+		bool mFirstChar : 1;
+
+		LineState() : mInString(false), mInComment(false), mInLongString(false), mConcatenate(false),
+			mInSingleLineComment(false), mInPreproc(false), mFirstChar(true) {}
+
+		bool operator ==(const LineState& o) const
+		{
+			return mLongLevel == o.mLongLevel && mInString == o.mInString && mInComment == o.mInComment &&
+				mInLongString == o.mInLongString && mConcatenate == o.mConcatenate &&
+				mInSingleLineComment == o.mInSingleLineComment && mInPreproc == o.mInPreproc && mFirstChar == o.mFirstChar;
+		}
+	};
+
+	typedef std::vector<LineState> LineStates;
+	typedef std::vector<std::vector<int>> LineSymbols;
+
+	void Colorize(int aFromLine = 0, int aCount = -1);
+	void ColorizeRange(int aFromLine = 0, int aToLine = 0);
+	void ColorizeInternal();
+	static void ColorizeLines(Line* aBegin, Line* aEnd, const Colorizer& aColorizer, IdentifierSpans& aIdentifiers);
+	void IndexLineSymbols(int aLine, const IdentifierSpans& aIdentifiers, int aIndex);
+	void ResetSymbols();
+	void PostColorizeJob(int aFromLine, int aToLine);
+	void CollectColorizeJob();
+	LineState ScanLineComments(Line& aLine, LineState aState) const;
+	LineState ScanLineLongBrackets(Line& aLine, LineState aState) const;
+	const std::vector<Line::ColumnStop>& GetLineColumns(int aLine) const;
+	void EnsureCursorVisible();
+	std::string GetText(const Coordinates& aStart, const Coordinates& aEnd) const;
+	Coordinates GetActualCursorCoordinates() const;
+	Coordinates SanitizeCoordinates(const Coordinates& aValue) const;
+	void Advance(Coordinates& aCoordinates) const;
+	void DeleteRange(const Coordinates& aStart, const Coordinates& aEnd);
+	int InsertTextAt(Coordinates& aWhere, const char* aValue);
+	void InsertTextAtCursor(const char* aValue);
+	void AddUndo(UndoRecord& aValue);
+	void ForEachCursor(const std::function<void()>& aAction);
+	void MergeCursors();
+	void AddCursorLine(int aDirection);
+	void PasteText(const char* aText);
+	Coordinates FindWordStart(const Coordinates& aFrom) const;
+	Coordinates FindWordEnd(const Coordinates& aFrom) const;
+	Coordinates FindNextWord(const Coordinates& aFrom) const;
+	int GetCharacterIndex(const Coordinates& aCoordinates) const;
+	int GetCharacterColumn(int aLine, int aIndex) const;
+	int GetLineCharacterCount(int aLine) const;
+	int GetLineMaxColumn(int aLine) const;
+	bool IsOnWordBoundary(const Coordinates& aAt) const;
+	void RemoveLine(int aStart, int aEnd);
+	void RemoveLine(int aIndex);
+	Line& InsertLine(int aIndex);
+	void InsertLines(int aIndex, int aCount);
+	void ShiftPendingRanges(int aIndex, int aDelta);
+	void DeleteSelection();
+	std::string GetWordUnderCursor() const;
+	std::string GetWordAt(const Coordinates& aCoords) const;
+	const std::vector<int>& GetLineMatches(int aLine) const;
+	void UpdateCompletions();
+	void AcceptCompletion();
+	void UpdateFolds();
+	void BuildFoldRegions();
+	void BuildHiddenLines();
+	void ShiftFolds(int aIndex, int aDelta);
+	void BuildPairs();
+	bool FindMatchingPair(const Coordinates& aWhere, int& aLine, int& aToken, int& aMatchLine, int& aMatch);
+	const FoldRegion* FindFoldRegion(int aLine) const;
+	const FoldRegion* FindEnclosingFoldRegion(int aLine, bool aFolded) const;
+	bool IsLineHidden(int aLine) const;
+	void RevealLine(int aLine);
+	void JournalText();
+	void JournalState();
+	void JournalSteps(uint8_t aKind, int aSteps);
+	void JournalEdit(const UndoRecord& aRecord);
+	void SendJournalRecord();
+	static void WriteJournalState(std::string& aOut, const EditorState& aState);
+	static bool ReadJournalState(const char*& aIn, const char* aEnd, EditorState& aState);
+	static void WriteJournalRecord(std::string& aOut, const UndoRecord& aRecord);
+	static bool ReadJournalRecord(const char*& aIn, const char* aEnd, UndoRecord& aRecord);
+	int LineToRow(int aLine) const;
+	int RowToLine(int aRow) const;
+	int GetVisibleLineCount() const { return (int)mLines.size() - mHiddenLineCount; }
+	void MarkLinesChanged(int aFromLine, int aToLine);
+
+	Lines mLines;
+	EditorState mState;
+	UndoBuffer mUndoBuffer;
+	int mUndoIndex;
+	size_t mUndoBytes;					// GetMemoryUsage() summed over mUndoBuffer
+	UndoRecord* mUndoBatch;				// collects the records of a ForEachCursor() edit
+
+	int mTabSize;
+	bool mOverwrite;
+	bool mReadOnly;
+	bool mScrollToCursor;
+	bool mScrollToTop;
+	bool mTextChanged;
+	bool mColorizerEnabled;
+	bool mCursorPositionChanged;
+	int mColorRangeMin, mColorRangeMax;
+
+	LanguageDefinition mLanguageDefinition;
+	std::shared_ptr<const Colorizer> mColorizer;
+	std::unique_ptr<ColorizeJob> mColorizeJob;	// in flight on mColorizeThread
+	std::thread mColorizeThread;
+	unsigned long long mColorizeGeneration;
+	int mViewLineMin, mViewLineMax;		// lines the view drew last, colorized first
+	int mViewColorizedMin, mViewColorizedMax;	// viewport lines tokenized ahead of the bulk pass...
+	unsigned long long mViewColorizedGeneration;	// ...and the edit generation they were done for
+
+	bool mCheckComments;
+	LineStates mLineStates;				// parallel to mLines
+	int mCheckCommentsMin, mCheckCommentsMax;
+	CIdentifierTrie mSymbols;			// completion words: the static ones tagged, the text's counted
+	LineSymbols mLineSymbols;			// parallel to mLines, the mSymbols nodes each line counts
+	std::vector<std::string> mCompletions;	// the completion popup is open while not empty
+	int mCompletionIndex;
+	Coordinates mCompletionStart;		// start of the word being completed
+	std::vector<FoldRegion> mFoldRegions;	// by mStart, only the outermost block of a line
+	std::unordered_set<int> mFoldedLines;	// mStart of the folded regions
+	std::vector<HiddenLines> mHiddenLines;	// by mFirst, built from the two above
+	int mHiddenLineCount;
+	bool mFoldRegionsDirty;				// the lines or their block counts changed since mFoldRegions was built
+	bool mPairsDirty;					// the lines or their pair tokens changed since BuildPairs()
+	int mChangedLineMin, mChangedLineMax;	// lines whose text or colors changed, see TakeChangedLines()
+	JournalCallback mJournalCallback;
+	std::string mJournalRecord;			// the record being written, kept for its capacity
+	std::string mFindQuery;
+	std::string mFindNeedle;			// the literal query, case folded unless mFindCaseSensitive
+	bool mFindCaseSensitive;
+	bool mFindRegex;
+	std::regex mFindPattern;
+	unsigned int mFindGeneration;		// bumped for every query, see Line::mMatchesQuery
+	mutable std::string mFindBuffer;
+	Breakpoints mBreakpoints;
+	ErrorMarkers mErrorMarkers;
+	Coordinates mInteractiveStart, mInteractiveEnd;
+};
@@ -1,72 +1,59 @@
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <string>
-#include <regex>
 #include <cmath>
 
 #include "CCodeEditor.h"
 
-#define IMGUI_DEFINE_MATH_OPERATORS
-#include "imgui.h" // for imGui::GetCurrentWindow()
+#include "imgui.h"
+#include "imgui_internal.h" // for ImTextCharFromUtf8()
 
-// TODO
-// - multiline comments vs single-line: latter is blocking start of a ML
+// The ImGui side of the editor: input handling, drawing, the glyph layout and
+// the minimap. The text model it drives lives in CCodeDocument.cpp.
 
-template<class InputIt1, class InputIt2, class BinaryPredicate>
-bool equals(InputIt1 first1, InputIt1 last1,
-	InputIt2 first2, InputIt2 last2, BinaryPredicate p)
-{
-	for (; first1 != last1 && first2 != last2; ++first1, ++first2)
-	{
-		if (!p(*first1, *first2))
-			return false;
-	}
-	return first1 == last1 && first2 == last2;
-}
+// Rows of the completion popup shown at once.
+#define COMPLETION_ROWS 10
+
+// Minimap: texture columns (a pixel per text column), the most texture rows
+// (a longer document puts several lines on a row), the height of a row when
+// the document fits the editor, and lines painted again per frame.
+#define MINIMAP_COLUMNS 80
+#define MINIMAP_MAX_ROWS 4096
+#define MINIMAP_ROW_HEIGHT 2.0f
+#define MINIMAP_UPDATE_LINES 8192
 
 CCodeEditor::CCodeEditor()
 	: mLineSpacing(1.0f)
-	, mUndoIndex(0)
-	, mTabSize(4)
-	, mOverwrite(false)
-	, mReadOnly(false)
-	, mWithinRender(false)
-	, mScrollToCursor(false)
-	, mScrollToTop(false)
-	, mTextChanged(false)
-	, mColorizerEnabled(true)
 	, mTextStart(20.0f)
 	, mLeftMargin(10)
-	, mCursorPositionChanged(false)
-	, mColorRangeMin(0)
-	, mColorRangeMax(0)
 	, mSelectionMode(SelectionMode::Normal)
-	, mCheckComments(true)
-	, mLastClick(-1.0f)
 	, mHandleKeyboardInputs(true)
 	, mHandleMouseInputs(true)
 	, mIgnoreImGuiChild(false)
 	, mShowWhitespaces(true)
+	, mMinimapTexture(nullptr)
+	, mMinimapPalette{}
+	, mMinimapLinesPerRow(1)
+	, mMinimapTextureRows(0)
+	, mMinimapDirtyMin(0)
+	, mMinimapDirtyMax(std::numeric_limits<int>::max())
+	, mMinimapDragging(false)
+	, mShowMinimap(true)
+	, mLayoutFont(nullptr)
+	, mLayoutFontSize(0.0f)
+	, mLayoutTabSize(0)
+	, mLongest(0.0f)
 	, mStartTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+	, mLastClick(-1.0f)
 {
 	SetPalette(GetDarkPalette());
-	SetLanguageDefinition(LanguageDefinition::HLSL());
-	mLines.push_back(Line());
 }
 
 CCodeEditor::~CCodeEditor()
 {
-}
-
-void CCodeEditor::SetLanguageDefinition(const LanguageDefinition & aLanguageDef)
-{
-	mLanguageDefinition = aLanguageDef;
-	mRegexList.clear();
-
-	for (auto& r : mLanguageDefinition.mTokenRegexStrings)
-		mRegexList.push_back(std::make_pair(std::regex(r.first, std::regex_constants::optimize), r.second));
-
-	Colorize();
+	if (mMinimapTexture != nullptr && mMinimapTextureCallback)
+		mMinimapTextureCallback(mMinimapTexture, 0, 0, nullptr, 0, 0);
 }
 
 void CCodeEditor::SetPalette(const Palette & aValue)
@@ -74,869 +61,464 @@ void CCodeEditor::SetPalette(const Palette & aValue)
 	mPaletteBase = aValue;
 }
 
-std::string CCodeEditor::GetText(const Coordinates & aStart, const Coordinates & aEnd) const
+ImU32 CCodeEditor::GetGlyphColor(const Line& aLine, size_t aIndex) const
 {
-	std::string result;
+	if (!mDocument.mColorizerEnabled)
+		return mPalette[(int)PaletteIndex::Default];
+	switch (aLine.GetComment(aIndex))
+	{
+	case CCodeDocument::CommentKind::SingleLine:
+		return mPalette[(int)PaletteIndex::Comment];
+	case CCodeDocument::CommentKind::MultiLine:
+		return mPalette[(int)PaletteIndex::MultiLineComment];
+	case CCodeDocument::CommentKind::MultiLineString:
+		return mPalette[(int)PaletteIndex::String];
+	default:
+		break;
+	}
+	auto const color = mPalette[(int)aLine.GetColor(aIndex)];
+	if (aLine.IsPreprocessor(aIndex))
+	{
+		const auto ppcolor = mPalette[(int)PaletteIndex::Preprocessor];
+		const int c0 = ((ppcolor & 0xff) + (color & 0xff)) / 2;
+		const int c1 = (((ppcolor >> 8) & 0xff) + ((color >> 8) & 0xff)) / 2;
+		const int c2 = (((ppcolor >> 16) & 0xff) + ((color >> 16) & 0xff)) / 2;
+		const int c3 = (((ppcolor >> 24) & 0xff) + ((color >> 24) & 0xff)) / 2;
+		return ImU32(c0 | (c1 << 8) | (c2 << 16) | (c3 << 24));
+	}
+	return color;
+}
 
-	auto lstart = aStart.mLine;
-	auto lend = aEnd.mLine;
-	auto istart = GetCharacterIndex(aStart);
-	auto iend = GetCharacterIndex(aEnd);
-	size_t s = 0;
+CCodeEditor::Coordinates CCodeEditor::ScreenPosToCoordinates(const ImVec2& aPosition) const
+{
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImVec2 local(aPosition.x - origin.x, aPosition.y - origin.y);
 
-	for (size_t i = lstart; i < lend; i++)
-		s += mLines[i].size();
+	int lineNo = mDocument.RowToLine(std::max(0, (int)floor(local.y / mCharAdvance.y)));
 
-	result.reserve(s + s / 8);
+	int columnCoord = 0;
 
-	while (istart < iend || lstart < lend)
+	if (lineNo >= 0 && lineNo < (int)mDocument.mLines.size())
 	{
-		if (lstart >= (int)mLines.size())
-			break;
+		auto& line = mDocument.mLines.at(lineNo);
+		auto& offsets = GetLineLayout(lineNo);
 
-		auto& line = mLines[lstart];
-		if (istart < (int)line.size())
-		{
-			result += line[istart].mChar;
-			istart++;
-		}
-		else
+		int columnIndex = 0;
+		while ((size_t)columnIndex < line.size())
 		{
-			istart = 0;
-			++lstart;
-			result += '\n';
-		}
-	}
-
-	return result;
-}
+			auto c = line.GetChar(columnIndex);
+			int next = c == '\t' ? columnIndex + 1 : std::min(columnIndex + CCodeDocument::UTF8CharLength(c), (int)line.size());
 
-CCodeEditor::Coordinates CCodeEditor::GetActualCursorCoordinates() const
-{
-	return SanitizeCoordinates(mState.mCursorPosition);
-}
+			// a click past the middle of a character lands after it
+			if (mTextStart + (offsets[columnIndex] + offsets[next]) * 0.5f > local.x)
+				break;
 
-CCodeEditor::Coordinates CCodeEditor::SanitizeCoordinates(const Coordinates & aValue) const
-{
-	auto line = aValue.mLine;
-	auto column = aValue.mColumn;
-	if (line >= (int)mLines.size())
-	{
-		if (mLines.empty())
-		{
-			line = 0;
-			column = 0;
-		}
-		else
-		{
-			line = (int)mLines.size() - 1;
-			column = GetLineMaxColumn(line);
+			if (c == '\t')
+				columnCoord = (columnCoord / mDocument.mTabSize) * mDocument.mTabSize + mDocument.mTabSize;
+			else
+				columnCoord++;
+			columnIndex = next;
 		}
-		return Coordinates(line, column);
-	}
-	else
-	{
-		column = mLines.empty() ? 0 : std::min(column, GetLineMaxColumn(line));
-		return Coordinates(line, column);
 	}
-}
 
-// https://en.wikipedia.org/wiki/UTF-8
-// We assume that the char is a standalone character (<128) or a leading byte of an UTF-8 code sequence (non-10xxxxxx code)
-static int UTF8CharLength(CCodeEditor::Char c)
-{
-	if ((c & 0xFE) == 0xFC)
-		return 6;
-	if ((c & 0xFC) == 0xF8)
-		return 5;
-	if ((c & 0xF8) == 0xF0)
-		return 4;
-	else if ((c & 0xF0) == 0xE0)
-		return 3;
-	else if ((c & 0xE0) == 0xC0)
-		return 2;
-	return 1;
+	return mDocument.SanitizeCoordinates(Coordinates(lineNo, columnCoord));
 }
 
-// "Borrowed" from ImGui source
-static inline int ImTextCharToUtf8(char* buf, int buf_size, unsigned int c)
+void CCodeEditor::HandleKeyboardInputs()
 {
-	if (c < 0x80)
-	{
-		buf[0] = (char)c;
-		return 1;
-	}
-	if (c < 0x800)
-	{
-		if (buf_size < 2) return 0;
-		buf[0] = (char)(0xc0 + (c >> 6));
-		buf[1] = (char)(0x80 + (c & 0x3f));
-		return 2;
-	}
-	if (c >= 0xdc00 && c < 0xe000)
-	{
-		return 0;
-	}
-	if (c >= 0xd800 && c < 0xdc00)
-	{
-		if (buf_size < 4) return 0;
-		buf[0] = (char)(0xf0 + (c >> 18));
-		buf[1] = (char)(0x80 + ((c >> 12) & 0x3f));
-		buf[2] = (char)(0x80 + ((c >> 6) & 0x3f));
-		buf[3] = (char)(0x80 + ((c) & 0x3f));
-		return 4;
-	}
-	//else if (c < 0x10000)
-	{
-		if (buf_size < 3) return 0;
-		buf[0] = (char)(0xe0 + (c >> 12));
-		buf[1] = (char)(0x80 + ((c >> 6) & 0x3f));
-		buf[2] = (char)(0x80 + ((c) & 0x3f));
-		return 3;
-	}
-}
+	ImGuiIO& io = ImGui::GetIO();
+	auto shift = io.KeyShift;
+	auto ctrl = io.ConfigMacOSXBehaviors ? io.KeySuper : io.KeyCtrl;
+	auto alt = io.ConfigMacOSXBehaviors ? io.KeyCtrl : io.KeyAlt;
 
-void CCodeEditor::Advance(Coordinates & aCoordinates) const
-{
-	if (aCoordinates.mLine < (int)mLines.size())
+	if (ImGui::IsWindowFocused())
 	{
-		auto& line = mLines[aCoordinates.mLine];
-		auto cindex = GetCharacterIndex(aCoordinates);
+		if (ImGui::IsWindowHovered())
+			ImGui::SetMouseCursor(ImGuiMouseCursor_TextInput);
+		//ImGui::CaptureKeyboardFromApp(true);
+
+		io.WantCaptureKeyboard = true;
+		io.WantTextInput = true;
 
-		if (cindex + 1 < (int)line.size())
+		// While the completion popup is open it takes the keys that pick from it.
+		// Typing and backspacing refresh it; anything else that moves the cursor
+		// or changes the text closes it.
+		const bool completing = !mDocument.mCompletions.empty();
+		const auto cursorBefore = mDocument.mState.mCursorPosition;
+		const auto undoIndexBefore = mDocument.mUndoIndex;
+		bool updateCompletions = false;
+		bool completionShortcut = false;
+
+		if (completing && !ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape)))
+			mDocument.mCompletions.clear();
+		else if (completing && !ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow)))
+			mDocument.mCompletionIndex = (mDocument.mCompletionIndex + (int)mDocument.mCompletions.size() - 1) % (int)mDocument.mCompletions.size();
+		else if (completing && !ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow)))
+			mDocument.mCompletionIndex = (mDocument.mCompletionIndex + 1) % (int)mDocument.mCompletions.size();
+		else if (completing && !mDocument.IsReadOnly() && !ctrl && !shift && !alt && (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Tab)) || ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter))))
+			mDocument.AcceptCompletion();
+		else if (mDocument.HasExtraCursors() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Escape)))
+			mDocument.ClearExtraCursors();
+		else if (!mDocument.IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Space)))
+			updateCompletions = completionShortcut = true;
+		else if (!mDocument.IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Z)))
+			mDocument.Undo();
+		else if (!mDocument.IsReadOnly() && !ctrl && !shift && alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Backspace)))
+			mDocument.Undo();
+		else if (!mDocument.IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Y)))
+			mDocument.Redo();
+		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow)))
+			mDocument.MoveUp(1, shift);
+		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow)))
+			mDocument.MoveDown(1, shift);
+		else if (ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_LeftBracket)))
 		{
-			auto delta = UTF8CharLength(line[cindex].mChar);
-			cindex = std::min(cindex + delta, (int)line.size() - 1);
+			if (auto region = mDocument.FindEnclosingFoldRegion(mDocument.mState.mCursorPosition.mLine, false))
+				mDocument.SetFolded(region->mStart, true);
 		}
-		else
+		else if (ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_RightBracket)))
 		{
-			++aCoordinates.mLine;
-			cindex = 0;
+			if (auto region = mDocument.FindEnclosingFoldRegion(mDocument.mState.mCursorPosition.mLine, true))
+				mDocument.SetFolded(region->mStart, false);
 		}
-		aCoordinates.mColumn = GetCharacterColumn(aCoordinates.mLine, cindex);
-	}
-}
-
-void CCodeEditor::DeleteRange(const Coordinates & aStart, const Coordinates & aEnd)
-{
-	assert(aEnd >= aStart);
-	assert(!mReadOnly);
+		else if (ctrl && !shift && alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow)))
+			mDocument.AddCursorLine(-1);
+		else if (ctrl && !shift && alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow)))
+			mDocument.AddCursorLine(1);
+		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_LeftArrow)))
+			mDocument.MoveLeft(1, shift, ctrl);
+		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_RightArrow)))
+			mDocument.MoveRight(1, shift, ctrl);
+		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageUp)))
+			mDocument.MoveUp(GetPageSize() - 4, shift);
+		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageDown)))
+			mDocument.MoveDown(GetPageSize() - 4, shift);
+		else if (!alt && ctrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Home)))
+			mDocument.MoveTop(shift);
+		else if (ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_End)))
+			mDocument.MoveBottom(shift);
+		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Home)))
+			mDocument.MoveHome(shift);
+		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_End)))
+			mDocument.MoveEnd(shift);
+		else if (!mDocument.IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Delete)))
+			mDocument.Delete();
+		else if (!mDocument.IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Backspace)))
+		{
+			mDocument.Backspace();
+			updateCompletions = completing;
+		}
+		else if (!ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
+			mDocument.mOverwrite ^= true;
+		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
+			Copy();
+		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_C)))
+			Copy();
+		else if (!mDocument.IsReadOnly() && !ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
+			Paste();
+		else if (!mDocument.IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_V)))
+			Paste();
+		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_X)))
+			Cut();
+		else if (!ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Delete)))
+			Cut();
+		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_A)))
+			mDocument.SelectAll();
+		else if (!mDocument.IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter)))
+			mDocument.EnterCharacter('\n', false);
+		else if (!mDocument.IsReadOnly() && !ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Tab)))
+			mDocument.EnterCharacter('\t', shift);
 
-	//printf("D(%d.%d)-(%d.%d)\n", aStart.mLine, aStart.mColumn, aEnd.mLine, aEnd.mColumn);
+		if (!mDocument.IsReadOnly() && !io.InputQueueCharacters.empty())
+		{
+			for (int i = 0; i < io.InputQueueCharacters.Size; i++)
+			{
+				auto c = io.InputQueueCharacters[i];
 
-	if (aEnd == aStart)
-		return;
+				// the space of the Ctrl+Space shortcut
+				if (completionShortcut && c == ' ')
+					continue;
 
-	auto start = GetCharacterIndex(aStart);
-	auto end = GetCharacterIndex(aEnd);
+				if (c != 0 && (c == '\n' || c >= 32))
+				{
+					mDocument.EnterCharacter(c, shift);
+					updateCompletions = c < 0x80 && CCodeDocument::IsIdentifierChar((Char)c);
+				}
+			}
+			io.InputQueueCharacters.resize(0);
+		}
 
-	if (aStart.mLine == aEnd.mLine)
-	{
-		auto& line = mLines[aStart.mLine];
-		auto n = GetLineMaxColumn(aStart.mLine);
-		if (aEnd.mColumn >= n)
-			line.erase(line.begin() + start, line.end());
-		else
-			line.erase(line.begin() + start, line.begin() + end);
+		if (updateCompletions)
+			mDocument.UpdateCompletions();
+		else if (!mDocument.mCompletions.empty() && (mDocument.mState.mCursorPosition != cursorBefore || mDocument.mUndoIndex != undoIndexBefore))
+			mDocument.mCompletions.clear();
 	}
-	else
-	{
-		auto& firstLine = mLines[aStart.mLine];
-		auto& lastLine = mLines[aEnd.mLine];
+}
 
-		firstLine.erase(firstLine.begin() + start, firstLine.end());
-		lastLine.erase(lastLine.begin(), lastLine.begin() + end);
+void CCodeEditor::HandleMouseInputs()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	auto shift = io.KeyShift;
+	auto ctrl = io.ConfigMacOSXBehaviors ? io.KeySuper : io.KeyCtrl;
+	auto alt = io.ConfigMacOSXBehaviors ? io.KeyCtrl : io.KeyAlt;
 
-		if (aStart.mLine < aEnd.mLine)
-			firstLine.insert(firstLine.end(), lastLine.begin(), lastLine.end());
+	ImVec2 minimapMin, minimapMax;
+	float minimapRowHeight;
+	const bool overMinimap = mMinimapDragging ||
+		(GetMinimapRect(minimapMin, minimapMax, minimapRowHeight) && ImGui::IsMouseHoveringRect(minimapMin, minimapMax));
 
-		if (aStart.mLine < aEnd.mLine)
-			RemoveLine(aStart.mLine + 1, aEnd.mLine + 1);
-	}
+	if (ImGui::IsWindowHovered() && !overMinimap)
+	{
+		if (!shift && !alt)
+		{
+			auto click = ImGui::IsMouseClicked(0);
+			auto doubleClick = ImGui::IsMouseDoubleClicked(0);
+			auto t = ImGui::GetTime();
+			auto tripleClick = click && !doubleClick && (mLastClick != -1.0f && (t - mLastClick) < io.MouseDoubleClickTime);
 
-	mTextChanged = true;
-}
+			auto foldLine = click ? FoldMarkerAt(ImGui::GetMousePos()) : -1;
 
-int CCodeEditor::InsertTextAt(Coordinates& /* inout */ aWhere, const char * aValue)
-{
-	assert(!mReadOnly);
+			if (click)
+				mDocument.mCompletions.clear();
 
-	int cindex = GetCharacterIndex(aWhere);
-	int totalLines = 0;
-	while (*aValue != '\0')
-	{
-		assert(!mLines.empty());
+			/*
+			Left mouse button click on a fold marker
+			*/
 
-		if (*aValue == '\r')
-		{
-			// skip
-			++aValue;
-		}
-		else if (*aValue == '\n')
-		{
-			if (cindex < (int)mLines[aWhere.mLine].size())
+			if (foldLine >= 0)
 			{
-				auto& newLine = InsertLine(aWhere.mLine + 1);
-				auto& line = mLines[aWhere.mLine];
-				newLine.insert(newLine.begin(), line.begin() + cindex, line.end());
-				line.erase(line.begin() + cindex, line.end());
-			}
-			else
-			{
-				InsertLine(aWhere.mLine + 1);
+				mDocument.ToggleFold(foldLine);
+				mLastClick = -1.0f;
 			}
-			++aWhere.mLine;
-			aWhere.mColumn = 0;
-			cindex = 0;
-			++totalLines;
-			++aValue;
-		}
-		else
-		{
-			auto& line = mLines[aWhere.mLine];
-			auto d = UTF8CharLength(*aValue);
-			while (d-- > 0 && *aValue != '\0')
-				line.insert(line.begin() + cindex++, Glyph(*aValue++, PaletteIndex::Default));
-			++aWhere.mColumn;
-		}
 
-		mTextChanged = true;
-	}
-
-	return totalLines;
-}
+			/*
+			Left mouse button triple click
+			*/
 
-void CCodeEditor::AddUndo(UndoRecord& aValue)
-{
-	assert(!mReadOnly);
-	//printf("AddUndo: (@%d.%d) +\'%s' [%d.%d .. %d.%d], -\'%s', [%d.%d .. %d.%d] (@%d.%d)\n",
-	//	aValue.mBefore.mCursorPosition.mLine, aValue.mBefore.mCursorPosition.mColumn,
-	//	aValue.mAdded.c_str(), aValue.mAddedStart.mLine, aValue.mAddedStart.mColumn, aValue.mAddedEnd.mLine, aValue.mAddedEnd.mColumn,
-	//	aValue.mRemoved.c_str(), aValue.mRemovedStart.mLine, aValue.mRemovedStart.mColumn, aValue.mRemovedEnd.mLine, aValue.mRemovedEnd.mColumn,
-	//	aValue.mAfter.mCursorPosition.mLine, aValue.mAfter.mCursorPosition.mColumn
-	//	);
-
-	mUndoBuffer.resize((size_t)(mUndoIndex + 1));
-	mUndoBuffer.back() = aValue;
-	++mUndoIndex;
-}
+			else if (tripleClick)
+			{
+				if (!ctrl)
+				{
+					mDocument.mState.mCursorPosition = mDocument.mInteractiveStart = mDocument.mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
+					mSelectionMode = SelectionMode::Line;
+					mDocument.SetSelection(mDocument.mInteractiveStart, mDocument.mInteractiveEnd, mSelectionMode);
+				}
 
-CCodeEditor::Coordinates CCodeEditor::ScreenPosToCoordinates(const ImVec2& aPosition) const
-{
-	ImVec2 origin = ImGui::GetCursorScreenPos();
-	ImVec2 local(aPosition.x - origin.x, aPosition.y - origin.y);
+				mLastClick = -1.0f;
+			}
 
-	int lineNo = std::max(0, (int)floor(local.y / mCharAdvance.y));
+			/*
+			Left mouse button double click
+			*/
 
-	int columnCoord = 0;
+			else if (doubleClick)
+			{
+				if (!ctrl)
+				{
+					mDocument.mState.mCursorPosition = mDocument.mInteractiveStart = mDocument.mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
+					if (mSelectionMode == SelectionMode::Line)
+						mSelectionMode = SelectionMode::Normal;
+					else
+						mSelectionMode = SelectionMode::Word;
+					mDocument.SetSelection(mDocument.mInteractiveStart, mDocument.mInteractiveEnd, mSelectionMode);
+				}
 
-	if (lineNo >= 0 && lineNo < (int)mLines.size())
-	{
-		auto& line = mLines.at(lineNo);
+				mLastClick = (float)ImGui::GetTime();
+			}
 
-		int columnIndex = 0;
-		float columnX = 0.0f;
+			/*
+			Left mouse button click
+			*/
+			else if (click)
+			{
+				mDocument.mState.mCursorPosition = mDocument.mInteractiveStart = mDocument.mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
+				if (ctrl)
+					mSelectionMode = SelectionMode::Word;
+				else
+					mSelectionMode = SelectionMode::Normal;
+				mDocument.SetSelection(mDocument.mInteractiveStart, mDocument.mInteractiveEnd, mSelectionMode);
 
-		while ((size_t)columnIndex < line.size())
+				mLastClick = (float)ImGui::GetTime();
+			}
+			// Mouse left button dragging (=> update selection)
+			else if (ImGui::IsMouseDragging(0) && ImGui::IsMouseDown(0))
+			{
+				io.WantCaptureMouse = true;
+				mDocument.mState.mCursorPosition = mDocument.mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
+				mDocument.SetSelection(mDocument.mInteractiveStart, mDocument.mInteractiveEnd, mSelectionMode);
+			}
+		}
+		else if (alt && !ctrl)
 		{
-			float columnWidth = 0.0f;
-
-			if (line[columnIndex].mChar == '\t')
+			/*
+			Alt + click adds a cursor, Shift + Alt + click or drag selects a column block from mDocument.mInteractiveStart
+			*/
+			if (ImGui::IsMouseClicked(0))
 			{
-				float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ").x;
-				float oldX = columnX;
-				float newColumnX = (1.0f + std::floor((1.0f + columnX) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-				columnWidth = newColumnX - oldX;
-				if (mTextStart + columnX + columnWidth * 0.5f > local.x)
-					break;
-				columnX = newColumnX;
-				columnCoord = (columnCoord / mTabSize) * mTabSize + mTabSize;
-				columnIndex++;
+				mDocument.mCompletions.clear();
+
+				if (shift)
+					mDocument.SetColumnSelection(mDocument.mInteractiveStart, ScreenPosToCoordinates(ImGui::GetMousePos()));
+				else
+					mDocument.AddCursor(ScreenPosToCoordinates(ImGui::GetMousePos()));
 			}
-			else
+			else if (shift && ImGui::IsMouseDragging(0) && ImGui::IsMouseDown(0))
 			{
-				char buf[7];
-				auto d = UTF8CharLength(line[columnIndex].mChar);
-				int i = 0;
-				while (i < 6 && d-- > 0)
-					buf[i++] = line[columnIndex++].mChar;
-				buf[i] = '\0';
-				columnWidth = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf).x;
-				if (mTextStart + columnX + columnWidth * 0.5f > local.x)
-					break;
-				columnX += columnWidth;
-				columnCoord++;
+				io.WantCaptureMouse = true;
+				mDocument.SetColumnSelection(mDocument.mInteractiveStart, ScreenPosToCoordinates(ImGui::GetMousePos()));
 			}
 		}
 	}
-
-	return SanitizeCoordinates(Coordinates(lineNo, columnCoord));
 }
 
-CCodeEditor::Coordinates CCodeEditor::FindWordStart(const Coordinates & aFrom) const
+void CCodeEditor::Render()
 {
-	Coordinates at = aFrom;
-	if (at.mLine >= (int)mLines.size())
-		return at;
-
-	auto& line = mLines[at.mLine];
-	auto cindex = GetCharacterIndex(at);
+	/* Compute mCharAdvance regarding to scaled font size (Ctrl + mouse wheel)*/
+	const float fontSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, "#", nullptr, nullptr).x;
+	mCharAdvance = ImVec2(fontSize, ImGui::GetTextLineHeightWithSpacing() * mLineSpacing);
 
-	if (cindex >= (int)line.size())
-		return at;
+	/* Update palette with the current alpha from style */
+	for (int i = 0; i < (int)PaletteIndex::Max; ++i)
+	{
+		auto color = ImGui::ColorConvertU32ToFloat4(mPaletteBase[i]);
+		color.w *= ImGui::GetStyle().Alpha;
+		mPalette[i] = ImGui::ColorConvertFloat4ToU32(color);
+	}
 
-	while (cindex > 0 && isspace(line[cindex].mChar))
-		--cindex;
+	auto contentSize = ImGui::GetWindowContentRegionMax();
+	auto drawList = ImGui::GetWindowDrawList();
+	const ImVec2 clipMin = drawList->GetClipRectMin();
+	const ImVec2 clipMax = drawList->GetClipRectMax();
 
-	auto cstart = (PaletteIndex)line[cindex].mColorIndex;
-	while (cindex > 0)
+	if (mDocument.mScrollToTop)
 	{
-		auto c = line[cindex].mChar;
-		if ((c & 0xC0) != 0x80)	// not UTF code sequence 10xxxxxx
-		{
-			if (c <= 32 && isspace(c))
-			{
-				cindex++;
-				break;
-			}
-			if (cstart != (PaletteIndex)line[size_t(cindex - 1)].mColorIndex)
-				break;
-		}
-		--cindex;
+		mDocument.mScrollToTop = false;
+		ImGui::SetScrollY(0.f);
 	}
-	return Coordinates(at.mLine, GetCharacterColumn(at.mLine, cindex));
-}
 
-CCodeEditor::Coordinates CCodeEditor::FindWordEnd(const Coordinates & aFrom) const
-{
-	Coordinates at = aFrom;
-	if (at.mLine >= (int)mLines.size())
-		return at;
+	ImVec2 cursorScreenPos = ImGui::GetCursorScreenPos();
+	auto scrollX = ImGui::GetScrollX();
+	auto scrollY = ImGui::GetScrollY();
 
-	auto& line = mLines[at.mLine];
-	auto cindex = GetCharacterIndex(at);
+	// Rows on screen skip the lines hidden by folds
+	auto rowNo = (int)floor(scrollY / mCharAdvance.y);
+	auto globalLineMax = (int)mDocument.mLines.size();
+	auto rowMax = std::max(0, std::min(mDocument.GetVisibleLineCount() - 1, rowNo + (int)floor((scrollY + contentSize.y) / mCharAdvance.y)));
+	mDocument.mViewLineMin = mDocument.RowToLine(rowNo);
+	mDocument.mViewLineMax = mDocument.RowToLine(rowMax) + 1;
 
-	if (cindex >= (int)line.size())
-		return at;
+	// Deduce mTextStart by evaluating mLines size (global lineMax) plus two spaces as text width
+	char buf[16];
+	snprintf(buf, 16, " %d ", globalLineMax);
+	mTextStart = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf, nullptr, nullptr).x + mLeftMargin;
 
-	bool prevspace = (bool)isspace(line[cindex].mChar);
-	auto cstart = (PaletteIndex)line[cindex].mColorIndex;
-	while (cindex < (int)line.size())
+	if (!mDocument.mLines.empty())
 	{
-		auto c = line[cindex].mChar;
-		auto d = UTF8CharLength(c);
-		if (cstart != (PaletteIndex)line[cindex].mColorIndex)
-			break;
+		float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
 
-		if (prevspace != !!isspace(c))
+		auto focused = ImGui::IsWindowFocused();
+		auto caretVisible = false;
+		if (focused)
 		{
-			if (isspace(c))
-				while (cindex < (int)line.size() && isspace(line[cindex].mChar))
-					++cindex;
-			break;
+			auto timeEnd = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			auto elapsed = timeEnd - mStartTime;
+			caretVisible = elapsed > 400;
+			if (elapsed > 800)
+				mStartTime = timeEnd;
 		}
-		cindex += d;
-	}
-	return Coordinates(aFrom.mLine, GetCharacterColumn(aFrom.mLine, cindex));
-}
 
-CCodeEditor::Coordinates CCodeEditor::FindNextWord(const Coordinates & aFrom) const
-{
-	Coordinates at = aFrom;
-	if (at.mLine >= (int)mLines.size())
-		return at;
-
-	// skip to the next non-word character
-	auto cindex = GetCharacterIndex(aFrom);
-	bool isword = false;
-	bool skip = false;
-	if (cindex < (int)mLines[at.mLine].size())
-	{
-		auto& line = mLines[at.mLine];
-		isword = isalnum(line[cindex].mChar);
-		skip = isword;
-	}
+		// The bracket or block keyword at the cursor and the one it pairs with
+		int pairLine = -1, pairToken = -1, matchLine = -1, matchToken = -1;
+		if (!mDocument.HasSelection())
+			mDocument.FindMatchingPair(mDocument.GetActualCursorCoordinates(), pairLine, pairToken, matchLine, matchToken);
 
-	while (!isword || skip)
-	{
-		if (at.mLine >= mLines.size())
+		while (rowNo <= rowMax)
 		{
-			auto l = std::max(0, (int) mLines.size() - 1);
-			return Coordinates(l, GetLineMaxColumn(l));
-		}
-
-		auto& line = mLines[at.mLine];
-		if (cindex < (int)line.size())
-		{
-			isword = isalnum(line[cindex].mChar);
-
-			if (isword && !skip)
-				return Coordinates(at.mLine, GetCharacterColumn(at.mLine, cindex));
-
-			if (!isword)
-				skip = false;
-
-			cindex++;
-		}
-		else
-		{
-			cindex = 0;
-			++at.mLine;
-			skip = false;
-			isword = false;
-		}
-	}
-
-	return at;
-}
-
-int CCodeEditor::GetCharacterIndex(const Coordinates& aCoordinates) const
-{
-	if (aCoordinates.mLine >= mLines.size())
-		return -1;
-	auto& line = mLines[aCoordinates.mLine];
-	int c = 0;
-	int i = 0;
-	for (; i < line.size() && c < aCoordinates.mColumn;)
-	{
-		if (line[i].mChar == '\t')
-			c = (c / mTabSize) * mTabSize + mTabSize;
-		else
-			++c;
-		i += UTF8CharLength(line[i].mChar);
-	}
-	return i;
-}
-
-int CCodeEditor::GetCharacterColumn(int aLine, int aIndex) const
-{
-	if (aLine >= mLines.size())
-		return 0;
-	auto& line = mLines[aLine];
-	int col = 0;
-	int i = 0;
-	while (i < aIndex && i < (int)line.size())
-	{
-		auto c = line[i].mChar;
-		i += UTF8CharLength(c);
-		if (c == '\t')
-			col = (col / mTabSize) * mTabSize + mTabSize;
-		else
-			col++;
-	}
-	return col;
-}
-
-int CCodeEditor::GetLineCharacterCount(int aLine) const
-{
-	if (aLine >= mLines.size())
-		return 0;
-	auto& line = mLines[aLine];
-	int c = 0;
-	for (unsigned i = 0; i < line.size(); c++)
-		i += UTF8CharLength(line[i].mChar);
-	return c;
-}
-
-int CCodeEditor::GetLineMaxColumn(int aLine) const
-{
-	if (aLine >= mLines.size())
-		return 0;
-	auto& line = mLines[aLine];
-	int col = 0;
-	for (unsigned i = 0; i < line.size(); )
-	{
-		auto c = line[i].mChar;
-		if (c == '\t')
-			col = (col / mTabSize) * mTabSize + mTabSize;
-		else
-			col++;
-		i += UTF8CharLength(c);
-	}
-	return col;
-}
-
-bool CCodeEditor::IsOnWordBoundary(const Coordinates & aAt) const
-{
-	if (aAt.mLine >= (int)mLines.size() || aAt.mColumn == 0)
-		return true;
-
-	auto& line = mLines[aAt.mLine];
-	auto cindex = GetCharacterIndex(aAt);
-	if (cindex >= (int)line.size())
-		return true;
-
-	if (mColorizerEnabled)
-		return line[cindex].mColorIndex != line[size_t(cindex - 1)].mColorIndex;
-
-	return isspace(line[cindex].mChar) != isspace(line[cindex - 1].mChar);
-}
-
-void CCodeEditor::RemoveLine(int aStart, int aEnd)
-{
-	assert(!mReadOnly);
-	assert(aEnd >= aStart);
-	assert(mLines.size() > (size_t)(aEnd - aStart));
-
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-	{
-		ErrorMarkers::value_type e(i.first >= aStart ? i.first - 1 : i.first, i.second);
-		if (e.first >= aStart && e.first <= aEnd)
-			continue;
-		etmp.insert(e);
-	}
-	mErrorMarkers = std::move(etmp);
-
-	Breakpoints btmp;
-	for (auto i : mBreakpoints)
-	{
-		if (i >= aStart && i <= aEnd)
-			continue;
-		btmp.insert(i >= aStart ? i - 1 : i);
-	}
-	mBreakpoints = std::move(btmp);
-
-	mLines.erase(mLines.begin() + aStart, mLines.begin() + aEnd);
-	assert(!mLines.empty());
-
-	mTextChanged = true;
-}
-
-void CCodeEditor::RemoveLine(int aIndex)
-{
-	assert(!mReadOnly);
-	assert(mLines.size() > 1);
-
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-	{
-		ErrorMarkers::value_type e(i.first > aIndex ? i.first - 1 : i.first, i.second);
-		if (e.first - 1 == aIndex)
-			continue;
-		etmp.insert(e);
-	}
-	mErrorMarkers = std::move(etmp);
-
-	Breakpoints btmp;
-	for (auto i : mBreakpoints)
-	{
-		if (i == aIndex)
-			continue;
-		btmp.insert(i >= aIndex ? i - 1 : i);
-	}
-	mBreakpoints = std::move(btmp);
-
-	mLines.erase(mLines.begin() + aIndex);
-	assert(!mLines.empty());
-
-	mTextChanged = true;
-}
-
-CCodeEditor::Line& CCodeEditor::InsertLine(int aIndex)
-{
-	assert(!mReadOnly);
-
-	auto& result = *mLines.insert(mLines.begin() + aIndex, Line());
-
-	ErrorMarkers etmp;
-	for (auto& i : mErrorMarkers)
-		etmp.insert(ErrorMarkers::value_type(i.first >= aIndex ? i.first + 1 : i.first, i.second));
-	mErrorMarkers = std::move(etmp);
-
-	Breakpoints btmp;
-	for (auto i : mBreakpoints)
-		btmp.insert(i >= aIndex ? i + 1 : i);
-	mBreakpoints = std::move(btmp);
-
-	return result;
-}
-
-std::string CCodeEditor::GetWordUnderCursor() const
-{
-	auto c = GetCursorPosition();
-	return GetWordAt(c);
-}
-
-std::string CCodeEditor::GetWordAt(const Coordinates & aCoords) const
-{
-	auto start = FindWordStart(aCoords);
-	auto end = FindWordEnd(aCoords);
-
-	std::string r;
-
-	auto istart = GetCharacterIndex(start);
-	auto iend = GetCharacterIndex(end);
-
-	for (auto it = istart; it < iend; ++it)
-		r.push_back(mLines[aCoords.mLine][it].mChar);
-
-	return r;
-}
-
-ImU32 CCodeEditor::GetGlyphColor(const Glyph & aGlyph) const
-{
-	if (!mColorizerEnabled)
-		return mPalette[(int)PaletteIndex::Default];
-	if (aGlyph.mComment)
-		return mPalette[(int)PaletteIndex::Comment];
-	if (aGlyph.mMultiLineComment)
-		return mPalette[(int)PaletteIndex::MultiLineComment];
-	auto const color = mPalette[(int)aGlyph.mColorIndex];
-	if (aGlyph.mPreprocessor)
-	{
-		const auto ppcolor = mPalette[(int)PaletteIndex::Preprocessor];
-		const int c0 = ((ppcolor & 0xff) + (color & 0xff)) / 2;
-		const int c1 = (((ppcolor >> 8) & 0xff) + ((color >> 8) & 0xff)) / 2;
-		const int c2 = (((ppcolor >> 16) & 0xff) + ((color >> 16) & 0xff)) / 2;
-		const int c3 = (((ppcolor >> 24) & 0xff) + ((color >> 24) & 0xff)) / 2;
-		return ImU32(c0 | (c1 << 8) | (c2 << 16) | (c3 << 24));
-	}
-	return color;
-}
-
-void CCodeEditor::HandleKeyboardInputs()
-{
-	ImGuiIO& io = ImGui::GetIO();
-	auto shift = io.KeyShift;
-	auto ctrl = io.ConfigMacOSXBehaviors ? io.KeySuper : io.KeyCtrl;
-	auto alt = io.ConfigMacOSXBehaviors ? io.KeyCtrl : io.KeyAlt;
-
-	if (ImGui::IsWindowFocused())
-	{
-		if (ImGui::IsWindowHovered())
-			ImGui::SetMouseCursor(ImGuiMouseCursor_TextInput);
-		//ImGui::CaptureKeyboardFromApp(true);
+			auto lineNo = mDocument.RowToLine(rowNo);
+			ImVec2 lineStartScreenPos = ImVec2(cursorScreenPos.x, cursorScreenPos.y + rowNo * mCharAdvance.y);
+			ImVec2 textScreenPos = ImVec2(lineStartScreenPos.x + mTextStart, lineStartScreenPos.y);
 
-		io.WantCaptureKeyboard = true;
-		io.WantTextInput = true;
+			auto& line = mDocument.mLines[lineNo];
+			auto& offsets = GetLineLayout(lineNo);
+			Coordinates lineStartCoord(lineNo, 0);
+			Coordinates lineEndCoord(lineNo, mDocument.GetLineMaxColumn(lineNo));
 
-		if (!IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Z)))
-			Undo();
-		else if (!IsReadOnly() && !ctrl && !shift && alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Backspace)))
-			Undo();
-		else if (!IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Y)))
-			Redo();
-		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_UpArrow)))
-			MoveUp(1, shift);
-		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_DownArrow)))
-			MoveDown(1, shift);
-		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_LeftArrow)))
-			MoveLeft(1, shift, ctrl);
-		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_RightArrow)))
-			MoveRight(1, shift, ctrl);
-		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageUp)))
-			MoveUp(GetPageSize() - 4, shift);
-		else if (!alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_PageDown)))
-			MoveDown(GetPageSize() - 4, shift);
-		else if (!alt && ctrl && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Home)))
-			MoveTop(shift);
-		else if (ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_End)))
-			MoveBottom(shift);
-		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Home)))
-			MoveHome(shift);
-		else if (!ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_End)))
-			MoveEnd(shift);
-		else if (!IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Delete)))
-			Delete();
-		else if (!IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Backspace)))
-			Backspace();
-		else if (!ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
-			mOverwrite ^= true;
-		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
-			Copy();
-		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_C)))
-			Copy();
-		else if (!IsReadOnly() && !ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Insert)))
-			Paste();
-		else if (!IsReadOnly() && ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_V)))
-			Paste();
-		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_X)))
-			Cut();
-		else if (!ctrl && shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Delete)))
-			Cut();
-		else if (ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_A)))
-			SelectAll();
-		else if (!IsReadOnly() && !ctrl && !shift && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter)))
-			EnterCharacter('\n', false);
-		else if (!IsReadOnly() && !ctrl && !alt && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Tab)))
-			EnterCharacter('\t', shift);
+			// The extra cursors that have their selection or caret on this line
+			auto& extras = mDocument.mState.mExtraCursors;
+			auto extrasBegin = std::lower_bound(extras.begin(), extras.end(), lineStartCoord,
+				[](const CCodeDocument::Cursor& aCursor, const Coordinates& aCoords) { return aCursor.GetEnd() < aCoords; });
+			auto extrasEnd = extrasBegin;
+			while (extrasEnd != extras.end() && extrasEnd->GetStart() <= lineEndCoord)
+				++extrasEnd;
 
-		if (!IsReadOnly() && !io.InputQueueCharacters.empty())
-		{
-			for (int i = 0; i < io.InputQueueCharacters.Size; i++)
+			// Draw selection for the current line
+			auto drawSelection = [&](const CCodeDocument::Cursor& aCursor)
 			{
-				auto c = io.InputQueueCharacters[i];
-				if (c != 0 && (c == '\n' || c >= 32))
-					EnterCharacter(c, shift);
-			}
-			io.InputQueueCharacters.resize(0);
-		}
-	}
-}
+				float sstart = -1.0f;
+				float ssend = -1.0f;
 
-void CCodeEditor::HandleMouseInputs()
-{
-	ImGuiIO& io = ImGui::GetIO();
-	auto shift = io.KeyShift;
-	auto ctrl = io.ConfigMacOSXBehaviors ? io.KeySuper : io.KeyCtrl;
-	auto alt = io.ConfigMacOSXBehaviors ? io.KeyCtrl : io.KeyAlt;
-
-	if (ImGui::IsWindowHovered())
-	{
-		if (!shift && !alt)
-		{
-			auto click = ImGui::IsMouseClicked(0);
-			auto doubleClick = ImGui::IsMouseDoubleClicked(0);
-			auto t = ImGui::GetTime();
-			auto tripleClick = click && !doubleClick && (mLastClick != -1.0f && (t - mLastClick) < io.MouseDoubleClickTime);
+				assert(aCursor.mSelectionStart <= aCursor.mSelectionEnd);
+				if (aCursor.mSelectionStart <= lineEndCoord)
+					sstart = aCursor.mSelectionStart > lineStartCoord ? TextDistanceToLineStart(aCursor.mSelectionStart) : 0.0f;
+				if (aCursor.mSelectionEnd > lineStartCoord)
+					ssend = aCursor.mSelectionEnd < lineEndCoord ? TextDistanceToLineStart(aCursor.mSelectionEnd) : offsets.back();
 
-			/*
-			Left mouse button triple click
-			*/
+				if (aCursor.mSelectionEnd.mLine > lineNo)
+					ssend += mCharAdvance.x;
 
-			if (tripleClick)
-			{
-				if (!ctrl)
+				if (sstart != -1 && ssend != -1 && sstart < ssend)
 				{
-					mState.mCursorPosition = mInteractiveStart = mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
-					mSelectionMode = SelectionMode::Line;
-					SetSelection(mInteractiveStart, mInteractiveEnd, mSelectionMode);
+					ImVec2 vstart(lineStartScreenPos.x + mTextStart + sstart, lineStartScreenPos.y);
+					ImVec2 vend(lineStartScreenPos.x + mTextStart + ssend, lineStartScreenPos.y + mCharAdvance.y);
+					drawList->AddRectFilled(vstart, vend, mPalette[(int)PaletteIndex::Selection]);
 				}
+			};
 
-				mLastClick = -1.0f;
-			}
-
-			/*
-			Left mouse button double click
-			*/
+			drawSelection(mDocument.mState);
+			for (auto it = extrasBegin; it != extrasEnd; ++it)
+				drawSelection(*it);
 
-			else if (doubleClick)
+			// Draw find matches
+			if (!mDocument.mFindQuery.empty())
 			{
-				if (!ctrl)
+				auto& matches = mDocument.GetLineMatches(lineNo);
+				for (size_t m = 0; m < matches.size(); m += 2)
 				{
-					mState.mCursorPosition = mInteractiveStart = mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
-					if (mSelectionMode == SelectionMode::Line)
-						mSelectionMode = SelectionMode::Normal;
-					else
-						mSelectionMode = SelectionMode::Word;
-					SetSelection(mInteractiveStart, mInteractiveEnd, mSelectionMode);
+					ImVec2 vstart(textScreenPos.x + offsets[matches[m]], lineStartScreenPos.y);
+					ImVec2 vend(textScreenPos.x + offsets[matches[m + 1]], lineStartScreenPos.y + mCharAdvance.y);
+					drawList->AddRectFilled(vstart, vend, mPalette[(int)PaletteIndex::FindMatch]);
 				}
-
-				mLastClick = (float)ImGui::GetTime();
 			}
 
-			/*
-			Left mouse button click
-			*/
-			else if (click)
-			{
-				mState.mCursorPosition = mInteractiveStart = mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
-				if (ctrl)
-					mSelectionMode = SelectionMode::Word;
-				else
-					mSelectionMode = SelectionMode::Normal;
-				SetSelection(mInteractiveStart, mInteractiveEnd, mSelectionMode);
-
-				mLastClick = (float)ImGui::GetTime();
-			}
-			// Mouse left button dragging (=> update selection)
-			else if (ImGui::IsMouseDragging(0) && ImGui::IsMouseDown(0))
+			// Draw the matching pair
+			auto drawPair = [&](int aToken)
 			{
-				io.WantCaptureMouse = true;
-				mState.mCursorPosition = mInteractiveEnd = ScreenPosToCoordinates(ImGui::GetMousePos());
-				SetSelection(mInteractiveStart, mInteractiveEnd, mSelectionMode);
-			}
-		}
-	}
-}
-
-void CCodeEditor::Render()
-{
-	/* Compute mCharAdvance regarding to scaled font size (Ctrl + mouse wheel)*/
-	const float fontSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, "#", nullptr, nullptr).x;
-	mCharAdvance = ImVec2(fontSize, ImGui::GetTextLineHeightWithSpacing() * mLineSpacing);
-
-	/* Update palette with the current alpha from style */
-	for (int i = 0; i < (int)PaletteIndex::Max; ++i)
-	{
-		auto color = ImGui::ColorConvertU32ToFloat4(mPaletteBase[i]);
-		color.w *= ImGui::GetStyle().Alpha;
-		mPalette[i] = ImGui::ColorConvertFloat4ToU32(color);
-	}
-
-	assert(mLineBuffer.empty());
-
-	auto contentSize = ImGui::GetWindowContentRegionMax();
-	auto drawList = ImGui::GetWindowDrawList();
-	float longest(mTextStart);
-
-	if (mScrollToTop)
-	{
-		mScrollToTop = false;
-		ImGui::SetScrollY(0.f);
-	}
-
-	ImVec2 cursorScreenPos = ImGui::GetCursorScreenPos();
-	auto scrollX = ImGui::GetScrollX();
-	auto scrollY = ImGui::GetScrollY();
-
-	auto lineNo = (int)floor(scrollY / mCharAdvance.y);
-	auto globalLineMax = (int)mLines.size();
-	auto lineMax = std::max(0, std::min((int)mLines.size() - 1, lineNo + (int)floor((scrollY + contentSize.y) / mCharAdvance.y)));
+				auto& token = line.mPairs[aToken];
+				if (token.mIndex + token.mLength > (int)line.size())
+					return;
 
-	// Deduce mTextStart by evaluating mLines size (global lineMax) plus two spaces as text width
-	char buf[16];
-	snprintf(buf, 16, " %d ", globalLineMax);
-	mTextStart = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf, nullptr, nullptr).x + mLeftMargin;
-
-	if (!mLines.empty())
-	{
-		float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
-
-		while (lineNo <= lineMax)
-		{
-			ImVec2 lineStartScreenPos = ImVec2(cursorScreenPos.x, cursorScreenPos.y + lineNo * mCharAdvance.y);
-			ImVec2 textScreenPos = ImVec2(lineStartScreenPos.x + mTextStart, lineStartScreenPos.y);
-
-			auto& line = mLines[lineNo];
-			longest = std::max(mTextStart + TextDistanceToLineStart(Coordinates(lineNo, GetLineMaxColumn(lineNo))), longest);
-			auto columnNo = 0;
-			Coordinates lineStartCoord(lineNo, 0);
-			Coordinates lineEndCoord(lineNo, GetLineMaxColumn(lineNo));
-
-			// Draw selection for the current line
-			float sstart = -1.0f;
-			float ssend = -1.0f;
-
-			assert(mState.mSelectionStart <= mState.mSelectionEnd);
-			if (mState.mSelectionStart <= lineEndCoord)
-				sstart = mState.mSelectionStart > lineStartCoord ? TextDistanceToLineStart(mState.mSelectionStart) : 0.0f;
-			if (mState.mSelectionEnd > lineStartCoord)
-				ssend = TextDistanceToLineStart(mState.mSelectionEnd < lineEndCoord ? mState.mSelectionEnd : lineEndCoord);
-
-			if (mState.mSelectionEnd.mLine > lineNo)
-				ssend += mCharAdvance.x;
+				ImVec2 vstart(textScreenPos.x + offsets[token.mIndex], lineStartScreenPos.y);
+				ImVec2 vend(textScreenPos.x + offsets[token.mIndex + token.mLength], lineStartScreenPos.y + mCharAdvance.y);
+				drawList->AddRectFilled(vstart, vend, mPalette[(int)PaletteIndex::MatchingPair]);
+			};
 
-			if (sstart != -1 && ssend != -1 && sstart < ssend)
-			{
-				ImVec2 vstart(lineStartScreenPos.x + mTextStart + sstart, lineStartScreenPos.y);
-				ImVec2 vend(lineStartScreenPos.x + mTextStart + ssend, lineStartScreenPos.y + mCharAdvance.y);
-				drawList->AddRectFilled(vstart, vend, mPalette[(int)PaletteIndex::Selection]);
-			}
+			if (lineNo == pairLine)
+				drawPair(pairToken);
+			if (lineNo == matchLine)
+				drawPair(matchToken);
 
 			// Draw breakpoints
 			auto start = ImVec2(lineStartScreenPos.x + scrollX, lineStartScreenPos.y);
 
-			if (mBreakpoints.count(lineNo + 1) != 0)
+			if (mDocument.mBreakpoints.count(lineNo + 1) != 0)
 			{
 				auto end = ImVec2(lineStartScreenPos.x + contentSize.x + 2.0f * scrollX, lineStartScreenPos.y + mCharAdvance.y);
 				drawList->AddRectFilled(start, end, mPalette[(int)PaletteIndex::Breakpoint]);
 			}
 
 			// Draw error markers
-			auto errorIt = mErrorMarkers.find(lineNo + 1);
-			if (errorIt != mErrorMarkers.end())
+			auto errorIt = mDocument.mErrorMarkers.find(lineNo + 1);
+			if (errorIt != mDocument.mErrorMarkers.end())
 			{
 				auto end = ImVec2(lineStartScreenPos.x + contentSize.x + 2.0f * scrollX, lineStartScreenPos.y + mCharAdvance.y);
 				drawList->AddRectFilled(start, end, mPalette[(int)PaletteIndex::ErrorMarker]);
@@ -961,85 +543,84 @@ void CCodeEditor::Render()
 			auto lineNoWidth = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf, nullptr, nullptr).x;
 			drawList->AddText(ImVec2(lineStartScreenPos.x + mTextStart - lineNoWidth, lineStartScreenPos.y), mPalette[(int)PaletteIndex::LineNumber], buf);
 
-			if (mState.mCursorPosition.mLine == lineNo)
+			// Draw the fold marker in the gap after the line number, and an ellipsis
+			// after the first line of a folded block
+			if (mDocument.FindFoldRegion(lineNo) != nullptr)
+			{
+				const auto folded = mDocument.IsFolded(lineNo);
+				const auto size = ImGui::GetFontSize() * 0.25f;
+				const ImVec2 center(lineStartScreenPos.x + mTextStart - spaceSize, lineStartScreenPos.y + mCharAdvance.y * 0.5f);
+
+				if (folded)
+					drawList->AddTriangleFilled(ImVec2(center.x - size * 0.5f, center.y - size), ImVec2(center.x - size * 0.5f, center.y + size), ImVec2(center.x + size, center.y), mPalette[(int)PaletteIndex::LineNumber]);
+				else
+					drawList->AddTriangleFilled(ImVec2(center.x - size, center.y - size * 0.5f), ImVec2(center.x + size, center.y - size * 0.5f), ImVec2(center.x, center.y + size), mPalette[(int)PaletteIndex::LineNumber]);
+
+				if (folded)
+					drawList->AddText(ImVec2(textScreenPos.x + offsets.back() + spaceSize, lineStartScreenPos.y), mPalette[(int)PaletteIndex::LineNumber], "...");
+			}
+
+			// Render the cursor
+			auto drawCaret = [&](const Coordinates& aPosition)
 			{
-				auto focused = ImGui::IsWindowFocused();
+				float width = 1.0f;
+				auto cindex = mDocument.GetCharacterIndex(aPosition);
+				float cx = TextDistanceToLineStart(aPosition);
 
+				if (mDocument.mOverwrite && cindex < (int)line.size())
+				{
+					auto next = cindex + 1;
+					while (next < (int)line.size() && offsets[next] == offsets[cindex])
+						next++;
+					width = offsets[next] - cx;
+				}
+				ImVec2 cstart(textScreenPos.x + cx, lineStartScreenPos.y);
+				ImVec2 cend(textScreenPos.x + cx + width, lineStartScreenPos.y + mCharAdvance.y);
+				drawList->AddRectFilled(cstart, cend, mPalette[(int)PaletteIndex::Cursor]);
+			};
+
+			if (mDocument.mState.mCursorPosition.mLine == lineNo)
+			{
 				// Highlight the current line (where the cursor is)
-				if (!HasSelection())
+				if (!mDocument.HasSelection())
 				{
 					auto end = ImVec2(start.x + contentSize.x + scrollX, start.y + mCharAdvance.y);
 					drawList->AddRectFilled(start, end, mPalette[(int)(focused ? PaletteIndex::CurrentLineFill : PaletteIndex::CurrentLineFillInactive)]);
 					drawList->AddRect(start, end, mPalette[(int)PaletteIndex::CurrentLineEdge], 1.0f);
 				}
 
-				// Render the cursor
-				if (focused)
-				{
-					auto timeEnd = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-					auto elapsed = timeEnd - mStartTime;
-					if (elapsed > 400)
-					{
-						float width = 1.0f;
-						auto cindex = GetCharacterIndex(mState.mCursorPosition);
-						float cx = TextDistanceToLineStart(mState.mCursorPosition);
-
-						if (mOverwrite && cindex < (int)line.size())
-						{
-							auto c = line[cindex].mChar;
-							if (c == '\t')
-							{
-								auto x = (1.0f + std::floor((1.0f + cx) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-								width = x - cx;
-							}
-							else
-							{
-								char buf2[2];
-								buf2[0] = line[cindex].mChar;
-								buf2[1] = '\0';
-								width = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf2).x;
-							}
-						}
-						ImVec2 cstart(textScreenPos.x + cx, lineStartScreenPos.y);
-						ImVec2 cend(textScreenPos.x + cx + width, lineStartScreenPos.y + mCharAdvance.y);
-						drawList->AddRectFilled(cstart, cend, mPalette[(int)PaletteIndex::Cursor]);
-						if (elapsed > 800)
-							mStartTime = timeEnd;
-					}
-				}
+				if (caretVisible)
+					drawCaret(mDocument.mState.mCursorPosition);
 			}
 
+			if (caretVisible)
+			{
+				for (auto it = extrasBegin; it != extrasEnd; ++it)
+					if (it->mCursorPosition.mLine == lineNo)
+						drawCaret(it->mCursorPosition);
+			}
+
+			// Only the bytes that can reach into the clip rect are looked at; a glyph
+			// may overhang its advance, hence the margin of one font size.
+			const float margin = ImGui::GetFontSize();
+			const auto firstVisible = std::lower_bound(offsets.begin(), offsets.end() - 1, clipMin.x - textScreenPos.x - margin) - offsets.begin();
+			const auto endVisible = std::upper_bound(offsets.begin() + firstVisible, offsets.end() - 1, clipMax.x - textScreenPos.x + margin) - offsets.begin();
+
 			// Render colorized text
-			auto prevColor = line.empty() ? mPalette[(int)PaletteIndex::Default] : GetGlyphColor(line[0]);
-			ImVec2 bufferOffset;
+			RenderLineGlyphs(drawList, line, (int)firstVisible, (int)endVisible, textScreenPos);
 
-			for (int i = 0; i < line.size();)
+			if (mShowWhitespaces)
 			{
-				auto& glyph = line[i];
-				auto color = GetGlyphColor(glyph);
+				const auto s = ImGui::GetFontSize();
+				const auto y = textScreenPos.y + s * 0.5f;
 
-				if ((color != prevColor || glyph.mChar == '\t' || glyph.mChar == ' ') && !mLineBuffer.empty())
+				for (auto i = firstVisible; i < endVisible; ++i)
 				{
-					const ImVec2 newOffset(textScreenPos.x + bufferOffset.x, textScreenPos.y + bufferOffset.y);
-					drawList->AddText(newOffset, prevColor, mLineBuffer.c_str());
-					auto textSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, mLineBuffer.c_str(), nullptr, nullptr);
-					bufferOffset.x += textSize.x;
-					mLineBuffer.clear();
-				}
-				prevColor = color;
-
-				if (glyph.mChar == '\t')
-				{
-					auto oldX = bufferOffset.x;
-					bufferOffset.x = (1.0f + std::floor((1.0f + bufferOffset.x) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-					++i;
-
-					if (mShowWhitespaces)
+					auto ch = line.GetChar(i);
+					if (ch == '\t')
 					{
-						const auto s = ImGui::GetFontSize();
-						const auto x1 = textScreenPos.x + oldX + 1.0f;
-						const auto x2 = textScreenPos.x + bufferOffset.x - 1.0f;
-						const auto y = textScreenPos.y + bufferOffset.y + s * 0.5f;
+						const auto x1 = textScreenPos.x + offsets[i] + 1.0f;
+						const auto x2 = textScreenPos.x + offsets[i + 1] - 1.0f;
 						const ImVec2 p1(x1, y);
 						const ImVec2 p2(x2, y);
 						const ImVec2 p3(x2 - s * 0.2f, y - s * 0.2f);
@@ -1048,46 +629,25 @@ void CCodeEditor::Render()
 						drawList->AddLine(p2, p3, 0x90909090);
 						drawList->AddLine(p2, p4, 0x90909090);
 					}
-				}
-				else if (glyph.mChar == ' ')
-				{
-					if (mShowWhitespaces)
+					else if (ch == ' ')
 					{
-						const auto s = ImGui::GetFontSize();
-						const auto x = textScreenPos.x + bufferOffset.x + spaceSize * 0.5f;
-						const auto y = textScreenPos.y + bufferOffset.y + s * 0.5f;
+						const auto x = textScreenPos.x + offsets[i] + spaceSize * 0.5f;
 						drawList->AddCircleFilled(ImVec2(x, y), 1.5f, 0x80808080, 4);
 					}
-					bufferOffset.x += spaceSize;
-					i++;
-				}
-				else
-				{
-					auto l = UTF8CharLength(glyph.mChar);
-					while (l-- > 0)
-						mLineBuffer.push_back(line[i++].mChar);
 				}
-				++columnNo;
-			}
-
-			if (!mLineBuffer.empty())
-			{
-				const ImVec2 newOffset(textScreenPos.x + bufferOffset.x, textScreenPos.y + bufferOffset.y);
-				drawList->AddText(newOffset, prevColor, mLineBuffer.c_str());
-				mLineBuffer.clear();
 			}
 
-			++lineNo;
+			++rowNo;
 		}
 
 		// Draw a tooltip on known identifiers/preprocessor symbols
 		if (ImGui::IsMousePosValid())
 		{
-			auto id = GetWordAt(ScreenPosToCoordinates(ImGui::GetMousePos()));
+			auto id = mDocument.GetWordAt(ScreenPosToCoordinates(ImGui::GetMousePos()));
 			if (!id.empty())
 			{
-				auto it = mLanguageDefinition.mIdentifiers.find(id);
-				if (it != mLanguageDefinition.mIdentifiers.end())
+				auto it = mDocument.mLanguageDefinition.mIdentifiers.find(id);
+				if (it != mDocument.mLanguageDefinition.mIdentifiers.end())
 				{
 					ImGui::BeginTooltip();
 					ImGui::TextUnformatted(it->second.mDeclaration.c_str());
@@ -1095,2066 +655,547 @@ void CCodeEditor::Render()
 				}
 				else
 				{
-					auto pi = mLanguageDefinition.mPreprocIdentifiers.find(id);
-					if (pi != mLanguageDefinition.mPreprocIdentifiers.end())
+					auto pi = mDocument.mLanguageDefinition.mPreprocIdentifiers.find(id);
+					if (pi != mDocument.mLanguageDefinition.mPreprocIdentifiers.end())
 					{
 						ImGui::BeginTooltip();
 						ImGui::TextUnformatted(pi->second.mDeclaration.c_str());
 						ImGui::EndTooltip();
 					}
 				}
-			}
-		}
-	}
-
-
-	ImGui::Dummy(ImVec2((longest + 2), mLines.size() * mCharAdvance.y));
-
-	if (mScrollToCursor)
-	{
-		EnsureCursorVisible();
-		ImGui::SetWindowFocus();
-		mScrollToCursor = false;
-	}
-}
-
-void CCodeEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
-{
-	mWithinRender = true;
-	mTextChanged = false;
-	mCursorPositionChanged = false;
-
-	ImGui::PushStyleColor(ImGuiCol_ChildBg, ImGui::ColorConvertU32ToFloat4(mPalette[(int)PaletteIndex::Background]));
-	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 0.0f));
-	if (!mIgnoreImGuiChild)
-		ImGui::BeginChild(aTitle, aSize, aBorder, ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_AlwaysHorizontalScrollbar | ImGuiWindowFlags_NoMove);
-
-	if (mHandleKeyboardInputs)
-	{
-		HandleKeyboardInputs();
-		ImGui::PushAllowKeyboardFocus(true);
-	}
-
-	if (mHandleMouseInputs)
-		HandleMouseInputs();
-
-	ColorizeInternal();
-	Render();
-
-	if (mHandleKeyboardInputs)
-		ImGui::PopAllowKeyboardFocus();
-
-	if (!mIgnoreImGuiChild)
-		ImGui::EndChild();
-
-	ImGui::PopStyleVar();
-	ImGui::PopStyleColor();
-
-	mWithinRender = false;
-}
-
-void CCodeEditor::SetText(const std::string & aText)
-{
-	mLines.clear();
-	mLines.emplace_back(Line());
-	for (auto chr : aText)
-	{
-		if (chr == '\r')
-		{
-			// ignore the carriage return character
-		}
-		else if (chr == '\n')
-			mLines.emplace_back(Line());
-		else
-		{
-			mLines.back().emplace_back(Glyph(chr, PaletteIndex::Default));
-		}
-	}
-
-	mTextChanged = true;
-	mScrollToTop = true;
-
-	mUndoBuffer.clear();
-	mUndoIndex = 0;
-
-	Colorize();
-}
-
-void CCodeEditor::SetTextLines(const std::vector<std::string> & aLines)
-{
-	mLines.clear();
-
-	if (aLines.empty())
-	{
-		mLines.emplace_back(Line());
-	}
-	else
-	{
-		mLines.resize(aLines.size());
-
-		for (size_t i = 0; i < aLines.size(); ++i)
-		{
-			const std::string & aLine = aLines[i];
-
-			mLines[i].reserve(aLine.size());
-			for (size_t j = 0; j < aLine.size(); ++j)
-				mLines[i].emplace_back(Glyph(aLine[j], PaletteIndex::Default));
-		}
-	}
-
-	mTextChanged = true;
-	mScrollToTop = true;
-
-	mUndoBuffer.clear();
-	mUndoIndex = 0;
-
-	Colorize();
-}
-
-void CCodeEditor::EnterCharacter(ImWchar aChar, bool aShift)
-{
-	assert(!mReadOnly);
-
-	UndoRecord u;
-
-	u.mBefore = mState;
-
-	if (HasSelection())
-	{
-		if (aChar == '\t' && mState.mSelectionStart.mLine != mState.mSelectionEnd.mLine)
-		{
-
-			auto start = mState.mSelectionStart;
-			auto end = mState.mSelectionEnd;
-			auto originalEnd = end;
-
-			if (start > end)
-				std::swap(start, end);
-			start.mColumn = 0;
-			//			end.mColumn = end.mLine < mLines.size() ? mLines[end.mLine].size() : 0;
-			if (end.mColumn == 0 && end.mLine > 0)
-				--end.mLine;
-			if (end.mLine >= (int)mLines.size())
-				end.mLine = mLines.empty() ? 0 : (int)mLines.size() - 1;
-			end.mColumn = GetLineMaxColumn(end.mLine);
-
-			//if (end.mColumn >= GetLineMaxColumn(end.mLine))
-			//	end.mColumn = GetLineMaxColumn(end.mLine) - 1;
-
-			u.mRemovedStart = start;
-			u.mRemovedEnd = end;
-			u.mRemoved = GetText(start, end);
-
-			bool modified = false;
-
-			for (int i = start.mLine; i <= end.mLine; i++)
-			{
-				auto& line = mLines[i];
-				if (aShift)
-				{
-					if (!line.empty())
-					{
-						if (line.front().mChar == '\t')
-						{
-							line.erase(line.begin());
-							modified = true;
-						}
-						else
-						{
-							for (int j = 0; j < mTabSize && !line.empty() && line.front().mChar == ' '; j++)
-							{
-								line.erase(line.begin());
-								modified = true;
-							}
-						}
-					}
-				}
-				else
-				{
-					line.insert(line.begin(), Glyph('\t', CCodeEditor::PaletteIndex::Background));
-					modified = true;
-				}
-			}
-
-			if (modified)
-			{
-				start = Coordinates(start.mLine, GetCharacterColumn(start.mLine, 0));
-				Coordinates rangeEnd;
-				if (originalEnd.mColumn != 0)
-				{
-					end = Coordinates(end.mLine, GetLineMaxColumn(end.mLine));
-					rangeEnd = end;
-					u.mAdded = GetText(start, end);
-				}
-				else
-				{
-					end = Coordinates(originalEnd.mLine, 0);
-					rangeEnd = Coordinates(end.mLine - 1, GetLineMaxColumn(end.mLine - 1));
-					u.mAdded = GetText(start, rangeEnd);
-				}
-
-				u.mAddedStart = start;
-				u.mAddedEnd = rangeEnd;
-				u.mAfter = mState;
-
-				mState.mSelectionStart = start;
-				mState.mSelectionEnd = end;
-				AddUndo(u);
-
-				mTextChanged = true;
-
-				EnsureCursorVisible();
-			}
-
-			return;
-		} // c == '\t'
-		else
-		{
-			u.mRemoved = GetSelectedText();
-			u.mRemovedStart = mState.mSelectionStart;
-			u.mRemovedEnd = mState.mSelectionEnd;
-			DeleteSelection();
-		}
-	} // HasSelection
-
-	auto coord = GetActualCursorCoordinates();
-	u.mAddedStart = coord;
-
-	assert(!mLines.empty());
-
-	if (aChar == '\n')
-	{
-		InsertLine(coord.mLine + 1);
-		auto& line = mLines[coord.mLine];
-		auto& newLine = mLines[coord.mLine + 1];
-
-		if (mLanguageDefinition.mAutoIndentation)
-			for (size_t it = 0; it < line.size() && isascii(line[it].mChar) && isblank(line[it].mChar); ++it)
-				newLine.push_back(line[it]);
-
-		const size_t whitespaceSize = newLine.size();
-		auto cindex = GetCharacterIndex(coord);
-		newLine.insert(newLine.end(), line.begin() + cindex, line.end());
-		line.erase(line.begin() + cindex, line.begin() + line.size());
-		SetCursorPosition(Coordinates(coord.mLine + 1, GetCharacterColumn(coord.mLine + 1, (int)whitespaceSize)));
-		u.mAdded = (char)aChar;
-	}
-	else
-	{
-		char buf[7];
-		int e = ImTextCharToUtf8(buf, 7, aChar);
-		if (e > 0)
-		{
-			buf[e] = '\0';
-			auto& line = mLines[coord.mLine];
-			auto cindex = GetCharacterIndex(coord);
-
-			if (mOverwrite && cindex < (int)line.size())
-			{
-				auto d = UTF8CharLength(line[cindex].mChar);
-
-				u.mRemovedStart = mState.mCursorPosition;
-				u.mRemovedEnd = Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex + d));
-
-				while (d-- > 0 && cindex < (int)line.size())
-				{
-					u.mRemoved += line[cindex].mChar;
-					line.erase(line.begin() + cindex);
-				}
-			}
-
-			for (auto p = buf; *p != '\0'; p++, ++cindex)
-				line.insert(line.begin() + cindex, Glyph(*p, PaletteIndex::Default));
-			u.mAdded = buf;
-
-			SetCursorPosition(Coordinates(coord.mLine, GetCharacterColumn(coord.mLine, cindex)));
-		}
-		else
-			return;
-	}
-
-	mTextChanged = true;
-
-	u.mAddedEnd = GetActualCursorCoordinates();
-	u.mAfter = mState;
-
-	AddUndo(u);
-
-	Colorize(coord.mLine - 1, 3);
-	EnsureCursorVisible();
-}
-
-void CCodeEditor::SetReadOnly(bool aValue)
-{
-	mReadOnly = aValue;
-}
-
-void CCodeEditor::SetColorizerEnable(bool aValue)
-{
-	mColorizerEnabled = aValue;
-}
-
-void CCodeEditor::SetCursorPosition(const Coordinates & aPosition)
-{
-	if (mState.mCursorPosition != aPosition)
-	{
-		mState.mCursorPosition = aPosition;
-		mCursorPositionChanged = true;
-		EnsureCursorVisible();
-	}
-}
-
-void CCodeEditor::SetSelectionStart(const Coordinates & aPosition)
-{
-	mState.mSelectionStart = SanitizeCoordinates(aPosition);
-	if (mState.mSelectionStart > mState.mSelectionEnd)
-		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
-}
-
-void CCodeEditor::SetSelectionEnd(const Coordinates & aPosition)
-{
-	mState.mSelectionEnd = SanitizeCoordinates(aPosition);
-	if (mState.mSelectionStart > mState.mSelectionEnd)
-		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
-}
-
-void CCodeEditor::SetSelection(const Coordinates & aStart, const Coordinates & aEnd, SelectionMode aMode)
-{
-	auto oldSelStart = mState.mSelectionStart;
-	auto oldSelEnd = mState.mSelectionEnd;
-
-	mState.mSelectionStart = SanitizeCoordinates(aStart);
-	mState.mSelectionEnd = SanitizeCoordinates(aEnd);
-	if (mState.mSelectionStart > mState.mSelectionEnd)
-		std::swap(mState.mSelectionStart, mState.mSelectionEnd);
-
-	switch (aMode)
-	{
-	case CCodeEditor::SelectionMode::Normal:
-		break;
-	case CCodeEditor::SelectionMode::Word:
-	{
-		mState.mSelectionStart = FindWordStart(mState.mSelectionStart);
-		if (!IsOnWordBoundary(mState.mSelectionEnd))
-			mState.mSelectionEnd = FindWordEnd(FindWordStart(mState.mSelectionEnd));
-		break;
-	}
-	case CCodeEditor::SelectionMode::Line:
-	{
-		const auto lineNo = mState.mSelectionEnd.mLine;
-		const auto lineSize = (size_t)lineNo < mLines.size() ? mLines[lineNo].size() : 0;
-		mState.mSelectionStart = Coordinates(mState.mSelectionStart.mLine, 0);
-		mState.mSelectionEnd = Coordinates(lineNo, GetLineMaxColumn(lineNo));
-		break;
-	}
-	default:
-		break;
-	}
-
-	if (mState.mSelectionStart != oldSelStart ||
-		mState.mSelectionEnd != oldSelEnd)
-		mCursorPositionChanged = true;
-}
-
-void CCodeEditor::SetTabSize(int aValue)
-{
-	mTabSize = std::max(0, std::min(32, aValue));
-}
-
-void CCodeEditor::InsertText(const std::string & aValue)
-{
-	InsertText(aValue.c_str());
-}
-
-void CCodeEditor::InsertText(const char * aValue)
-{
-	if (aValue == nullptr)
-		return;
-
-	auto pos = GetActualCursorCoordinates();
-	auto start = std::min(pos, mState.mSelectionStart);
-	int totalLines = pos.mLine - start.mLine;
-
-	totalLines += InsertTextAt(pos, aValue);
-
-	SetSelection(pos, pos);
-	SetCursorPosition(pos);
-	Colorize(start.mLine - 1, totalLines + 2);
-}
-
-void CCodeEditor::DeleteSelection()
-{
-	assert(mState.mSelectionEnd >= mState.mSelectionStart);
-
-	if (mState.mSelectionEnd == mState.mSelectionStart)
-		return;
-
-	DeleteRange(mState.mSelectionStart, mState.mSelectionEnd);
-
-	SetSelection(mState.mSelectionStart, mState.mSelectionStart);
-	SetCursorPosition(mState.mSelectionStart);
-	Colorize(mState.mSelectionStart.mLine, 1);
-}
-
-void CCodeEditor::MoveUp(int aAmount, bool aSelect)
-{
-	auto oldPos = mState.mCursorPosition;
-	mState.mCursorPosition.mLine = std::max(0, mState.mCursorPosition.mLine - aAmount);
-	if (oldPos != mState.mCursorPosition)
-	{
-		if (aSelect)
-		{
-			if (oldPos == mInteractiveStart)
-				mInteractiveStart = mState.mCursorPosition;
-			else if (oldPos == mInteractiveEnd)
-				mInteractiveEnd = mState.mCursorPosition;
-			else
-			{
-				mInteractiveStart = mState.mCursorPosition;
-				mInteractiveEnd = oldPos;
-			}
-		}
-		else
-			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-		SetSelection(mInteractiveStart, mInteractiveEnd);
-
-		EnsureCursorVisible();
-	}
-}
-
-void CCodeEditor::MoveDown(int aAmount, bool aSelect)
-{
-	assert(mState.mCursorPosition.mColumn >= 0);
-	auto oldPos = mState.mCursorPosition;
-	mState.mCursorPosition.mLine = std::max(0, std::min((int)mLines.size() - 1, mState.mCursorPosition.mLine + aAmount));
-
-	if (mState.mCursorPosition != oldPos)
-	{
-		if (aSelect)
-		{
-			if (oldPos == mInteractiveEnd)
-				mInteractiveEnd = mState.mCursorPosition;
-			else if (oldPos == mInteractiveStart)
-				mInteractiveStart = mState.mCursorPosition;
-			else
-			{
-				mInteractiveStart = oldPos;
-				mInteractiveEnd = mState.mCursorPosition;
-			}
-		}
-		else
-			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-		SetSelection(mInteractiveStart, mInteractiveEnd);
-
-		EnsureCursorVisible();
-	}
-}
-
-static bool IsUTFSequence(char c)
-{
-	return (c & 0xC0) == 0x80;
-}
-
-void CCodeEditor::MoveLeft(int aAmount, bool aSelect, bool aWordMode)
-{
-	if (mLines.empty())
-		return;
-
-	auto oldPos = mState.mCursorPosition;
-	mState.mCursorPosition = GetActualCursorCoordinates();
-	auto line = mState.mCursorPosition.mLine;
-	auto cindex = GetCharacterIndex(mState.mCursorPosition);
-
-	while (aAmount-- > 0)
-	{
-		if (cindex == 0)
-		{
-			if (line > 0)
-			{
-				--line;
-				if ((int)mLines.size() > line)
-					cindex = (int)mLines[line].size();
-				else
-					cindex = 0;
-			}
-		}
-		else
-		{
-			--cindex;
-			if (cindex > 0)
-			{
-				if ((int)mLines.size() > line)
-				{
-					while (cindex > 0 && IsUTFSequence(mLines[line][cindex].mChar))
-						--cindex;
-				}
-			}
-		}
-
-		mState.mCursorPosition = Coordinates(line, GetCharacterColumn(line, cindex));
-		if (aWordMode)
-		{
-			mState.mCursorPosition = FindWordStart(mState.mCursorPosition);
-			cindex = GetCharacterIndex(mState.mCursorPosition);
-		}
-	}
-
-	mState.mCursorPosition = Coordinates(line, GetCharacterColumn(line, cindex));
-
-	assert(mState.mCursorPosition.mColumn >= 0);
-	if (aSelect)
-	{
-		if (oldPos == mInteractiveStart)
-			mInteractiveStart = mState.mCursorPosition;
-		else if (oldPos == mInteractiveEnd)
-			mInteractiveEnd = mState.mCursorPosition;
-		else
-		{
-			mInteractiveStart = mState.mCursorPosition;
-			mInteractiveEnd = oldPos;
-		}
-	}
-	else
-		mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-	SetSelection(mInteractiveStart, mInteractiveEnd, aSelect && aWordMode ? SelectionMode::Word : SelectionMode::Normal);
-
-	EnsureCursorVisible();
-}
-
-void CCodeEditor::MoveRight(int aAmount, bool aSelect, bool aWordMode)
-{
-	auto oldPos = mState.mCursorPosition;
-
-	if (mLines.empty() || oldPos.mLine >= mLines.size())
-		return;
-
-	auto cindex = GetCharacterIndex(mState.mCursorPosition);
-	while (aAmount-- > 0)
-	{
-		auto lindex = mState.mCursorPosition.mLine;
-		auto& line = mLines[lindex];
-
-		if (cindex >= line.size())
-		{
-			if (mState.mCursorPosition.mLine < mLines.size() - 1)
-			{
-				mState.mCursorPosition.mLine = std::max(0, std::min((int)mLines.size() - 1, mState.mCursorPosition.mLine + 1));
-				mState.mCursorPosition.mColumn = 0;
-			}
-			else
-				return;
-		}
-		else
-		{
-			cindex += UTF8CharLength(line[cindex].mChar);
-			mState.mCursorPosition = Coordinates(lindex, GetCharacterColumn(lindex, cindex));
-			if (aWordMode)
-				mState.mCursorPosition = FindNextWord(mState.mCursorPosition);
-		}
-	}
-
-	if (aSelect)
-	{
-		if (oldPos == mInteractiveEnd)
-			mInteractiveEnd = SanitizeCoordinates(mState.mCursorPosition);
-		else if (oldPos == mInteractiveStart)
-			mInteractiveStart = mState.mCursorPosition;
-		else
-		{
-			mInteractiveStart = oldPos;
-			mInteractiveEnd = mState.mCursorPosition;
-		}
-	}
-	else
-		mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-	SetSelection(mInteractiveStart, mInteractiveEnd, aSelect && aWordMode ? SelectionMode::Word : SelectionMode::Normal);
-
-	EnsureCursorVisible();
-}
-
-void CCodeEditor::MoveTop(bool aSelect)
-{
-	auto oldPos = mState.mCursorPosition;
-	SetCursorPosition(Coordinates(0, 0));
-
-	if (mState.mCursorPosition != oldPos)
-	{
-		if (aSelect)
-		{
-			mInteractiveEnd = oldPos;
-			mInteractiveStart = mState.mCursorPosition;
-		}
-		else
-			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-		SetSelection(mInteractiveStart, mInteractiveEnd);
-	}
-}
-
-void CCodeEditor::CCodeEditor::MoveBottom(bool aSelect)
-{
-	auto oldPos = GetCursorPosition();
-	auto newPos = Coordinates((int)mLines.size() - 1, 0);
-	SetCursorPosition(newPos);
-	if (aSelect)
-	{
-		mInteractiveStart = oldPos;
-		mInteractiveEnd = newPos;
-	}
-	else
-		mInteractiveStart = mInteractiveEnd = newPos;
-	SetSelection(mInteractiveStart, mInteractiveEnd);
-}
-
-void CCodeEditor::MoveHome(bool aSelect)
-{
-	auto oldPos = mState.mCursorPosition;
-	SetCursorPosition(Coordinates(mState.mCursorPosition.mLine, 0));
-
-	if (mState.mCursorPosition != oldPos)
-	{
-		if (aSelect)
-		{
-			if (oldPos == mInteractiveStart)
-				mInteractiveStart = mState.mCursorPosition;
-			else if (oldPos == mInteractiveEnd)
-				mInteractiveEnd = mState.mCursorPosition;
-			else
-			{
-				mInteractiveStart = mState.mCursorPosition;
-				mInteractiveEnd = oldPos;
-			}
-		}
-		else
-			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-		SetSelection(mInteractiveStart, mInteractiveEnd);
-	}
-}
-
-void CCodeEditor::MoveEnd(bool aSelect)
-{
-	auto oldPos = mState.mCursorPosition;
-	SetCursorPosition(Coordinates(mState.mCursorPosition.mLine, GetLineMaxColumn(oldPos.mLine)));
-
-	if (mState.mCursorPosition != oldPos)
-	{
-		if (aSelect)
-		{
-			if (oldPos == mInteractiveEnd)
-				mInteractiveEnd = mState.mCursorPosition;
-			else if (oldPos == mInteractiveStart)
-				mInteractiveStart = mState.mCursorPosition;
-			else
-			{
-				mInteractiveStart = oldPos;
-				mInteractiveEnd = mState.mCursorPosition;
-			}
-		}
-		else
-			mInteractiveStart = mInteractiveEnd = mState.mCursorPosition;
-		SetSelection(mInteractiveStart, mInteractiveEnd);
-	}
-}
-
-void CCodeEditor::Delete()
-{
-	assert(!mReadOnly);
-
-	if (mLines.empty())
-		return;
-
-	UndoRecord u;
-	u.mBefore = mState;
-
-	if (HasSelection())
-	{
-		u.mRemoved = GetSelectedText();
-		u.mRemovedStart = mState.mSelectionStart;
-		u.mRemovedEnd = mState.mSelectionEnd;
-
-		DeleteSelection();
-	}
-	else
-	{
-		auto pos = GetActualCursorCoordinates();
-		SetCursorPosition(pos);
-		auto& line = mLines[pos.mLine];
-
-		if (pos.mColumn == GetLineMaxColumn(pos.mLine))
-		{
-			if (pos.mLine == (int)mLines.size() - 1)
-				return;
-
-			u.mRemoved = '\n';
-			u.mRemovedStart = u.mRemovedEnd = GetActualCursorCoordinates();
-			Advance(u.mRemovedEnd);
-
-			auto& nextLine = mLines[pos.mLine + 1];
-			line.insert(line.end(), nextLine.begin(), nextLine.end());
-			RemoveLine(pos.mLine + 1);
-		}
-		else
-		{
-			auto cindex = GetCharacterIndex(pos);
-			u.mRemovedStart = u.mRemovedEnd = GetActualCursorCoordinates();
-			u.mRemovedEnd.mColumn++;
-			u.mRemoved = GetText(u.mRemovedStart, u.mRemovedEnd);
-
-			auto d = UTF8CharLength(line[cindex].mChar);
-			while (d-- > 0 && cindex < (int)line.size())
-				line.erase(line.begin() + cindex);
-		}
-
-		mTextChanged = true;
-
-		Colorize(pos.mLine, 1);
-	}
-
-	u.mAfter = mState;
-	AddUndo(u);
-}
-
-void CCodeEditor::Backspace()
-{
-	assert(!mReadOnly);
-
-	if (mLines.empty())
-		return;
-
-	UndoRecord u;
-	u.mBefore = mState;
-
-	if (HasSelection())
-	{
-		u.mRemoved = GetSelectedText();
-		u.mRemovedStart = mState.mSelectionStart;
-		u.mRemovedEnd = mState.mSelectionEnd;
-
-		DeleteSelection();
-	}
-	else
-	{
-		auto pos = GetActualCursorCoordinates();
-		SetCursorPosition(pos);
-
-		if (mState.mCursorPosition.mColumn == 0)
-		{
-			if (mState.mCursorPosition.mLine == 0)
-				return;
-
-			u.mRemoved = '\n';
-			u.mRemovedStart = u.mRemovedEnd = Coordinates(pos.mLine - 1, GetLineMaxColumn(pos.mLine - 1));
-			Advance(u.mRemovedEnd);
-
-			auto& line = mLines[mState.mCursorPosition.mLine];
-			auto& prevLine = mLines[mState.mCursorPosition.mLine - 1];
-			auto prevSize = GetLineMaxColumn(mState.mCursorPosition.mLine - 1);
-			prevLine.insert(prevLine.end(), line.begin(), line.end());
-
-			ErrorMarkers etmp;
-			for (auto& i : mErrorMarkers)
-				etmp.insert(ErrorMarkers::value_type(i.first - 1 == mState.mCursorPosition.mLine ? i.first - 1 : i.first, i.second));
-			mErrorMarkers = std::move(etmp);
-
-			RemoveLine(mState.mCursorPosition.mLine);
-			--mState.mCursorPosition.mLine;
-			mState.mCursorPosition.mColumn = prevSize;
-		}
-		else
-		{
-			auto& line = mLines[mState.mCursorPosition.mLine];
-			auto cindex = GetCharacterIndex(pos) - 1;
-			auto cend = cindex + 1;
-			while (cindex > 0 && IsUTFSequence(line[cindex].mChar))
-				--cindex;
-
-			//if (cindex > 0 && UTF8CharLength(line[cindex].mChar) > 1)
-			//	--cindex;
-
-			u.mRemovedStart = u.mRemovedEnd = GetActualCursorCoordinates();
-			--u.mRemovedStart.mColumn;
-			--mState.mCursorPosition.mColumn;
-
-			while (cindex < line.size() && cend-- > cindex)
-			{
-				u.mRemoved += line[cindex].mChar;
-				line.erase(line.begin() + cindex);
-			}
-		}
-
-		mTextChanged = true;
-
-		EnsureCursorVisible();
-		Colorize(mState.mCursorPosition.mLine, 1);
-	}
-
-	u.mAfter = mState;
-	AddUndo(u);
-}
-
-void CCodeEditor::SelectWordUnderCursor()
-{
-	auto c = GetCursorPosition();
-	SetSelection(FindWordStart(c), FindWordEnd(c));
-}
-
-void CCodeEditor::SelectAll()
-{
-	SetSelection(Coordinates(0, 0), Coordinates((int)mLines.size(), 0));
-}
-
-bool CCodeEditor::HasSelection() const
-{
-	return mState.mSelectionEnd > mState.mSelectionStart;
-}
-
-void CCodeEditor::Copy()
-{
-	if (HasSelection())
-	{
-		ImGui::SetClipboardText(GetSelectedText().c_str());
-	}
-	else
-	{
-		if (!mLines.empty())
-		{
-			std::string str;
-			auto& line = mLines[GetActualCursorCoordinates().mLine];
-			for (auto& g : line)
-				str.push_back(g.mChar);
-			ImGui::SetClipboardText(str.c_str());
-		}
-	}
-}
-
-void CCodeEditor::Cut()
-{
-	if (IsReadOnly())
-	{
-		Copy();
-	}
-	else
-	{
-		if (HasSelection())
-		{
-			UndoRecord u;
-			u.mBefore = mState;
-			u.mRemoved = GetSelectedText();
-			u.mRemovedStart = mState.mSelectionStart;
-			u.mRemovedEnd = mState.mSelectionEnd;
-
-			Copy();
-			DeleteSelection();
-
-			u.mAfter = mState;
-			AddUndo(u);
-		}
-	}
-}
-
-void CCodeEditor::Paste()
-{
-	if (IsReadOnly())
-		return;
-
-	auto clipText = ImGui::GetClipboardText();
-	if (clipText != nullptr && strlen(clipText) > 0)
-	{
-		UndoRecord u;
-		u.mBefore = mState;
-
-		if (HasSelection())
-		{
-			u.mRemoved = GetSelectedText();
-			u.mRemovedStart = mState.mSelectionStart;
-			u.mRemovedEnd = mState.mSelectionEnd;
-			DeleteSelection();
-		}
-
-		u.mAdded = clipText;
-		u.mAddedStart = GetActualCursorCoordinates();
-
-		InsertText(clipText);
-
-		u.mAddedEnd = GetActualCursorCoordinates();
-		u.mAfter = mState;
-		AddUndo(u);
-	}
-}
-
-bool CCodeEditor::CanUndo() const
-{
-	return !mReadOnly && mUndoIndex > 0;
-}
-
-bool CCodeEditor::CanRedo() const
-{
-	return !mReadOnly && mUndoIndex < (int)mUndoBuffer.size();
-}
-
-void CCodeEditor::Undo(int aSteps)
-{
-	while (CanUndo() && aSteps-- > 0)
-		mUndoBuffer[--mUndoIndex].Undo(this);
-}
-
-void CCodeEditor::Redo(int aSteps)
-{
-	while (CanRedo() && aSteps-- > 0)
-		mUndoBuffer[mUndoIndex++].Redo(this);
-}
-
-const CCodeEditor::Palette & CCodeEditor::GetDarkPalette()
-{
-	const static Palette p = { {
-			0xff7f7f7f,	// Default
-			0xffd69c56,	// Keyword	
-			0xff00ff00,	// Number
-			0xff7070e0,	// String
-			0xff70a0e0, // Char literal
-			0xffffffff, // Punctuation
-			0xff408080,	// Preprocessor
-			0xffaaaaaa, // Identifier
-			0xff9bc64d, // Known identifier
-			0xffc040a0, // Preproc identifier
-			0xff206020, // Comment (single line)
-			0xff406020, // Comment (multi line)
-			0xff101010, // Background
-			0xffe0e0e0, // Cursor
-			0x80a06020, // Selection
-			0x800020ff, // ErrorMarker
-			0x40f08000, // Breakpoint
-			0xff707000, // Line number
-			0x40000000, // Current line fill
-			0x40808080, // Current line fill (inactive)
-			0x40a0a0a0, // Current line edge
-		} };
-	return p;
-}
-
-const CCodeEditor::Palette & CCodeEditor::GetLightPalette()
-{
-	const static Palette p = { {
-			0xff7f7f7f,	// None
-			0xffff0c06,	// Keyword	
-			0xff008000,	// Number
-			0xff2020a0,	// String
-			0xff304070, // Char literal
-			0xff000000, // Punctuation
-			0xff406060,	// Preprocessor
-			0xff404040, // Identifier
-			0xff606010, // Known identifier
-			0xffc040a0, // Preproc identifier
-			0xff205020, // Comment (single line)
-			0xff405020, // Comment (multi line)
-			0xffffffff, // Background
-			0xff000000, // Cursor
-			0x80600000, // Selection
-			0xa00010ff, // ErrorMarker
-			0x80f08000, // Breakpoint
-			0xff505000, // Line number
-			0x40000000, // Current line fill
-			0x40808080, // Current line fill (inactive)
-			0x40000000, // Current line edge
-		} };
-	return p;
-}
-
-const CCodeEditor::Palette & CCodeEditor::GetRetroBluePalette()
-{
-	const static Palette p = { {
-			0xff00ffff,	// None
-			0xffffff00,	// Keyword	
-			0xff00ff00,	// Number
-			0xff808000,	// String
-			0xff808000, // Char literal
-			0xffffffff, // Punctuation
-			0xff008000,	// Preprocessor
-			0xff00ffff, // Identifier
-			0xffffffff, // Known identifier
-			0xffff00ff, // Preproc identifier
-			0xff808080, // Comment (single line)
-			0xff404040, // Comment (multi line)
-			0xff800000, // Background
-			0xff0080ff, // Cursor
-			0x80ffff00, // Selection
-			0xa00000ff, // ErrorMarker
-			0x80ff8000, // Breakpoint
-			0xff808000, // Line number
-			0x40000000, // Current line fill
-			0x40808080, // Current line fill (inactive)
-			0x40000000, // Current line edge
-		} };
-	return p;
-}
-
-
-std::string CCodeEditor::GetText() const
-{
-	return GetText(Coordinates(), Coordinates((int)mLines.size(), 0));
-}
-
-std::vector<std::string> CCodeEditor::GetTextLines() const
-{
-	std::vector<std::string> result;
-
-	result.reserve(mLines.size());
-
-	for (auto & line : mLines)
-	{
-		std::string text;
-
-		text.resize(line.size());
-
-		for (size_t i = 0; i < line.size(); ++i)
-			text[i] = line[i].mChar;
-
-		result.emplace_back(std::move(text));
-	}
-
-	return result;
-}
-
-std::string CCodeEditor::GetSelectedText() const
-{
-	return GetText(mState.mSelectionStart, mState.mSelectionEnd);
-}
-
-std::string CCodeEditor::GetCurrentLineText()const
-{
-	auto lineLength = GetLineMaxColumn(mState.mCursorPosition.mLine);
-	return GetText(
-		Coordinates(mState.mCursorPosition.mLine, 0),
-		Coordinates(mState.mCursorPosition.mLine, lineLength));
-}
-
-void CCodeEditor::ProcessInputs()
-{
-}
-
-void CCodeEditor::Colorize(int aFromLine, int aLines)
-{
-	int toLine = aLines == -1 ? (int)mLines.size() : std::min((int)mLines.size(), aFromLine + aLines);
-	mColorRangeMin = std::min(mColorRangeMin, aFromLine);
-	mColorRangeMax = std::max(mColorRangeMax, toLine);
-	mColorRangeMin = std::max(0, mColorRangeMin);
-	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
-	mCheckComments = true;
-}
-
-void CCodeEditor::ColorizeRange(int aFromLine, int aToLine)
-{
-	if (mLines.empty() || aFromLine >= aToLine)
-		return;
-
-	std::string buffer;
-	std::cmatch results;
-	std::string id;
-
-	int endLine = std::max(0, std::min((int)mLines.size(), aToLine));
-	for (int i = aFromLine; i < endLine; ++i)
-	{
-		auto& line = mLines[i];
-
-		if (line.empty())
-			continue;
-
-		buffer.resize(line.size());
-		for (size_t j = 0; j < line.size(); ++j)
-		{
-			auto& col = line[j];
-			buffer[j] = col.mChar;
-			col.mColorIndex = PaletteIndex::Default;
-		}
-
-		const char * bufferBegin = &buffer.front();
-		const char * bufferEnd = bufferBegin + buffer.size();
-
-		auto last = bufferEnd;
-
-		for (auto first = bufferBegin; first != last; )
-		{
-			const char * token_begin = nullptr;
-			const char * token_end = nullptr;
-			PaletteIndex token_color = PaletteIndex::Default;
-
-			bool hasTokenizeResult = false;
-
-			if (mLanguageDefinition.mTokenize != nullptr)
-			{
-				if (mLanguageDefinition.mTokenize(first, last, token_begin, token_end, token_color))
-					hasTokenizeResult = true;
-			}
-
-			if (hasTokenizeResult == false)
-			{
-				// todo : remove
-				//printf("using regex for %.*s\n", first + 10 < last ? 10 : int(last - first), first);
-
-				for (auto& p : mRegexList)
-				{
-					if (std::regex_search(first, last, results, p.first, std::regex_constants::match_continuous))
-					{
-						hasTokenizeResult = true;
-
-						auto& v = *results.begin();
-						token_begin = v.first;
-						token_end = v.second;
-						token_color = p.second;
-						break;
-					}
-				}
-			}
-
-			if (hasTokenizeResult == false)
-			{
-				first++;
-			}
-			else
-			{
-				const size_t token_length = token_end - token_begin;
-
-				if (token_color == PaletteIndex::Identifier)
-				{
-					id.assign(token_begin, token_end);
-
-					// todo : allmost all language definitions use lower case to specify keywords, so shouldn't this use ::tolower ?
-					if (!mLanguageDefinition.mCaseSensitive)
-						std::transform(id.begin(), id.end(), id.begin(), ::toupper);
-
-					if (!line[first - bufferBegin].mPreprocessor)
-					{
-						if (mLanguageDefinition.mKeywords.count(id) != 0)
-							token_color = PaletteIndex::Keyword;
-						else if (mLanguageDefinition.mIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::KnownIdentifier;
-						else if (mLanguageDefinition.mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-					}
-					else
-					{
-						if (mLanguageDefinition.mPreprocIdentifiers.count(id) != 0)
-							token_color = PaletteIndex::PreprocIdentifier;
-					}
-				}
-
-				for (size_t j = 0; j < token_length; ++j)
-					line[(token_begin - bufferBegin) + j].mColorIndex = token_color;
-
-				first = token_end;
-			}
-		}
-	}
-}
-
-void CCodeEditor::ColorizeInternal()
-{
-	if (mLines.empty() || !mColorizerEnabled)
-		return;
-
-	if (mCheckComments)
-	{
-		auto endLine = mLines.size();
-		auto endIndex = 0;
-		auto commentStartLine = endLine;
-		auto commentStartIndex = endIndex;
-		auto withinString = false;
-		auto withinSingleLineComment = false;
-		auto withinPreproc = false;
-		auto firstChar = true;			// there is no other non-whitespace characters in the line before
-		auto concatenate = false;		// '\' on the very end of the line
-		auto currentLine = 0;
-		auto currentIndex = 0;
-		while (currentLine < endLine || currentIndex < endIndex)
-		{
-			auto& line = mLines[currentLine];
-
-			if (currentIndex == 0 && !concatenate)
-			{
-				withinSingleLineComment = false;
-				withinPreproc = false;
-				firstChar = true;
-			}
-
-			concatenate = false;
-
-			if (!line.empty())
-			{
-				auto& g = line[currentIndex];
-				auto c = g.mChar;
-
-				if (c != mLanguageDefinition.mPreprocChar && !isspace(c))
-					firstChar = false;
-
-				if (currentIndex == (int)line.size() - 1 && line[line.size() - 1].mChar == '\\')
-					concatenate = true;
-
-				bool inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
-
-				if (withinString)
-				{
-					line[currentIndex].mMultiLineComment = inComment;
-
-					if (c == '\"')
-					{
-						if (currentIndex + 1 < (int)line.size() && line[currentIndex + 1].mChar == '\"')
-						{
-							currentIndex += 1;
-							if (currentIndex < (int)line.size())
-								line[currentIndex].mMultiLineComment = inComment;
-						}
-						else
-							withinString = false;
-					}
-					else if (c == '\\')
-					{
-						currentIndex += 1;
-						if (currentIndex < (int)line.size())
-							line[currentIndex].mMultiLineComment = inComment;
-					}
-				}
-				else
-				{
-					if (firstChar && c == mLanguageDefinition.mPreprocChar)
-						withinPreproc = true;
-
-					if (c == '\"')
-					{
-						withinString = true;
-						line[currentIndex].mMultiLineComment = inComment;
-					}
-					else
-					{
-						auto pred = [](const char& a, const Glyph& b) { return a == b.mChar; };
-						auto from = line.begin() + currentIndex;
-						auto& startStr = mLanguageDefinition.mCommentStart;
-						auto& singleStartStr = mLanguageDefinition.mSingleLineComment;
-
-						if (singleStartStr.size() > 0 &&
-							currentIndex + singleStartStr.size() <= line.size() &&
-							equals(singleStartStr.begin(), singleStartStr.end(), from, from + singleStartStr.size(), pred))
-						{
-							withinSingleLineComment = true;
-						}
-						else if (!withinSingleLineComment && currentIndex + startStr.size() <= line.size() &&
-							equals(startStr.begin(), startStr.end(), from, from + startStr.size(), pred))
-						{
-							commentStartLine = currentLine;
-							commentStartIndex = currentIndex;
-						}
-
-						inComment = inComment = (commentStartLine < currentLine || (commentStartLine == currentLine && commentStartIndex <= currentIndex));
-
-						line[currentIndex].mMultiLineComment = inComment;
-						line[currentIndex].mComment = withinSingleLineComment;
-
-						auto& endStr = mLanguageDefinition.mCommentEnd;
-						if (currentIndex + 1 >= (int)endStr.size() &&
-							equals(endStr.begin(), endStr.end(), from + 1 - endStr.size(), from + 1, pred))
-						{
-							commentStartIndex = endIndex;
-							commentStartLine = endLine;
-						}
-					}
-				}
-				line[currentIndex].mPreprocessor = withinPreproc;
-				currentIndex += UTF8CharLength(c);
-				if (currentIndex >= (int)line.size())
-				{
-					currentIndex = 0;
-					++currentLine;
-				}
-			}
-			else
-			{
-				currentIndex = 0;
-				++currentLine;
-			}
-		}
-		mCheckComments = false;
-	}
-
-	if (mColorRangeMin < mColorRangeMax)
-	{
-		const int increment = (mLanguageDefinition.mTokenize == nullptr) ? 10 : 10000;
-		const int to = std::min(mColorRangeMin + increment, mColorRangeMax);
-		ColorizeRange(mColorRangeMin, to);
-		mColorRangeMin = to;
-
-		if (mColorRangeMax == mColorRangeMin)
-		{
-			mColorRangeMin = std::numeric_limits<int>::max();
-			mColorRangeMax = 0;
-		}
-		return;
-	}
-}
-
-float CCodeEditor::TextDistanceToLineStart(const Coordinates& aFrom) const
-{
-	auto& line = mLines[aFrom.mLine];
-	float distance = 0.0f;
-	float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
-	int colIndex = GetCharacterIndex(aFrom);
-	for (size_t it = 0u; it < line.size() && it < colIndex; )
-	{
-		if (line[it].mChar == '\t')
-		{
-			distance = (1.0f + std::floor((1.0f + distance) / (float(mTabSize) * spaceSize))) * (float(mTabSize) * spaceSize);
-			++it;
-		}
-		else
-		{
-			auto d = UTF8CharLength(line[it].mChar);
-			char tempCString[7];
-			int i = 0;
-			for (; i < 6 && d-- > 0 && it < (int)line.size(); i++, it++)
-				tempCString[i] = line[it].mChar;
-
-			tempCString[i] = '\0';
-			distance += ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, tempCString, nullptr, nullptr).x;
-		}
-	}
-
-	return distance;
-}
-
-void CCodeEditor::EnsureCursorVisible()
-{
-	if (!mWithinRender)
-	{
-		mScrollToCursor = true;
-		return;
-	}
-
-	float scrollX = ImGui::GetScrollX();
-	float scrollY = ImGui::GetScrollY();
-
-	auto height = ImGui::GetWindowHeight();
-	auto width = ImGui::GetWindowWidth();
-
-	auto top = 1 + (int)ceil(scrollY / mCharAdvance.y);
-	auto bottom = (int)ceil((scrollY + height) / mCharAdvance.y);
-
-	auto left = (int)ceil(scrollX / mCharAdvance.x);
-	auto right = (int)ceil((scrollX + width) / mCharAdvance.x);
-
-	auto pos = GetActualCursorCoordinates();
-	auto len = TextDistanceToLineStart(pos);
-
-	if (pos.mLine < top)
-		ImGui::SetScrollY(std::max(0.0f, (pos.mLine - 1) * mCharAdvance.y));
-	if (pos.mLine > bottom - 4)
-		ImGui::SetScrollY(std::max(0.0f, (pos.mLine + 4) * mCharAdvance.y - height));
-	if (len + mTextStart < left + 4)
-		ImGui::SetScrollX(std::max(0.0f, len + mTextStart - 4));
-	if (len + mTextStart > right - 4)
-		ImGui::SetScrollX(std::max(0.0f, len + mTextStart + 4 - width));
-}
-
-int CCodeEditor::GetPageSize() const
-{
-	auto height = ImGui::GetWindowHeight() - 20.0f;
-	return (int)floor(height / mCharAdvance.y);
-}
-
-CCodeEditor::UndoRecord::UndoRecord(
-	const std::string& aAdded,
-	const CCodeEditor::Coordinates aAddedStart,
-	const CCodeEditor::Coordinates aAddedEnd,
-	const std::string& aRemoved,
-	const CCodeEditor::Coordinates aRemovedStart,
-	const CCodeEditor::Coordinates aRemovedEnd,
-	CCodeEditor::EditorState& aBefore,
-	CCodeEditor::EditorState& aAfter)
-	: mAdded(aAdded)
-	, mAddedStart(aAddedStart)
-	, mAddedEnd(aAddedEnd)
-	, mRemoved(aRemoved)
-	, mRemovedStart(aRemovedStart)
-	, mRemovedEnd(aRemovedEnd)
-	, mBefore(aBefore)
-	, mAfter(aAfter)
-{
-	assert(mAddedStart <= mAddedEnd);
-	assert(mRemovedStart <= mRemovedEnd);
-}
+			}
+		}
 
-void CCodeEditor::UndoRecord::Undo(CCodeEditor * aEditor)
-{
-	if (!mAdded.empty())
-	{
-		aEditor->DeleteRange(mAddedStart, mAddedEnd);
-		aEditor->Colorize(mAddedStart.mLine - 1, mAddedEnd.mLine - mAddedStart.mLine + 2);
-	}
+		// Draw the completion popup below the word being completed; it only
+		// shows the rows around the selected suggestion.
+		if (!mDocument.mCompletions.empty() && !ImGui::IsWindowFocused())
+			mDocument.mCompletions.clear();
 
-	if (!mRemoved.empty())
-	{
-		auto start = mRemovedStart;
-		aEditor->InsertTextAt(start, mRemoved.c_str());
-		aEditor->Colorize(mRemovedStart.mLine - 1, mRemovedEnd.mLine - mRemovedStart.mLine + 2);
-	}
+		if (!mDocument.mCompletions.empty())
+		{
+			const int count = (int)mDocument.mCompletions.size();
+			const int shown = std::min(count, COMPLETION_ROWS);
+			const int first = std::max(0, std::min(mDocument.mCompletionIndex - shown / 2, count - shown));
 
-	aEditor->mState = mBefore;
-	aEditor->EnsureCursorVisible();
+			ImGui::SetNextWindowPos(ImVec2(cursorScreenPos.x + mTextStart + TextDistanceToLineStart(mDocument.mCompletionStart),
+				cursorScreenPos.y + (mDocument.LineToRow(mDocument.mCompletionStart.mLine) + 1) * mCharAdvance.y));
+			ImGui::Begin("##CodeEditorCompletions", nullptr, ImGuiWindowFlags_Tooltip | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoTitleBar |
+				ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_AlwaysAutoResize |
+				ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
 
-}
+			for (int i = first; i < first + shown; ++i)
+				ImGui::Selectable(mDocument.mCompletions[i].c_str(), i == mDocument.mCompletionIndex);
 
-void CCodeEditor::UndoRecord::Redo(CCodeEditor * aEditor)
-{
-	if (!mRemoved.empty())
-	{
-		aEditor->DeleteRange(mRemovedStart, mRemovedEnd);
-		aEditor->Colorize(mRemovedStart.mLine - 1, mRemovedEnd.mLine - mRemovedStart.mLine + 1);
+			ImGui::End();
+		}
 	}
 
-	if (!mAdded.empty())
-	{
-		auto start = mAddedStart;
-		aEditor->InsertTextAt(start, mAdded.c_str());
-		aEditor->Colorize(mAddedStart.mLine - 1, mAddedEnd.mLine - mAddedStart.mLine + 1);
-	}
 
-	aEditor->mState = mAfter;
-	aEditor->EnsureCursorVisible();
-}
+	RenderMinimap();
 
-static bool TokenizeCStyleString(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
-{
-	const char * p = in_begin;
+	// the minimap covers the right edge, so the text can scroll out from under it
+	const float minimapWidth = mShowMinimap && mMinimapTexture != nullptr ? (float)MINIMAP_COLUMNS : 0.0f;
+	ImGui::Dummy(ImVec2((mTextStart + mLongest + 2 + minimapWidth), mDocument.GetVisibleLineCount() * mCharAdvance.y));
 
-	if (*p == '"')
+	if (mDocument.mScrollToCursor)
 	{
-		p++;
-
-		while (p < in_end)
-		{
-			// handle end of string
-			if (*p == '"')
-			{
-				out_begin = in_begin;
-				out_end = p + 1;
-				return true;
-			}
-
-			// handle escape character for "
-			if (*p == '\\' && p + 1 < in_end && p[1] == '"')
-				p++;
-
-			p++;
-		}
+		ScrollToCursor();
+		ImGui::SetWindowFocus();
+		mDocument.mScrollToCursor = false;
 	}
-
-	return false;
 }
 
-static bool TokenizeCStyleCharacterLiteral(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+void CCodeEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 {
-	const char * p = in_begin;
+	// the text was replaced, its lines are measured from scratch
+	if (mDocument.mScrollToTop)
+		mLongest = 0.0f;
 
-	if (*p == '\'')
-	{
-		p++;
+	mDocument.mTextChanged = false;
+	mDocument.mCursorPositionChanged = false;
 
-		// handle escape characters
-		if (p < in_end && *p == '\\')
-			p++;
+	ImGui::PushStyleColor(ImGuiCol_ChildBg, ImGui::ColorConvertU32ToFloat4(mPalette[(int)PaletteIndex::Background]));
+	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 0.0f));
+	if (!mIgnoreImGuiChild)
+		ImGui::BeginChild(aTitle, aSize, aBorder, ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_AlwaysHorizontalScrollbar | ImGuiWindowFlags_NoMove);
 
-		if (p < in_end)
-			p++;
+	CheckLayoutCache();
+	mDocument.UpdateFolds();
 
-		// handle end of character literal
-		if (p < in_end && *p == '\'')
-		{
-			out_begin = in_begin;
-			out_end = p + 1;
-			return true;
-		}
+	if (mHandleKeyboardInputs)
+	{
+		HandleKeyboardInputs();
+		ImGui::PushAllowKeyboardFocus(true);
 	}
 
-	return false;
-}
+	if (mHandleMouseInputs)
+		HandleMouseInputs();
 
-static bool TokenizeCStyleIdentifier(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
-{
-	const char * p = in_begin;
+	mDocument.Update();
+	Render();
 
-	if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || *p == '_')
-	{
-		p++;
+	if (mHandleKeyboardInputs)
+		ImGui::PopAllowKeyboardFocus();
 
-		while ((p < in_end) && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
-			p++;
+	if (!mIgnoreImGuiChild)
+		ImGui::EndChild();
 
-		out_begin = in_begin;
-		out_end = p;
-		return true;
-	}
+	ImGui::PopStyleVar();
+	ImGui::PopStyleColor();
 
-	return false;
+	// edits journal themselves as they're made, cursor moves once a frame
+	if (mDocument.mCursorPositionChanged)
+		mDocument.JournalState();
 }
 
-static bool TokenizeCStyleNumber(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
+// Writes one quad per visible glyph of [aFrom, aTo) straight into the draw list, in
+// the line's colors and at the cached layout offsets. This is what ImFont::RenderText
+// does for one AddText call, but it covers every color run of the line at once.
+void CCodeEditor::RenderLineGlyphs(ImDrawList* aDrawList, const Line& aLine, int aFrom, int aTo, const ImVec2& aPosition) const
 {
-	const char * p = in_begin;
+	if (aFrom >= aTo)
+		return;
 
-	const bool startsWithNumber = *p >= '0' && *p <= '9';
+	const ImFont* font = ImGui::GetFont();
+	const float scale = ImGui::GetFontSize() / font->FontSize;
+	const ImVec2 clipMin = aDrawList->GetClipRectMin();
+	const ImVec2 clipMax = aDrawList->GetClipRectMax();
+	const auto& offsets = aLine.mOffsets;
+	const char* text = aLine.mText.data();
 
-	if (*p != '+' && *p != '-' && !startsWithNumber)
-		return false;
+	// Align to be pixel perfect, like ImFont::RenderText
+	const float x = IM_TRUNC(aPosition.x);
+	const float y = IM_TRUNC(aPosition.y);
 
-	p++;
+	// At most one quad per byte; the unused part is given back below
+	const int reserved = aTo - aFrom;
+	aDrawList->PrimReserve(reserved * 6, reserved * 4);
 
-	bool hasNumber = startsWithNumber;
+	ImDrawVert* vtx = aDrawList->_VtxWritePtr;
+	ImDrawIdx* idx = aDrawList->_IdxWritePtr;
+	unsigned int vtxIndex = aDrawList->_VtxCurrentIdx;
 
-	while (p < in_end && (*p >= '0' && *p <= '9'))
+	for (int i = aFrom; i < aTo; )
 	{
-		hasNumber = true;
-
-		p++;
-	}
-
-	if (hasNumber == false)
-		return false;
+		const int next = std::min(i + CCodeDocument::UTF8CharLength(aLine.GetChar(i)), (int)aLine.size());
+		unsigned int c = (unsigned char)text[i];
+		if (c >= 0x80)
+			ImTextCharFromUtf8(&c, text + i, text + next);
 
-	bool isFloat = false;
-	bool isHex = false;
-	bool isBinary = false;
+		const ImFontGlyph* glyph = c == '\t' || c == ' ' ? nullptr : font->FindGlyph((ImWchar)c);
+		const ImU32 color = GetGlyphColor(aLine, i);
 
-	if (p < in_end)
-	{
-		if (*p == '.')
+		if (glyph != nullptr && glyph->Visible && (color & IM_COL32_A_MASK) != 0)
 		{
-			isFloat = true;
-
-			p++;
+			const float x1 = x + offsets[i] + glyph->X0 * scale;
+			const float x2 = x + offsets[i] + glyph->X1 * scale;
+			const float y1 = y + glyph->Y0 * scale;
+			const float y2 = y + glyph->Y1 * scale;
 
-			while (p < in_end && (*p >= '0' && *p <= '9'))
-				p++;
+			if (x1 <= clipMax.x && x2 >= clipMin.x)
+			{
+				const ImU32 glyphColor = glyph->Colored ? (color | ~IM_COL32_A_MASK) : color;
+
+				vtx[0].pos = ImVec2(x1, y1); vtx[0].uv = ImVec2(glyph->U0, glyph->V0); vtx[0].col = glyphColor;
+				vtx[1].pos = ImVec2(x2, y1); vtx[1].uv = ImVec2(glyph->U1, glyph->V0); vtx[1].col = glyphColor;
+				vtx[2].pos = ImVec2(x2, y2); vtx[2].uv = ImVec2(glyph->U1, glyph->V1); vtx[2].col = glyphColor;
+				vtx[3].pos = ImVec2(x1, y2); vtx[3].uv = ImVec2(glyph->U0, glyph->V1); vtx[3].col = glyphColor;
+				idx[0] = (ImDrawIdx)vtxIndex; idx[1] = (ImDrawIdx)(vtxIndex + 1); idx[2] = (ImDrawIdx)(vtxIndex + 2);
+				idx[3] = (ImDrawIdx)vtxIndex; idx[4] = (ImDrawIdx)(vtxIndex + 2); idx[5] = (ImDrawIdx)(vtxIndex + 3);
+				vtx += 4;
+				idx += 6;
+				vtxIndex += 4;
+			}
 		}
-		else if (*p == 'x' || *p == 'X')
-		{
-			// hex formatted integer of the type 0xef80
-
-			isHex = true;
 
-			p++;
+		i = next;
+	}
 
-			while (p < in_end && ((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') || (*p >= 'A' && *p <= 'F')))
-				p++;
-		}
-		else if (*p == 'b' || *p == 'B')
-		{
-			// binary formatted integer of the type 0b01011101
+	const int unused = reserved - (int)(vtx - aDrawList->_VtxWritePtr) / 4;
+	aDrawList->PrimUnreserve(unused * 6, unused * 4);
+	aDrawList->_VtxWritePtr = vtx;
+	aDrawList->_IdxWritePtr = idx;
+	aDrawList->_VtxCurrentIdx = vtxIndex;
+}
 
-			isBinary = true;
+void CCodeEditor::Copy()
+{
+	ImGui::SetClipboardText(mDocument.GetCopyText().c_str());
+}
 
-			p++;
+void CCodeEditor::Cut()
+{
+	Copy();
+	mDocument.DeleteSelections();
+}
 
-			while (p < in_end && (*p >= '0' && *p <= '1'))
-				p++;
-		}
-	}
+void CCodeEditor::Paste()
+{
+	auto clipText = ImGui::GetClipboardText();
+	if (clipText != nullptr)
+		mDocument.Paste(clipText);
+}
 
-	if (isHex == false && isBinary == false)
-	{
-		// floating point exponent
-		if (p < in_end && (*p == 'e' || *p == 'E'))
-		{
-			isFloat = true;
+// The line whose fold marker is at aPosition, or -1.
+int CCodeEditor::FoldMarkerAt(const ImVec2& aPosition) const
+{
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImVec2 local(aPosition.x - origin.x, aPosition.y - origin.y);
 
-			p++;
+	// the marker sits in the two spaces after the line number
+	if (local.y < 0.0f || local.x < mTextStart - 2.0f * mCharAdvance.x || local.x >= mTextStart)
+		return -1;
 
-			if (p < in_end && (*p == '+' || *p == '-'))
-				p++;
+	const int line = mDocument.RowToLine((int)floor(local.y / mCharAdvance.y));
+	return mDocument.FindFoldRegion(line) != nullptr ? line : -1;
+}
 
-			bool hasDigits = false;
+void CCodeEditor::SetMinimapTextureCallback(const TextureCallback& aCallback)
+{
+	if (mMinimapTexture != nullptr && mMinimapTextureCallback)
+		mMinimapTextureCallback(mMinimapTexture, 0, 0, nullptr, 0, 0);
 
-			while (p < in_end && (*p >= '0' && *p <= '9'))
-			{
-				hasDigits = true;
+	mMinimapTextureCallback = aCallback;
+	mMinimapTexture = nullptr;
+	mMinimapTextureRows = 0;
+	MarkMinimapDirty(0, std::numeric_limits<int>::max());
+}
 
-				p++;
-			}
+// Paints the dirty rows again, up to MINIMAP_UPDATE_LINES lines a frame, and
+// uploads only those; a new texture size uploads everything once.
+void CCodeEditor::UpdateMinimap()
+{
+	int changedMin, changedMax;
+	if (mDocument.TakeChangedLines(changedMin, changedMax))
+		MarkMinimapDirty(changedMin, changedMax);
 
-			if (hasDigits == false)
-				return false;
-		}
+	const int lineCount = (int)mDocument.mLines.size();
+	const int linesPerRow = std::max(1, (lineCount + MINIMAP_MAX_ROWS - 1) / MINIMAP_MAX_ROWS);
+	const int rows = (lineCount + linesPerRow - 1) / linesPerRow;
+	// grown in steps, so that typing doesn't make a new texture every line
+	const int textureRows = std::min(MINIMAP_MAX_ROWS, (rows + 255) & ~255);
 
-		// single precision floating point type
-		if (p < in_end && *p == 'f')
-			p++;
+	if (linesPerRow != mMinimapLinesPerRow || mPalette != mMinimapPalette)
+	{
+		mMinimapLinesPerRow = linesPerRow;
+		mMinimapPalette = mPalette;
+		MarkMinimapDirty(0, std::numeric_limits<int>::max());
 	}
 
-	if (isFloat == false)
+	const bool resized = textureRows != mMinimapTextureRows;
+	if (resized)
 	{
-		// integer size type
-		while (p < in_end && (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L'))
-			p++;
+		mMinimapPixels.resize((size_t)MINIMAP_COLUMNS * textureRows, 0);
+		mMinimapTextureRows = textureRows;
 	}
 
-	out_begin = in_begin;
-	out_end = p;
-	return true;
-}
+	int firstRow = 0;
+	int lastRow = 0;
+	if (mMinimapDirtyMin < mMinimapDirtyMax)
+	{
+		firstRow = mMinimapDirtyMin / linesPerRow;
+		lastRow = std::min(textureRows, mMinimapDirtyMax / linesPerRow + (mMinimapDirtyMax % linesPerRow != 0 ? 1 : 0));
+		lastRow = std::min(lastRow, firstRow + std::max(1, MINIMAP_UPDATE_LINES / linesPerRow));
 
-static bool TokenizeCStylePunctuation(const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end)
-{
-	(void)in_end;
+		for (int row = firstRow; row < lastRow; ++row)
+			PaintMinimapRow(row);
 
-	switch (*in_begin)
-	{
-	case '[':
-	case ']':
-	case '{':
-	case '}':
-	case '!':
-	case '%':
-	case '^':
-	case '&':
-	case '*':
-	case '(':
-	case ')':
-	case '-':
-	case '+':
-	case '=':
-	case '~':
-	case '|':
-	case '<':
-	case '>':
-	case '?':
-	case ':':
-	case '/':
-	case ';':
-	case ',':
-	case '.':
-		out_begin = in_begin;
-		out_end = in_begin + 1;
-		return true;
+		mMinimapDirtyMin = std::max(mMinimapDirtyMin, lastRow * linesPerRow);
+		if (mMinimapDirtyMin >= mMinimapDirtyMax || lastRow >= textureRows)
+		{
+			mMinimapDirtyMin = std::numeric_limits<int>::max();
+			mMinimapDirtyMax = 0;
+		}
 	}
 
-	return false;
+	if (resized)
+		mMinimapTexture = mMinimapTextureCallback(mMinimapTexture, MINIMAP_COLUMNS, textureRows, mMinimapPixels.data(), 0, textureRows);
+	else if (firstRow < lastRow)
+		mMinimapTexture = mMinimapTextureCallback(mMinimapTexture, MINIMAP_COLUMNS, textureRows, mMinimapPixels.data(), firstRow, lastRow - firstRow);
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::CPlusPlus()
+// A pixel per text column, in the color of the character there; a row of
+// several lines shows the first character found in each column.
+void CCodeEditor::PaintMinimapRow(int aRow)
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const cppKeywords[] = {
-			"alignas", "alignof", "and", "and_eq", "asm", "atomic_cancel", "atomic_commit", "atomic_noexcept", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
-			"compl", "concept", "const", "constexpr", "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float",
-			"for", "friend", "goto", "if", "import", "inline", "int", "long", "module", "mutable", "namespace", "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public",
-			"register", "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct", "switch", "synchronized", "template", "this", "thread_local",
-			"throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
-		};
-		for (auto& k : cppKeywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
-			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "printf", "sprintf", "snprintf", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper",
-			"std", "string", "vector", "map", "unordered_map", "set", "unordered_set", "min", "max"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
+	ImU32* pixels = mMinimapPixels.data() + (size_t)aRow * MINIMAP_COLUMNS;
+	std::fill(pixels, pixels + MINIMAP_COLUMNS, 0);
 
-		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
-		{
-			paletteIndex = PaletteIndex::Max;
+	const int tabSize = std::max(1, mDocument.mTabSize);
+	const int first = aRow * mMinimapLinesPerRow;
+	const int last = std::min((int)mDocument.mLines.size(), first + mMinimapLinesPerRow);
 
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
+	for (int i = first; i < last; ++i)
+	{
+		auto& line = mDocument.mLines[i];
+		int column = 0;
 
-			if (in_begin == in_end)
+		for (size_t j = 0; j < line.size() && column < MINIMAP_COLUMNS; ++j)
+		{
+			auto c = line.GetChar(j);
+			if (c == '\t')
+				column = (column / tabSize + 1) * tabSize;
+			else if ((c & 0xC0) != 0x80)
 			{
-				out_begin = in_end;
-				out_end = in_end;
-				paletteIndex = PaletteIndex::Default;
+				if (c != ' ' && pixels[column] == 0)
+					pixels[column] = GetGlyphColor(line, j);
+				++column;
 			}
-			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::String;
-			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::CharLiteral;
-			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Identifier;
-			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Number;
-			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Punctuation;
-
-			return paletteIndex != PaletteIndex::Max;
-		};
-
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
-
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = true;
-
-		langDef.mName = "C++";
-
-		inited = true;
+		}
 	}
-	return langDef;
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::HLSL()
+// The strip along the right edge of the editor the minimap takes, and the
+// height it draws a texture row at.
+bool CCodeEditor::GetMinimapRect(ImVec2& aMin, ImVec2& aMax, float& aRowHeight) const
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const keywords[] = {
-			"AppendStructuredBuffer", "asm", "asm_fragment", "BlendState", "bool", "break", "Buffer", "ByteAddressBuffer", "case", "cbuffer", "centroid", "class", "column_major", "compile", "compile_fragment",
-			"CompileShader", "const", "continue", "ComputeShader", "ConsumeStructuredBuffer", "default", "DepthStencilState", "DepthStencilView", "discard", "do", "double", "DomainShader", "dword", "else",
-			"export", "extern", "false", "float", "for", "fxgroup", "GeometryShader", "groupshared", "half", "Hullshader", "if", "in", "inline", "inout", "InputPatch", "int", "interface", "line", "lineadj",
-			"linear", "LineStream", "matrix", "min16float", "min10float", "min16int", "min12int", "min16uint", "namespace", "nointerpolation", "noperspective", "NULL", "out", "OutputPatch", "packoffset",
-			"pass", "pixelfragment", "PixelShader", "point", "PointStream", "precise", "RasterizerState", "RenderTargetView", "return", "register", "row_major", "RWBuffer", "RWByteAddressBuffer", "RWStructuredBuffer",
-			"RWTexture1D", "RWTexture1DArray", "RWTexture2D", "RWTexture2DArray", "RWTexture3D", "sample", "sampler", "SamplerState", "SamplerComparisonState", "shared", "snorm", "stateblock", "stateblock_state",
-			"static", "string", "struct", "switch", "StructuredBuffer", "tbuffer", "technique", "technique10", "technique11", "texture", "Texture1D", "Texture1DArray", "Texture2D", "Texture2DArray", "Texture2DMS",
-			"Texture2DMSArray", "Texture3D", "TextureCube", "TextureCubeArray", "true", "typedef", "triangle", "triangleadj", "TriangleStream", "uint", "uniform", "unorm", "unsigned", "vector", "vertexfragment",
-			"VertexShader", "void", "volatile", "while",
-			"bool1","bool2","bool3","bool4","double1","double2","double3","double4", "float1", "float2", "float3", "float4", "int1", "int2", "int3", "int4", "in", "out", "inout",
-			"uint1", "uint2", "uint3", "uint4", "dword1", "dword2", "dword3", "dword4", "half1", "half2", "half3", "half4",
-			"float1x1","float2x1","float3x1","float4x1","float1x2","float2x2","float3x2","float4x2",
-			"float1x3","float2x3","float3x3","float4x3","float1x4","float2x4","float3x4","float4x4",
-			"half1x1","half2x1","half3x1","half4x1","half1x2","half2x2","half3x2","half4x2",
-			"half1x3","half2x3","half3x3","half4x3","half1x4","half2x4","half3x4","half4x4",
-		};
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"abort", "abs", "acos", "all", "AllMemoryBarrier", "AllMemoryBarrierWithGroupSync", "any", "asdouble", "asfloat", "asin", "asint", "asint", "asuint",
-			"asuint", "atan", "atan2", "ceil", "CheckAccessFullyMapped", "clamp", "clip", "cos", "cosh", "countbits", "cross", "D3DCOLORtoUBYTE4", "ddx",
-			"ddx_coarse", "ddx_fine", "ddy", "ddy_coarse", "ddy_fine", "degrees", "determinant", "DeviceMemoryBarrier", "DeviceMemoryBarrierWithGroupSync",
-			"distance", "dot", "dst", "errorf", "EvaluateAttributeAtCentroid", "EvaluateAttributeAtSample", "EvaluateAttributeSnapped", "exp", "exp2",
-			"f16tof32", "f32tof16", "faceforward", "firstbithigh", "firstbitlow", "floor", "fma", "fmod", "frac", "frexp", "fwidth", "GetRenderTargetSampleCount",
-			"GetRenderTargetSamplePosition", "GroupMemoryBarrier", "GroupMemoryBarrierWithGroupSync", "InterlockedAdd", "InterlockedAnd", "InterlockedCompareExchange",
-			"InterlockedCompareStore", "InterlockedExchange", "InterlockedMax", "InterlockedMin", "InterlockedOr", "InterlockedXor", "isfinite", "isinf", "isnan",
-			"ldexp", "length", "lerp", "lit", "log", "log10", "log2", "mad", "max", "min", "modf", "msad4", "mul", "noise", "normalize", "pow", "printf",
-			"Process2DQuadTessFactorsAvg", "Process2DQuadTessFactorsMax", "Process2DQuadTessFactorsMin", "ProcessIsolineTessFactors", "ProcessQuadTessFactorsAvg",
-			"ProcessQuadTessFactorsMax", "ProcessQuadTessFactorsMin", "ProcessTriTessFactorsAvg", "ProcessTriTessFactorsMax", "ProcessTriTessFactorsMin",
-			"radians", "rcp", "reflect", "refract", "reversebits", "round", "rsqrt", "saturate", "sign", "sin", "sincos", "sinh", "smoothstep", "sqrt", "step",
-			"tan", "tanh", "tex1D", "tex1D", "tex1Dbias", "tex1Dgrad", "tex1Dlod", "tex1Dproj", "tex2D", "tex2D", "tex2Dbias", "tex2Dgrad", "tex2Dlod", "tex2Dproj",
-			"tex3D", "tex3D", "tex3Dbias", "tex3Dgrad", "tex3Dlod", "tex3Dproj", "texCUBE", "texCUBE", "texCUBEbias", "texCUBEgrad", "texCUBElod", "texCUBEproj", "transpose", "trunc"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
-
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
-
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
-
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = true;
+	if (!mShowMinimap || mMinimapTexture == nullptr)
+		return false;
 
-		langDef.mName = "HLSL";
+	const ImRect& inner = ImGui::GetCurrentWindowRead()->InnerRect;
+	const int rows = std::max(1, ((int)mDocument.mLines.size() + mMinimapLinesPerRow - 1) / mMinimapLinesPerRow);
 
-		inited = true;
-	}
-	return langDef;
+	aMin = ImVec2(inner.Max.x - MINIMAP_COLUMNS, inner.Min.y);
+	aMax = inner.Max;
+	aRowHeight = std::min(MINIMAP_ROW_HEIGHT, inner.GetHeight() / rows);
+	return true;
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::GLSL()
+void CCodeEditor::RenderMinimap()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const keywords[] = {
-			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
-			"signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
-			"_Noreturn", "_Static_assert", "_Thread_local"
-		};
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
-			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
+	if (!mShowMinimap || !mMinimapTextureCallback)
+		return;
+
+	UpdateMinimap();
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[ \\t]*#[ \\t]*[a-zA-Z_]+", PaletteIndex::Preprocessor));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::CharLiteral));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+	ImVec2 min, max;
+	float rowHeight;
+	if (!GetMinimapRect(min, max, rowHeight))
+		return;
+
+	// one quad for the whole document
+	const int linesPerRow = mMinimapLinesPerRow;
+	const int rows = ((int)mDocument.mLines.size() + linesPerRow - 1) / linesPerRow;
+	auto drawList = ImGui::GetWindowDrawList();
+	drawList->AddRectFilled(min, max, mPalette[(int)PaletteIndex::Background]);
+	drawList->AddImage(mMinimapTexture, min, ImVec2(max.x, min.y + rows * rowHeight), ImVec2(0.0f, 0.0f), ImVec2(1.0f, (float)rows / mMinimapTextureRows));
 
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
+	// the lines on screen
+	const float viewTop = min.y + (float)mDocument.mViewLineMin / linesPerRow * rowHeight;
+	const float viewBottom = std::max(viewTop + 2.0f, min.y + (float)mDocument.mViewLineMax / linesPerRow * rowHeight);
+	drawList->AddRectFilled(ImVec2(min.x, viewTop), ImVec2(max.x, viewBottom), mPalette[(int)PaletteIndex::CurrentLineFillInactive]);
 
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = true;
+	if (!mHandleMouseInputs)
+		return;
 
-		langDef.mName = "GLSL";
+	if (ImGui::IsWindowHovered() && ImGui::IsMouseHoveringRect(min, max) && ImGui::IsMouseClicked(0))
+		mMinimapDragging = true;
+	if (!ImGui::IsMouseDown(0))
+		mMinimapDragging = false;
 
-		inited = true;
+	if (mMinimapDragging)
+	{
+		// centers the line under the mouse, found through the same rows the texture is painted by
+		const int row = (int)((ImGui::GetMousePos().y - min.y) / rowHeight);
+		const int line = std::max(0, std::min((int)mDocument.mLines.size() - 1, row * linesPerRow));
+		ImGui::SetScrollY(std::max(0.0f, mDocument.LineToRow(line) * mCharAdvance.y - (max.y - min.y) * 0.5f));
 	}
-	return langDef;
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::C()
+float CCodeEditor::TextDistanceToLineStart(const Coordinates& aFrom) const
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const keywords[] = {
-			"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return", "short",
-			"signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary",
-			"_Noreturn", "_Static_assert", "_Thread_local"
-		};
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"abort", "abs", "acos", "asin", "atan", "atexit", "atof", "atoi", "atol", "ceil", "clock", "cosh", "ctime", "div", "exit", "fabs", "floor", "fmod", "getchar", "getenv", "isalnum", "isalpha", "isdigit", "isgraph",
-			"ispunct", "isspace", "isupper", "kbhit", "log10", "log2", "log", "memcmp", "modf", "pow", "putchar", "putenv", "puts", "rand", "remove", "rename", "sinh", "sqrt", "srand", "strcat", "strcmp", "strerror", "time", "tolower", "toupper"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
+	auto& offsets = GetLineLayout(aFrom.mLine);
+	return offsets[std::min((size_t)mDocument.GetCharacterIndex(aFrom), offsets.size() - 1)];
+}
 
-		langDef.mTokenize = [](const char * in_begin, const char * in_end, const char *& out_begin, const char *& out_end, PaletteIndex & paletteIndex) -> bool
-		{
-			paletteIndex = PaletteIndex::Max;
+// Lays out the line on first use after an edit; the result stays valid until the
+// line is edited again or CheckLayoutCache() sees a different font or tab size.
+const std::vector<float>& CCodeEditor::GetLineLayout(int aLine) const
+{
+	auto& line = mDocument.mLines[aLine];
+	auto& offsets = line.mOffsets;
+	if (!offsets.empty())
+		return offsets;
 
-			while (in_begin < in_end && isascii(*in_begin) && isblank(*in_begin))
-				in_begin++;
+	const ImFont* font = ImGui::GetFont();
+	const float scale = ImGui::GetFontSize() / font->FontSize;
+	const float tabSize = float(mDocument.mTabSize) * font->GetCharAdvance(' ') * scale;
+	const char* text = line.mText.data();
 
-			if (in_begin == in_end)
-			{
-				out_begin = in_end;
-				out_end = in_end;
-				paletteIndex = PaletteIndex::Default;
-			}
-			else if (TokenizeCStyleString(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::String;
-			else if (TokenizeCStyleCharacterLiteral(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::CharLiteral;
-			else if (TokenizeCStyleIdentifier(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Identifier;
-			else if (TokenizeCStyleNumber(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Number;
-			else if (TokenizeCStylePunctuation(in_begin, in_end, out_begin, out_end))
-				paletteIndex = PaletteIndex::Punctuation;
-
-			return paletteIndex != PaletteIndex::Max;
-		};
-
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
-
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = true;
-
-		langDef.mName = "C";
-
-		inited = true;
-	}
-	return langDef;
-}
+	offsets.resize(line.size() + 1);
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::SQL()
-{
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
+	float x = 0.0f;
+	for (size_t it = 0u; it < line.size(); )
 	{
-		static const char* const keywords[] = {
-			"ADD", "EXCEPT", "PERCENT", "ALL", "EXEC", "PLAN", "ALTER", "EXECUTE", "PRECISION", "AND", "EXISTS", "PRIMARY", "ANY", "EXIT", "PRINT", "AS", "FETCH", "PROC", "ASC", "FILE", "PROCEDURE",
-			"AUTHORIZATION", "FILLFACTOR", "PUBLIC", "BACKUP", "FOR", "RAISERROR", "BEGIN", "FOREIGN", "READ", "BETWEEN", "FREETEXT", "READTEXT", "BREAK", "FREETEXTTABLE", "RECONFIGURE",
-			"BROWSE", "FROM", "REFERENCES", "BULK", "FULL", "REPLICATION", "BY", "FUNCTION", "RESTORE", "CASCADE", "GOTO", "RESTRICT", "CASE", "GRANT", "RETURN", "CHECK", "GROUP", "REVOKE",
-			"CHECKPOINT", "HAVING", "RIGHT", "CLOSE", "HOLDLOCK", "ROLLBACK", "CLUSTERED", "IDENTITY", "ROWCOUNT", "COALESCE", "IDENTITY_INSERT", "ROWGUIDCOL", "COLLATE", "IDENTITYCOL", "RULE",
-			"COLUMN", "IF", "SAVE", "COMMIT", "IN", "SCHEMA", "COMPUTE", "INDEX", "SELECT", "CONSTRAINT", "INNER", "SESSION_USER", "CONTAINS", "INSERT", "SET", "CONTAINSTABLE", "INTERSECT", "SETUSER",
-			"CONTINUE", "INTO", "SHUTDOWN", "CONVERT", "IS", "SOME", "CREATE", "JOIN", "STATISTICS", "CROSS", "KEY", "SYSTEM_USER", "CURRENT", "KILL", "TABLE", "CURRENT_DATE", "LEFT", "TEXTSIZE",
-			"CURRENT_TIME", "LIKE", "THEN", "CURRENT_TIMESTAMP", "LINENO", "TO", "CURRENT_USER", "LOAD", "TOP", "CURSOR", "NATIONAL", "TRAN", "DATABASE", "NOCHECK", "TRANSACTION",
-			"DBCC", "NONCLUSTERED", "TRIGGER", "DEALLOCATE", "NOT", "TRUNCATE", "DECLARE", "NULL", "TSEQUAL", "DEFAULT", "NULLIF", "UNION", "DELETE", "OF", "UNIQUE", "DENY", "OFF", "UPDATE",
-			"DESC", "OFFSETS", "UPDATETEXT", "DISK", "ON", "USE", "DISTINCT", "OPEN", "USER", "DISTRIBUTED", "OPENDATASOURCE", "VALUES", "DOUBLE", "OPENQUERY", "VARYING","DROP", "OPENROWSET", "VIEW",
-			"DUMMY", "OPENXML", "WAITFOR", "DUMP", "OPTION", "WHEN", "ELSE", "OR", "WHERE", "END", "ORDER", "WHILE", "ERRLVL", "OUTER", "WITH", "ESCAPE", "OVER", "WRITETEXT"
-		};
-
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"ABS",  "ACOS",  "ADD_MONTHS",  "ASCII",  "ASCIISTR",  "ASIN",  "ATAN",  "ATAN2",  "AVG",  "BFILENAME",  "BIN_TO_NUM",  "BITAND",  "CARDINALITY",  "CASE",  "CAST",  "CEIL",
-			"CHARTOROWID",  "CHR",  "COALESCE",  "COMPOSE",  "CONCAT",  "CONVERT",  "CORR",  "COS",  "COSH",  "COUNT",  "COVAR_POP",  "COVAR_SAMP",  "CUME_DIST",  "CURRENT_DATE",
-			"CURRENT_TIMESTAMP",  "DBTIMEZONE",  "DECODE",  "DECOMPOSE",  "DENSE_RANK",  "DUMP",  "EMPTY_BLOB",  "EMPTY_CLOB",  "EXP",  "EXTRACT",  "FIRST_VALUE",  "FLOOR",  "FROM_TZ",  "GREATEST",
-			"GROUP_ID",  "HEXTORAW",  "INITCAP",  "INSTR",  "INSTR2",  "INSTR4",  "INSTRB",  "INSTRC",  "LAG",  "LAST_DAY",  "LAST_VALUE",  "LEAD",  "LEAST",  "LENGTH",  "LENGTH2",  "LENGTH4",
-			"LENGTHB",  "LENGTHC",  "LISTAGG",  "LN",  "LNNVL",  "LOCALTIMESTAMP",  "LOG",  "LOWER",  "LPAD",  "LTRIM",  "MAX",  "MEDIAN",  "MIN",  "MOD",  "MONTHS_BETWEEN",  "NANVL",  "NCHR",
-			"NEW_TIME",  "NEXT_DAY",  "NTH_VALUE",  "NULLIF",  "NUMTODSINTERVAL",  "NUMTOYMINTERVAL",  "NVL",  "NVL2",  "POWER",  "RANK",  "RAWTOHEX",  "REGEXP_COUNT",  "REGEXP_INSTR",
-			"REGEXP_REPLACE",  "REGEXP_SUBSTR",  "REMAINDER",  "REPLACE",  "ROUND",  "ROWNUM",  "RPAD",  "RTRIM",  "SESSIONTIMEZONE",  "SIGN",  "SIN",  "SINH",
-			"SOUNDEX",  "SQRT",  "STDDEV",  "SUBSTR",  "SUM",  "SYS_CONTEXT",  "SYSDATE",  "SYSTIMESTAMP",  "TAN",  "TANH",  "TO_CHAR",  "TO_CLOB",  "TO_DATE",  "TO_DSINTERVAL",  "TO_LOB",
-			"TO_MULTI_BYTE",  "TO_NCLOB",  "TO_NUMBER",  "TO_SINGLE_BYTE",  "TO_TIMESTAMP",  "TO_TIMESTAMP_TZ",  "TO_YMINTERVAL",  "TRANSLATE",  "TRIM",  "TRUNC", "TZ_OFFSET",  "UID",  "UPPER",
-			"USER",  "USERENV",  "VAR_POP",  "VAR_SAMP",  "VARIANCE",  "VSIZE "
-		};
-		for (auto& k : identifiers)
+		offsets[it] = x;
+
+		if (text[it] == '\t')
+		{
+			x = (1.0f + std::floor((1.0f + x) / tabSize)) * tabSize;
+			++it;
+		}
+		else
 		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
+			const size_t end = std::min(it + CCodeDocument::UTF8CharLength(line.GetChar(it)), line.size());
+			unsigned int c = (unsigned char)text[it];
+			if (c >= 0x80)
+				ImTextCharFromUtf8(&c, text + it, text + end);
+
+			x += font->GetCharAdvance((ImWchar)c) * scale;
+			for (++it; it < end; ++it)
+				offsets[it] = offsets[it - 1];
 		}
+	}
+	offsets[line.size()] = x;
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\\'[^\\\']*\\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+	mLongest = std::max(mLongest, x);
+	return offsets;
+}
 
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
+void CCodeEditor::CheckLayoutCache()
+{
+	const ImFont* font = ImGui::GetFont();
+	const float fontSize = ImGui::GetFontSize();
 
-		langDef.mCaseSensitive = false;
-		langDef.mAutoIndentation = false;
+	if (font == mLayoutFont && fontSize == mLayoutFontSize && mDocument.mTabSize == mLayoutTabSize)
+		return;
 
-		langDef.mName = "SQL";
+	mLayoutFont = font;
+	mLayoutFontSize = fontSize;
+	mLayoutTabSize = mDocument.mTabSize;
+	mLongest = 0.0f;
 
-		inited = true;
-	}
-	return langDef;
+	for (auto& line : mDocument.mLines)
+		line.mOffsets.clear();
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::AngelScript()
+// Scrolls the window for the cursor to show, as EnsureCursorVisible() asks
+void CCodeEditor::ScrollToCursor()
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const keywords[] = {
-			"and", "abstract", "auto", "bool", "break", "case", "cast", "class", "const", "continue", "default", "do", "double", "else", "enum", "false", "final", "float", "for",
-			"from", "funcdef", "function", "get", "if", "import", "in", "inout", "int", "interface", "int8", "int16", "int32", "int64", "is", "mixin", "namespace", "not",
-			"null", "or", "out", "override", "private", "protected", "return", "set", "shared", "super", "switch", "this ", "true", "typedef", "uint", "uint8", "uint16", "uint32",
-			"uint64", "void", "while", "xor"
-		};
-
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"cos", "sin", "tab", "acos", "asin", "atan", "atan2", "cosh", "sinh", "tanh", "log", "log10", "pow", "sqrt", "abs", "ceil", "floor", "fraction", "closeTo", "fpFromIEEE", "fpToIEEE",
-			"complex", "opEquals", "opAddAssign", "opSubAssign", "opMulAssign", "opDivAssign", "opAdd", "opSub", "opMul", "opDiv"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
+	float scrollX = ImGui::GetScrollX();
+	float scrollY = ImGui::GetScrollY();
 
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\'\\\\?[^\\']\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[0-7]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+	auto height = ImGui::GetWindowHeight();
+	auto width = ImGui::GetWindowWidth();
 
-		langDef.mCommentStart = "/*";
-		langDef.mCommentEnd = "*/";
-		langDef.mSingleLineComment = "//";
+	auto top = 1 + (int)ceil(scrollY / mCharAdvance.y);
+	auto bottom = (int)ceil((scrollY + height) / mCharAdvance.y);
 
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = true;
+	auto left = (int)ceil(scrollX / mCharAdvance.x);
+	auto right = (int)ceil((scrollX + width) / mCharAdvance.x);
 
-		langDef.mName = "AngelScript";
+	auto pos = mDocument.GetActualCursorCoordinates();
+	auto len = TextDistanceToLineStart(pos);
+	auto row = mDocument.LineToRow(pos.mLine);
 
-		inited = true;
-	}
-	return langDef;
+	if (row < top)
+		ImGui::SetScrollY(std::max(0.0f, (row - 1) * mCharAdvance.y));
+	if (row > bottom - 4)
+		ImGui::SetScrollY(std::max(0.0f, (row + 4) * mCharAdvance.y - height));
+	if (len + mTextStart < left + 4)
+		ImGui::SetScrollX(std::max(0.0f, len + mTextStart - 4));
+	if (len + mTextStart > right - 4)
+		ImGui::SetScrollX(std::max(0.0f, len + mTextStart + 4 - width));
 }
 
-const CCodeEditor::LanguageDefinition& CCodeEditor::LanguageDefinition::Lua()
+int CCodeEditor::GetPageSize() const
 {
-	static bool inited = false;
-	static LanguageDefinition langDef;
-	if (!inited)
-	{
-		static const char* const keywords[] = {
-			"and", "break", "do", "", "else", "elseif", "end", "false", "for", "function", "if", "in", "", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
-		};
-
-		for (auto& k : keywords)
-			langDef.mKeywords.insert(k);
-
-		static const char* const identifiers[] = {
-			"assert", "collectgarbage", "dofile", "error", "getmetatable", "ipairs", "loadfile", "load", "loadstring",  "next",  "pairs",  "pcall",  "print",  "rawequal",  "rawlen",  "rawget",  "rawset",
-			"select",  "setmetatable",  "tonumber",  "tostring",  "type",  "xpcall",  "_G",  "_VERSION","arshift", "band", "bnot", "bor", "bxor", "btest", "extract", "lrotate", "lshift", "replace",
-			"rrotate", "rshift", "create", "resume", "running", "status", "wrap", "yield", "isyieldable", "debug","getuservalue", "gethook", "getinfo", "getlocal", "getregistry", "getmetatable",
-			"getupvalue", "upvaluejoin", "upvalueid", "setuservalue", "sethook", "setlocal", "setmetatable", "setupvalue", "traceback", "close", "flush", "input", "lines", "open", "output", "popen",
-			"read", "tmpfile", "type", "write", "close", "flush", "lines", "read", "seek", "setvbuf", "write", "__gc", "__tostring", "abs", "acos", "asin", "atan", "ceil", "cos", "deg", "exp", "tointeger",
-			"floor", "fmod", "ult", "log", "max", "min", "modf", "rad", "random", "randomseed", "sin", "sqrt", "string", "tan", "type", "atan2", "cosh", "sinh", "tanh",
-			"pow", "frexp", "ldexp", "log10", "pi", "huge", "maxinteger", "mininteger", "loadlib", "searchpath", "seeall", "preload", "cpath", "path", "searchers", "loaded", "module", "require", "clock",
-			"date", "difftime", "execute", "exit", "getenv", "remove", "rename", "setlocale", "time", "tmpname", "byte", "char", "dump", "find", "format", "gmatch", "gsub", "len", "lower", "match", "rep",
-			"reverse", "sub", "upper", "pack", "packsize", "unpack", "concat", "maxn", "insert", "pack", "unpack", "remove", "move", "sort", "offset", "codepoint", "char", "len", "codes", "charpattern",
-			"coroutine", "table", "io", "os", "string", "utf8", "bit32", "math", "debug", "package"
-		};
-		for (auto& k : identifiers)
-		{
-			Identifier id;
-			id.mDeclaration = "Built-in function";
-			langDef.mIdentifiers.insert(std::make_pair(std::string(k), id));
-		}
-
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("L?\\\"(\\\\.|[^\\\"])*\\\"", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("\\\'[^\\\']*\\\'", PaletteIndex::String));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("0[xX][0-9a-fA-F]+[uU]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?([0-9]+([.][0-9]*)?|[.][0-9]+)([eE][+-]?[0-9]+)?[fF]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[+-]?[0-9]+[Uu]?[lL]?[lL]?", PaletteIndex::Number));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[a-zA-Z_][a-zA-Z0-9_]*", PaletteIndex::Identifier));
-		langDef.mTokenRegexStrings.push_back(std::make_pair<std::string, PaletteIndex>("[\\[\\]\\{\\}\\!\\%\\^\\&\\*\\(\\)\\-\\+\\=\\~\\|\\<\\>\\?\\/\\;\\,\\.]", PaletteIndex::Punctuation));
+	auto height = ImGui::GetWindowHeight() - 20.0f;
+	return (int)floor(height / mCharAdvance.y);
+}
 
-		langDef.mCommentStart = "--[[";
-		langDef.mCommentEnd = "]]";
-		langDef.mSingleLineComment = "--";
+void CCodeEditor::MarkMinimapDirty(int aFromLine, int aToLine)
+{
+	mMinimapDirtyMin = std::min(mMinimapDirtyMin, aFromLine);
+	mMinimapDirtyMax = std::max(mMinimapDirtyMax, aToLine);
+}
 
-		langDef.mCaseSensitive = true;
-		langDef.mAutoIndentation = false;
+const CCodeEditor::Palette & CCodeEditor::GetDarkPalette()
+{
+	const static Palette p = { {
+			0xff7f7f7f,	// Default
+			0xffd69c56,	// Keyword	
+			0xff00ff00,	// Number
+			0xff7070e0,	// String
+			0xff70a0e0, // Char literal
+			0xffffffff, // Punctuation
+			0xff408080,	// Preprocessor
+			0xffaaaaaa, // Identifier
+			0xff9bc64d, // Known identifier
+			0xffc040a0, // Preproc identifier
+			0xff206020, // Comment (single line)
+			0xff406020, // Comment (multi line)
+			0xff101010, // Background
+			0xffe0e0e0, // Cursor
+			0x80a06020, // Selection
+			0x800020ff, // ErrorMarker
+			0x40f08000, // Breakpoint
+			0xff707000, // Line number
+			0x40000000, // Current line fill
+			0x40808080, // Current line fill (inactive)
+			0x40a0a0a0, // Current line edge
+			0x4020a0e0, // Find match
+			0x50a0a0a0, // Matching pair
+		} };
+	return p;
+}
 
-		langDef.mName = "Lua";
+const CCodeEditor::Palette & CCodeEditor::GetLightPalette()
+{
+	const static Palette p = { {
+			0xff7f7f7f,	// None
+			0xffff0c06,	// Keyword	
+			0xff008000,	// Number
+			0xff2020a0,	// String
+			0xff304070, // Char literal
+			0xff000000, // Punctuation
+			0xff406060,	// Preprocessor
+			0xff404040, // Identifier
+			0xff606010, // Known identifier
+			0xffc040a0, // Preproc identifier
+			0xff205020, // Comment (single line)
+			0xff405020, // Comment (multi line)
+			0xffffffff, // Background
+			0xff000000, // Cursor
+			0x80600000, // Selection
+			0xa00010ff, // ErrorMarker
+			0x80f08000, // Breakpoint
+			0xff505000, // Line number
+			0x40000000, // Current line fill
+			0x40808080, // Current line fill (inactive)
+			0x40000000, // Current line edge
+			0x4000a0ff, // Find match
+			0x40606060, // Matching pair
+		} };
+	return p;
+}
 
-		inited = true;
-	}
-	return langDef;
+const CCodeEditor::Palette & CCodeEditor::GetRetroBluePalette()
+{
+	const static Palette p = { {
+			0xff00ffff,	// None
+			0xffffff00,	// Keyword	
+			0xff00ff00,	// Number
+			0xff808000,	// String
+			0xff808000, // Char literal
+			0xffffffff, // Punctuation
+			0xff008000,	// Preprocessor
+			0xff00ffff, // Identifier
+			0xffffffff, // Known identifier
+			0xffff00ff, // Preproc identifier
+			0xff808080, // Comment (single line)
+			0xff404040, // Comment (multi line)
+			0xff800000, // Background
+			0xff0080ff, // Cursor
+			0x80ffff00, // Selection
+			0xa00000ff, // ErrorMarker
+			0x80ff8000, // Breakpoint
+			0xff808000, // Line number
+			0x40000000, // Current line fill
+			0x40808080, // Current line fill (inactive)
+			0x40000000, // Current line edge
+			0x6000ffff, // Find match
+			0x60c0c0c0, // Matching pair
+		} };
+	return p;
 }
@@ -158,6 +158,51 @@ void CGuiMgr::Render()
     EndFrame();
 }
 
+ImTextureID CGuiMgr::UpdateTexture(ImTextureID texture, int width, int height, const ImU32* pixels, int firstRow, int rows)
+{
+    IDirect3DTexture9* pTexture = reinterpret_cast<IDirect3DTexture9*>(texture);
+
+    if (pTexture != nullptr)
+    {
+        D3DSURFACE_DESC desc;
+        if (width <= 0 || height <= 0 || pTexture->GetLevelDesc(0, &desc) != D3D_OK || desc.Width != (UINT)width || desc.Height != (UINT)height)
+        {
+            pTexture->Release();
+            pTexture = nullptr;
+            firstRow = 0;
+            rows = height;
+        }
+    }
+
+    if (width <= 0 || height <= 0 || m_pDevice == nullptr)
+        return nullptr;
+
+    // Managed pool, so the texture outlives a device reset
+    if (pTexture == nullptr && m_pDevice->CreateTexture(width, height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &pTexture, nullptr) != D3D_OK)
+        return nullptr;
+
+    RECT rect = { 0, firstRow, width, firstRow + rows };
+    D3DLOCKED_RECT lockedRect;
+    if (pTexture->LockRect(0, &lockedRect, &rect, 0) == D3D_OK)
+    {
+        for (int y = 0; y < rows; y++)
+        {
+            const ImU32* pSrc = pixels + (size_t)(firstRow + y) * width;
+            ImU32* pDst = reinterpret_cast<ImU32*>(static_cast<unsigned char*>(lockedRect.pBits) + y * lockedRect.Pitch);
+#ifndef IMGUI_USE_BGRA_PACKED_COLOR
+            // RGBA32 to BGRA32, like the backend does for the font atlas
+            for (int x = 0; x < width; x++)
+                pDst[x] = (pSrc[x] & 0xFF00FF00) | ((pSrc[x] & 0x000000FF) << 16) | ((pSrc[x] & 0x00FF0000) >> 16);
+#else
+            memcpy(pDst, pSrc, width * sizeof(ImU32));
+#endif
+        }
+        pTexture->UnlockRect(0);
+    }
+
+    return pTexture;
+}
+
 void CGuiMgr::BeginFrame()
 {
     ImGui_ImplDX9_NewFrame();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CGuiPanel.h"
+#include "imgui.h"
 
 #include <vector>
 #include <d3d9.h>
@@ -21,6 +22,9 @@ public:
     void RemovePanel(CGuiPanel* panel);
     void Render();
 
+    // Makes or updates a texture from IM_COL32 pixels, see CCodeEditor::TextureCallback
+    ImTextureID UpdateTexture(ImTextureID texture, int width, int height, const ImU32* pixels, int firstRow, int rows);
+
     HWND GetWindow() { return m_hWnd; }
     IDirect3DDevice9* GetDevice() { return m_pDevice; }
 
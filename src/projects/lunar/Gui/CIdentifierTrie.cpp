@@ -0,0 +1,120 @@
+#include "CIdentifierTrie.h"
+
+#include <algorithm>
+
+static inline uint8_t FoldCase(char c)
+{
+	return (c >= 'a' && c <= 'z') ? (uint8_t)(c - 'a' + 'A') : (uint8_t)c;
+}
+
+CIdentifierTrie::CIdentifierTrie()
+{
+	Clear();
+}
+
+int CIdentifierTrie::Insert(const char* pBegin, const char* pEnd)
+{
+	if (pBegin == pEnd)
+		return 0;
+
+	int& first = m_Root[(uint8_t)*pBegin];
+	if (first < 0)
+	{
+		first = (int)m_Nodes.size();
+		m_Nodes.push_back(Node{ *pBegin, 0, -1, -1, 0 });
+	}
+
+	int node = first;
+
+	for (const char* p = pBegin + 1; p < pEnd; p++)
+	{
+		const uint8_t c = (uint8_t)*p;
+
+		int prev = -1;
+		int child = m_Nodes[node].mFirstChild;
+		while (child >= 0 && (uint8_t)m_Nodes[child].mChar < c)
+		{
+			prev = child;
+			child = m_Nodes[child].mNextSibling;
+		}
+
+		if (child < 0 || (uint8_t)m_Nodes[child].mChar != c)
+		{
+			const int added = (int)m_Nodes.size();
+			m_Nodes.push_back(Node{ (char)c, 0, -1, child, 0 });
+
+			if (prev >= 0)
+				m_Nodes[prev].mNextSibling = added;
+			else
+				m_Nodes[node].mFirstChild = added;
+
+			child = added;
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+int CIdentifierTrie::Find(const char* pBegin, const char* pEnd, bool bFoldCase) const
+{
+	if (pBegin == pEnd)
+		return 0;
+
+	int node = m_Root[bFoldCase ? FoldCase(*pBegin) : (uint8_t)*pBegin];
+
+	for (const char* p = pBegin + 1; p < pEnd && node >= 0; p++)
+	{
+		const uint8_t c = bFoldCase ? FoldCase(*p) : (uint8_t)*p;
+
+		int child = m_Nodes[node].mFirstChild;
+		while (child >= 0 && (uint8_t)m_Nodes[child].mChar < c)
+			child = m_Nodes[child].mNextSibling;
+
+		if (child < 0 || (uint8_t)m_Nodes[child].mChar != c)
+			return -1;
+
+		node = child;
+	}
+
+	return node;
+}
+
+int CIdentifierTrie::Add(const char* pBegin, const char* pEnd)
+{
+	const int node = Insert(pBegin, pEnd);
+	m_Nodes[node].mCount++;
+	return node;
+}
+
+void CIdentifierTrie::Complete(const char* pBegin, const char* pEnd, std::vector<std::string>& results, size_t maxResults) const
+{
+	const int node = Find(pBegin, pEnd);
+	if (node <= 0)
+		return;
+
+	std::string word(pBegin, pEnd);
+	Collect(node, word, results, maxResults);
+}
+
+void CIdentifierTrie::Collect(int node, std::string& word, std::vector<std::string>& results, size_t maxResults) const
+{
+	const Node& n = m_Nodes[node];
+	if (n.mTag != 0 || n.mCount > 0)
+		results.push_back(word);
+
+	for (int child = n.mFirstChild; child >= 0 && results.size() < maxResults; child = m_Nodes[child].mNextSibling)
+	{
+		word.push_back(m_Nodes[child].mChar);
+		Collect(child, word, results, maxResults);
+		word.pop_back();
+	}
+}
+
+void CIdentifierTrie::Clear()
+{
+	m_Nodes.clear();
+	m_Nodes.push_back(Node{ 0, 0, -1, -1, 0 });
+	std::fill(std::begin(m_Root), std::end(m_Root), -1);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Byte trie of identifiers, used by CCodeDocument for known word lookups right
+// out of the line text and for completion prefix queries.
+//
+// Nodes live in one array and link first child / next sibling, siblings kept
+// in byte order, so a prefix query lists words sorted. The first byte, where
+// the fan-out is by far the widest, goes through a table instead. A node can
+// carry a tag (what kind of fixed word ends there, e.g. a keyword) and a count
+// of the occurrences added to the document; a word is listed while either is
+// set. Nodes are never removed, so node ids stay valid until Clear().
+class CIdentifierTrie
+{
+public:
+	CIdentifierTrie();
+
+	// Returns the node for the word, adding it if it's new.
+	int Insert(const char* pBegin, const char* pEnd);
+	// Returns the node for the word, or -1. With bFoldCase, ASCII letters of the text are upper-cased first.
+	int Find(const char* pBegin, const char* pEnd, bool bFoldCase = false) const;
+
+	void AddTag(int node, uint8_t tag) { m_Nodes[node].mTag |= tag; }
+	uint8_t GetTag(int node) const { return m_Nodes[node].mTag; }
+
+	// Counts one occurrence of the word and returns its node, to hand back to Release().
+	int Add(const char* pBegin, const char* pEnd);
+	void Release(int node) { m_Nodes[node].mCount--; }
+	int GetCount(int node) const { return m_Nodes[node].mCount; }
+
+	// Appends up to maxResults listed words that start with the prefix, in byte order.
+	void Complete(const char* pBegin, const char* pEnd, std::vector<std::string>& results, size_t maxResults) const;
+
+	void Clear();
+	size_t GetNodeCount() const { return m_Nodes.size(); }
+
+private:
+	struct Node
+	{
+		char mChar;
+		uint8_t mTag;
+		int mFirstChild;
+		int mNextSibling;
+		int mCount;
+	};
+
+	void Collect(int node, std::string& word, std::vector<std::string>& results, size_t maxResults) const;
+
+private:
+	std::vector<Node> m_Nodes;	// [0] is the root, it ends the empty word
+	int m_Root[256];			// the root's children, by byte
+};
@@ -1,20 +1,56 @@
 #include "MainPanel.h"
 #include "../CCodeEditor.h"
+#include "../CGuiMgr.h"
+#include "../../CLuaManager.h"
 
 #include "imgui.h"
 
+#include <Windows.h>
 #include <string>
 
+// Seconds without an edit before the buffer is compiled for syntax errors
+#define SYNTAX_CHECK_DELAY 0.3
+
+// What the script run from the editor is called in errors; running again replaces it
+#define EDITOR_SCRIPT_NAME "editor"
+
+// The editor session's journal, in the temp directory; it's replayed on the next start
+#define SWAP_FILE_NAME "lunar_editor.swp"
+
+// Bytes of journal after which it's rewritten as a snapshot of the session
+#define SWAP_FILE_COMPACT_SIZE (32 * 1024 * 1024)
+
+struct EditorReader
+{
+    const CCodeDocument* pDocument;
+    int cursor;
+};
+
+// Streams the buffer into lua_load a line at a time, no copy of the document
+static const char* ReadEditor(lua_State*, void* data, size_t* size)
+{
+    EditorReader* pReader = static_cast<EditorReader*>(data);
+    return pReader->pDocument->GetTextChunk(pReader->cursor, *size);
+}
+
 MainPanel::MainPanel()
 {
     m_pCodeEditor = new CCodeEditor();
-    m_pCodeEditor->SetLanguageDefinition(CCodeEditor::LanguageDefinition::Lua());
+    m_pCodeEditor->GetDocument().SetLanguageDefinition(CCodeDocument::LanguageDefinition::Lua());
+    m_pCodeEditor->SetMinimapTextureCallback([](ImTextureID texture, int width, int height, const ImU32* pixels, int firstRow, int rows) {
+        return Global::LunarGui.UpdateTexture(texture, width, height, pixels, firstRow, rows);
+    });
+
+    RecoverSession();
 }
 
 MainPanel::~MainPanel()
 {
+    m_SyntaxChecker.Stop();
+
     if (m_pCodeEditor != nullptr)
     {
+        m_pCodeEditor->GetDocument().SetJournalCallback(nullptr);
         delete m_pCodeEditor;
     }
 }
@@ -29,10 +65,100 @@ void MainPanel::Render()
     {
         ImGui::BeginChild("Header", ImVec2(0, ImGui::GetFrameHeight()), ImGuiChildFlags_None, ImGuiWindowFlags_NoBackground);
         {
-
+            if (ImGui::Button("Run"))
+                RunScript();
         }
         ImGui::EndChild();
         m_pCodeEditor->Render("CodeEditor", ImVec2(200, 100), false);
+        CheckSyntax();
+
+        if (m_SwapFile.GetSize() > SWAP_FILE_COMPACT_SIZE)
+            CompactSwapFile();
     }
     ImGui::End();
+}
+
+void MainPanel::RunScript()
+{
+    if (lua_State* pLuaState = Global::LuaManager.FindScript(EDITOR_SCRIPT_NAME))
+        Global::LuaManager.UnloadScript(pLuaState);
+
+    EditorReader reader = { &m_pCodeEditor->GetDocument(), 0 };
+    Global::LuaManager.LoadScriptFromReader(ReadEditor, &reader, EDITOR_SCRIPT_NAME);
+}
+
+void MainPanel::CheckSyntax()
+{
+    if (m_pCodeEditor->GetDocument().IsTextChanged())
+    {
+        m_EditGeneration++;
+        m_LastEditTime = ImGui::GetTime();
+        m_bCheckPending = true;
+    }
+
+    if (m_bCheckPending && ImGui::GetTime() - m_LastEditTime >= SYNTAX_CHECK_DELAY)
+    {
+        m_SyntaxChecker.Check(m_pCodeEditor->GetDocument().GetText(), m_EditGeneration);
+        m_bCheckPending = false;
+    }
+
+    // Markers for text that has been edited since would land on the wrong lines.
+    CLuaSyntaxChecker::Result result;
+    if (m_SyntaxChecker.Poll(result) && result.mGeneration == m_EditGeneration)
+    {
+        CCodeDocument::ErrorMarkers markers;
+        if (result.mLine > 0)
+            markers[result.mLine] = result.mMessage;
+        m_pCodeEditor->GetDocument().SetErrorMarkers(markers);
+    }
+}
+
+void MainPanel::RecoverSession()
+{
+    char szTempPath[MAX_PATH];
+    DWORD length = GetTempPathA(MAX_PATH, szTempPath);
+    if (length == 0 || length >= MAX_PATH)
+        return;
+
+    m_SwapPath = std::string(szTempPath) + SWAP_FILE_NAME;
+
+    // Whatever the last session journaled, up to the first record torn by a crash
+    if (m_SwapFile.Open(m_SwapPath.c_str()))
+    {
+        size_t offset = 0;
+        const char* pData;
+        size_t size;
+        while (m_SwapFile.Next(offset, pData, size) && m_pCodeEditor->GetDocument().ReplayJournal(pData, size))
+            ;
+    }
+
+    CompactSwapFile();
+}
+
+void MainPanel::CompactSwapFile()
+{
+    // The snapshot goes to a file of its own first, so a crash halfway through
+    // leaves the old journal to recover from.
+    const std::string newPath = m_SwapPath + ".new";
+
+    CUtil_SwapFile newFile;
+    if (newFile.Open(newPath.c_str(), true))
+    {
+        m_pCodeEditor->GetDocument().SetJournalCallback([&newFile](const char* pData, size_t size) {
+            newFile.Append(pData, size);
+        });
+        m_pCodeEditor->GetDocument().WriteJournalSnapshot();
+        newFile.Close();
+
+        m_SwapFile.Close();
+        MoveFileExA(newPath.c_str(), m_SwapPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+    }
+
+    // Carries on with the old journal if the snapshot couldn't replace it
+    if (!m_SwapFile.IsOpen())
+        m_SwapFile.Open(m_SwapPath.c_str());
+
+    m_pCodeEditor->GetDocument().SetJournalCallback([this](const char* pData, size_t size) {
+        m_SwapFile.Append(pData, size);
+    });
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "../CGuiPanel.h"
+#include "../../Lua/CLuaSyntaxChecker.h"
+#include "../../Utils/SwapFile.h"
 //#include "../CGuiWidgets.h"
 
+#include <string>
+
 class CCodeEditor;
 class MainPanel : public CGuiPanel/*, public CGuiWidgets*/ {
 public:
@@ -11,6 +15,20 @@ public:
 
     void Render() override;
 
+private:
+    void CheckSyntax();
+    void RunScript();
+    void RecoverSession();
+    void CompactSwapFile();
+
 private:
     CCodeEditor* m_pCodeEditor;
+
+    CLuaSyntaxChecker m_SyntaxChecker;
+    unsigned long long m_EditGeneration = 0;
+    double m_LastEditTime = 0.0;
+    bool m_bCheckPending = false;
+
+    CUtil_SwapFile m_SwapFile;
+    std::string m_SwapPath;
 };
\ No newline at end of file
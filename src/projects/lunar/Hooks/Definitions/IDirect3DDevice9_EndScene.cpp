@@ -1,6 +1,7 @@
 #include "../Hooks.h"
 
 #include "../../Gui/CGuiMgr.h"
+#include "../../CLuaManager.h"
 
 #include <d3d9.h>
 #include <d3dx9.h>
@@ -23,5 +24,6 @@ DEFINE_HOOK(Direct3DDevice9_EndScene, void, __fastcall, void* ecx, void* edx, ID
 
 	pDevice->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
 
+	Global::LuaManager.Update();
 	Global::LunarGui.Render();
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "CLuaAllocator.h"
+
+#include "lua/Lua.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// How far up the stack to look for a Lua function when the innermost frame is C.
+#define SAMPLE_MAX_DEPTH 4
+
+CLuaAllocator::CLuaAllocator(size_t limit, unsigned int sampleRate)
+	: m_Limit(limit)
+	, m_SampleRate(sampleRate)
+	, m_Countdown(sampleRate)
+{
+}
+
+void* CLuaAllocator::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	return static_cast<CLuaAllocator*>(ud)->Reallocate(ptr, osize, nsize);
+}
+
+void* CLuaAllocator::Reallocate(void* ptr, size_t osize, size_t nsize)
+{
+	// For fresh blocks Lua passes the object type in osize.
+	const size_t oldSize = ptr != nullptr ? osize : 0;
+
+	if (nsize == 0)
+	{
+		if (ptr != nullptr)
+		{
+			if (m_SampleRate != 0 && !m_Blocks.empty())
+				Forget(ptr, oldSize);
+
+			m_Usage -= oldSize;
+			free(ptr);
+		}
+		return nullptr;
+	}
+
+	// Only growth may fail; Lua answers with an emergency GC and a retry of the
+	// same request, and the GC only frees and shrinks. The cap counts as hit
+	// when the retry is refused too, or when the next growth is another request,
+	// which is what lauxlib's buffers do: they raise the error without a retry.
+	if (nsize > oldSize)
+	{
+		const bool retry = m_Refused.mPtr == ptr && m_Refused.mOsize == osize && m_Refused.mNsize == nsize;
+		if (m_Refused.mNsize != 0 && !retry)
+			m_bLimitHit = true;
+
+		if (m_Limit != 0 && m_Usage - oldSize + nsize > m_Limit)
+		{
+			if (retry)
+				m_bLimitHit = true;
+			m_Refused = Request{ ptr, osize, nsize };
+			return nullptr;
+		}
+
+		m_Refused = Request{};
+	}
+
+	void* block = realloc(ptr, nsize);
+	if (block == nullptr)
+		return nullptr;
+
+	m_Usage = m_Usage - oldSize + nsize;
+	m_Peak = std::max(m_Peak, m_Usage);
+
+	if (m_SampleRate != 0)
+	{
+		// Bookkeeping must never throw through the C frames of the Lua core.
+		try
+		{
+			if (ptr != nullptr)
+			{
+				// Resized block: keep its tag, if it had one.
+				auto it = m_Blocks.find(ptr);
+				if (it != m_Blocks.end())
+				{
+					Block tagged = it->second;
+					m_Blocks.erase(it);
+					tagged.mSite->mBytes += ((long long)nsize - (long long)tagged.mSize) * m_SampleRate;
+					tagged.mSize = nsize;
+					m_Blocks.emplace(block, tagged);
+				}
+			}
+			else if (--m_Countdown == 0)
+			{
+				m_Countdown = m_SampleRate;
+				Sample(block, nsize);
+			}
+		}
+		catch (...)
+		{
+			m_bInSample = false;
+		}
+	}
+
+	return block;
+}
+
+void CLuaAllocator::Sample(void* ptr, size_t nsize)
+{
+	// Only fresh blocks are sampled: a resize may be the stack itself being
+	// moved, and walking the call info in that window is not safe.
+	if (m_pLuaState == nullptr || m_bInSample)
+		return;
+
+	m_bInSample = true;
+
+	std::string name = "[C]";
+	lua_Debug ar;
+	for (int level = 0; level < SAMPLE_MAX_DEPTH && lua_getstack(m_pLuaState, level, &ar); level++)
+	{
+		if (!lua_getinfo(m_pLuaState, "Sl", &ar))
+			break;
+
+		if (ar.currentline >= 0)
+		{
+			name = ar.short_src;
+			name += ':';
+			name += std::to_string(ar.currentline);
+			break;
+		}
+	}
+
+	SiteData& site = m_Sites[name];
+	site.mBytes += (long long)nsize * m_SampleRate;
+	m_Blocks[ptr] = Block{ &site, nsize };
+
+	m_bInSample = false;
+}
+
+void CLuaAllocator::Forget(void* ptr, size_t osize)
+{
+	auto it = m_Blocks.find(ptr);
+	if (it == m_Blocks.end())
+		return;
+
+	it->second.mSite->mBytes -= (long long)osize * m_SampleRate;
+	m_Blocks.erase(it);
+}
+
+std::vector<CLuaAllocator::Site> CLuaAllocator::GetTopGrowingSites(size_t count)
+{
+	std::vector<Site> sites;
+	sites.reserve(m_Sites.size());
+
+	for (auto& [name, data] : m_Sites)
+	{
+		sites.push_back(Site{ name, data.mBytes, data.mBytes - data.mReported });
+		data.mReported = data.mBytes;
+	}
+
+	std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.mGrowth > b.mGrowth; });
+
+	if (sites.size() > count)
+		sites.resize(count);
+
+	return sites;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+
+// Per-state allocator used by CLuaManager.
+//
+// Always tracks the state's usage and peak, and can enforce a byte cap: a
+// growing allocation past the cap fails, which makes Lua run an emergency full
+// GC and retry before it raises a memory error. Once the retry has been refused
+// too the state is flagged so the manager can kill the script even if it
+// swallowed the error with pcall.
+//
+// With sampling enabled, every Nth fresh allocation is tagged with the
+// source:line of the innermost running Lua function, and frees of tagged
+// blocks are attributed back, giving a statistical live-bytes figure per site.
+class CLuaAllocator
+{
+public:
+	struct Site
+	{
+		std::string mName;
+		long long mBytes;	// estimated live bytes (sampled bytes * sample rate)
+		long long mGrowth;	// since the previous GetTopGrowingSites() call
+	};
+
+public:
+	CLuaAllocator(size_t limit, unsigned int sampleRate);
+
+	static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	void Attach(lua_State* pLuaState) { m_pLuaState = pLuaState; }
+
+	size_t GetUsage() const { return m_Usage; }
+	size_t GetPeak() const { return m_Peak; }
+	size_t GetLimit() const { return m_Limit; }
+	// A refusal still pending between calls into Lua was never retried.
+	bool IsLimitHit() const { return m_bLimitHit || m_Refused.mNsize != 0; }
+
+	std::vector<Site> GetTopGrowingSites(size_t count);
+
+private:
+	void* Reallocate(void* ptr, size_t osize, size_t nsize);
+	void Sample(void* ptr, size_t nsize);
+	void Forget(void* ptr, size_t osize);
+
+private:
+	struct SiteData
+	{
+		long long mBytes = 0;
+		long long mReported = 0;
+	};
+
+	struct Block
+	{
+		SiteData* mSite;
+		size_t mSize;
+	};
+
+	struct Request
+	{
+		void* mPtr = nullptr;
+		size_t mOsize = 0;
+		size_t mNsize = 0;	// 0 = none
+	};
+
+	lua_State* m_pLuaState = nullptr;
+
+	size_t m_Limit;		// 0 = unlimited
+	size_t m_Usage = 0;
+	size_t m_Peak = 0;
+	Request m_Refused;	// the last growth refused, until Lua retries it
+	bool m_bLimitHit = false;
+
+	unsigned int m_SampleRate;	// 0 = no site tracking
+	unsigned int m_Countdown;
+	bool m_bInSample = false;
+	std::unordered_map<std::string, SiteData> m_Sites;
+	std::unordered_map<void*, Block> m_Blocks;
+};
@@ -0,0 +1,207 @@
+#include "CLuaLibSnapshot.h"
+
+#include "lua/Lua.hpp"
+
+#include <cstring>
+
+// Same libraries and order as linit.c; only the ones marked cloneable are
+// rebuilt from the snapshot, the rest keep their luaopen_* side effects.
+static const struct
+{
+	const char* mName;
+	lua_CFunction mOpen;
+	bool mCloneable;
+} s_Libraries[] = {
+	{ LUA_GNAME,		luaopen_base,		true },
+	{ LUA_LOADLIBNAME,	luaopen_package,	false },	// searchers, require upvalue
+	{ LUA_COLIBNAME,	luaopen_coroutine,	true },
+	{ LUA_TABLIBNAME,	luaopen_table,		true },
+	{ LUA_IOLIBNAME,	luaopen_io,			false },	// file handles and metatables
+	{ LUA_OSLIBNAME,	luaopen_os,			true },
+	{ LUA_STRLIBNAME,	luaopen_string,		false },	// string metatable
+	{ LUA_MATHLIBNAME,	luaopen_math,		false },	// per state random seed
+	{ LUA_UTF8LIBNAME,	luaopen_utf8,		true },
+	{ LUA_DBLIBNAME,	luaopen_debug,		true },
+};
+
+void CLuaLibSnapshot::Capture(HostLibs pHostLibs)
+{
+	m_Libraries.clear();
+
+	// Every library is captured from its own state, so _G only holds the base library.
+	for (const auto& source : s_Libraries)
+	{
+		Library& library = m_Libraries.emplace_back();
+		library.mName = source.mName;
+		library.mOpen = source.mOpen;
+		library.mCloned = false;
+
+		if (!source.mCloneable)
+			continue;
+
+		lua_State* L = luaL_newstate();
+		if (L == nullptr)
+			continue;
+
+		luaL_requiref(L, source.mName, source.mOpen, 0);
+		library.mCloned = CaptureLibrary(L, library);
+		lua_close(L);
+	}
+
+	// Final size of _G once everything is opened, the host's globals included.
+	lua_State* L = luaL_newstate();
+	if (L != nullptr)
+	{
+		luaL_openlibs(L);
+		if (pHostLibs != nullptr)
+			pHostLibs(L);
+		lua_pushglobaltable(L);
+		lua_pushnil(L);
+		for (m_GlobalCount = 0; lua_next(L, -2) != 0; m_GlobalCount++)
+			lua_pop(L, 1);
+		lua_close(L);
+	}
+
+	m_bCaptured = true;
+}
+
+bool CLuaLibSnapshot::CaptureLibrary(lua_State* L, Library& library)
+{
+	const bool isBase = strcmp(library.mName, LUA_GNAME) == 0;
+
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0)
+	{
+		if (lua_type(L, -2) != LUA_TSTRING)
+			return false;
+
+		// Names and values may hold NULs (utf8.charpattern does), so they're copied with their length.
+		size_t length;
+		const char* name = lua_tolstring(L, -2, &length);
+
+		Entry& entry = library.mEntries.emplace_back();
+		entry.mName.assign(name, length);
+		entry.mType = lua_type(L, -1);
+		entry.mIsInteger = false;
+		entry.mFunction = nullptr;
+		entry.mNumber = 0.0;
+		entry.mInteger = 0;
+
+		switch (entry.mType)
+		{
+		case LUA_TFUNCTION:
+			// Closures carry per state upvalues and cannot be shared.
+			if (!lua_iscfunction(L, -1) || lua_getupvalue(L, -1, 1) != nullptr)
+				return false;
+			entry.mFunction = lua_tocfunction(L, -1);
+			break;
+		case LUA_TNUMBER:
+			entry.mIsInteger = lua_isinteger(L, -1);
+			if (entry.mIsInteger)
+				entry.mInteger = lua_tointeger(L, -1);
+			else
+				entry.mNumber = lua_tonumber(L, -1);
+			break;
+		case LUA_TSTRING:
+		{
+			const char* value = lua_tolstring(L, -1, &length);
+			entry.mString.assign(value, length);
+			break;
+		}
+		case LUA_TBOOLEAN:
+			entry.mInteger = lua_toboolean(L, -1);
+			break;
+		case LUA_TTABLE:
+			// Only _G._G, which is rebuilt as a reference to the new global table.
+			if (!isBase || !lua_compare(L, -1, -3, LUA_OPEQ))
+				return false;
+			break;
+		default:
+			return false;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	return true;
+}
+
+void CLuaLibSnapshot::PushEntry(lua_State* L, const Entry& entry) const
+{
+	switch (entry.mType)
+	{
+	case LUA_TFUNCTION:
+		lua_pushcfunction(L, entry.mFunction);
+		break;
+	case LUA_TNUMBER:
+		if (entry.mIsInteger)
+			lua_pushinteger(L, entry.mInteger);
+		else
+			lua_pushnumber(L, entry.mNumber);
+		break;
+	case LUA_TSTRING:
+		lua_pushlstring(L, entry.mString.data(), entry.mString.size());
+		break;
+	case LUA_TBOOLEAN:
+		lua_pushboolean(L, (int)entry.mInteger);
+		break;
+	case LUA_TTABLE:
+		lua_pushglobaltable(L);
+		break;
+	}
+}
+
+void CLuaLibSnapshot::OpenLibs(lua_State* pLuaState, HostLibs pHostLibs)
+{
+	if (!m_bCaptured)
+		Capture(pHostLibs);
+
+	lua_State* L = pLuaState;
+
+	// Exact-size package.loaded and _G, before anything has been put into them.
+	lua_createtable(L, 0, (int)m_Libraries.size());
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	lua_createtable(L, 0, m_GlobalCount);
+	lua_rawseti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+
+	for (const Library& library : m_Libraries)
+	{
+		if (!library.mCloned)
+		{
+			luaL_requiref(L, library.mName, library.mOpen, 1);
+			lua_pop(L, 1);
+			continue;
+		}
+
+		const bool isBase = strcmp(library.mName, LUA_GNAME) == 0;
+
+		if (isBase)
+			lua_pushglobaltable(L);
+		else
+			lua_createtable(L, 0, (int)library.mEntries.size());
+
+		for (const Entry& entry : library.mEntries)
+		{
+			lua_pushlstring(L, entry.mName.data(), entry.mName.size());
+			PushEntry(L, entry);
+			lua_rawset(L, -3);
+		}
+
+		// What luaL_requiref would have done: LOADED[name] = lib, _G[name] = lib
+		lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+		lua_pushvalue(L, -2);
+		lua_setfield(L, -2, library.mName);
+		lua_pop(L, 1);
+
+		if (!isBase)
+		{
+			lua_pushvalue(L, -1);
+			lua_setglobal(L, library.mName);
+		}
+
+		lua_pop(L, 1);
+	}
+
+	if (pHostLibs != nullptr)
+		pHostLibs(L);
+}
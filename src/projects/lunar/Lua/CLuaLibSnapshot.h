@@ -0,0 +1,58 @@
+#pragma once
+
+#include "lua/Lua.hpp"
+
+#include <string>
+#include <vector>
+
+// Replacement for luaL_openlibs when many states are spawned.
+//
+// The standard libraries are opened once in a template state and their tables
+// are recorded: every field name plus its C function or constant value. New
+// states get the libraries rebuilt from that record with tables allocated at
+// their exact final size (_G and package.loaded included), which skips the
+// rehash growth and the per-library require bookkeeping of luaL_openlibs.
+// Libraries that need more than a table of functions (string metatable, io
+// handles, package searchers, math's seeded generator) are still opened the
+// regular way.
+//
+// Globals the host adds on top go through pHostLibs, so _G is sized for them
+// too; it is run once when the snapshot is taken and then in every new state.
+class CLuaLibSnapshot
+{
+public:
+	typedef void (*HostLibs)(lua_State* pLuaState);
+
+	void OpenLibs(lua_State* pLuaState, HostLibs pHostLibs = nullptr);
+
+private:
+	struct Entry
+	{
+		std::string mName;
+		int mType;
+		bool mIsInteger;
+		lua_CFunction mFunction;
+		double mNumber;
+		long long mInteger;
+		std::string mString;
+	};
+
+	struct Library
+	{
+		const char* mName;
+		lua_CFunction mOpen;
+		bool mCloned;
+		std::vector<Entry> mEntries;
+	};
+
+	void Capture(HostLibs pHostLibs);
+	bool CaptureLibrary(lua_State* L, Library& library);
+	void PushEntry(lua_State* L, const Entry& entry) const;
+
+private:
+	bool m_bCaptured = false;
+	std::vector<Library> m_Libraries;
+	int m_GlobalCount = 0;
+};
+
+namespace Lua { inline CLuaLibSnapshot LibSnapshot; }
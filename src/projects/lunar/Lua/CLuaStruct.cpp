@@ -0,0 +1,332 @@
+#include "CLuaStruct.h"
+
+#include "lua/Lua.hpp"
+
+#include <cstring>
+#include <new>
+
+#define LAYOUT_METATABLE "LunarStructLayout"
+
+// Every inline field takes one 8 byte cell, whatever its declared type.
+union StructCell
+{
+	lua_Number n;
+	lua_Integer i;
+};
+
+// Slot codes stored in the per-layout name -> slot table: the low two bits hold
+// the FieldType, the remaining bits the byte offset or user value index.
+static inline lua_Integer EncodeSlot(const CLuaStruct::Field& field)
+{
+	return ((lua_Integer)field.mSlot << 2) | (lua_Integer)field.mType;
+}
+
+static inline CLuaStruct::FieldType SlotType(lua_Integer code)
+{
+	return (CLuaStruct::FieldType)(code & 3);
+}
+
+static inline int SlotIndex(lua_Integer code)
+{
+	return (int)(code >> 2);
+}
+
+static bool ParseFieldType(const char* name, CLuaStruct::FieldType& type)
+{
+	if (strcmp(name, "number") == 0)
+		type = CLuaStruct::FieldType::Number;
+	else if (strcmp(name, "integer") == 0)
+		type = CLuaStruct::FieldType::Integer;
+	else if (strcmp(name, "boolean") == 0)
+		type = CLuaStruct::FieldType::Boolean;
+	else if (strcmp(name, "any") == 0)
+		type = CLuaStruct::FieldType::Any;
+	else
+		return false;
+
+	return true;
+}
+
+static CLuaStruct::Layout* CheckLayout(lua_State* L, int idx)
+{
+	return static_cast<CLuaStruct::Layout*>(luaL_checkudata(L, idx, LAYOUT_METATABLE));
+}
+
+// Resolves the key at index 2 through the slot table in upvalue 2; raises on unknown fields.
+static lua_Integer LookupSlot(lua_State* L)
+{
+	lua_pushvalue(L, 2);
+	if (lua_rawget(L, lua_upvalueindex(2)) != LUA_TNUMBER)
+	{
+		const CLuaStruct::Layout* layout = static_cast<const CLuaStruct::Layout*>(lua_touserdata(L, lua_upvalueindex(1)));
+		luaL_error(L, "struct %s has no field '%s'", layout->mName.c_str(), luaL_tolstring(L, 2, nullptr));
+	}
+
+	const lua_Integer code = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	return code;
+}
+
+// Argument 1 of the instance metamethods. Scripts can reach those through
+// debug.getmetatable and call them on anything, so it has to be a userdata
+// carrying the instance metatable in upvalue 3.
+static void CheckInstance(lua_State* L)
+{
+	if (lua_type(L, 1) != LUA_TUSERDATA || !lua_getmetatable(L, 1) || !lua_rawequal(L, -1, lua_upvalueindex(3)))
+	{
+		const CLuaStruct::Layout* layout = static_cast<const CLuaStruct::Layout*>(lua_touserdata(L, lua_upvalueindex(1)));
+		luaL_typeerror(L, 1, layout->mName.c_str());
+	}
+	lua_pop(L, 1);
+}
+
+// The inline cell at slot; debug.setmetatable can also put the instance
+// metatable on a userdata too small for the layout.
+static StructCell* GetCell(lua_State* L, int udIdx, int slot)
+{
+	if ((size_t)slot + sizeof(StructCell) > lua_rawlen(L, udIdx))
+		luaL_error(L, "struct instance is smaller than its layout");
+
+	return reinterpret_cast<StructCell*>(static_cast<char*>(lua_touserdata(L, udIdx)) + slot);
+}
+
+static void WriteField(lua_State* L, int udIdx, lua_Integer code, int valueIdx)
+{
+	const int slot = SlotIndex(code);
+
+	switch (SlotType(code))
+	{
+	case CLuaStruct::FieldType::Number:
+		GetCell(L, udIdx, slot)->n = luaL_checknumber(L, valueIdx);
+		break;
+	case CLuaStruct::FieldType::Integer:
+		GetCell(L, udIdx, slot)->i = luaL_checkinteger(L, valueIdx);
+		break;
+	case CLuaStruct::FieldType::Boolean:
+		GetCell(L, udIdx, slot)->i = lua_toboolean(L, valueIdx);
+		break;
+	case CLuaStruct::FieldType::Any:
+		lua_pushvalue(L, valueIdx);
+		lua_setiuservalue(L, udIdx, slot);
+		break;
+	}
+}
+
+// __index(instance, key), upvalues: layout, slot table, instance metatable
+static int Instance_Index(lua_State* L)
+{
+	CheckInstance(L);
+	const lua_Integer code = LookupSlot(L);
+	const int slot = SlotIndex(code);
+
+	switch (SlotType(code))
+	{
+	case CLuaStruct::FieldType::Number:
+		lua_pushnumber(L, GetCell(L, 1, slot)->n);
+		break;
+	case CLuaStruct::FieldType::Integer:
+		lua_pushinteger(L, GetCell(L, 1, slot)->i);
+		break;
+	case CLuaStruct::FieldType::Boolean:
+		lua_pushboolean(L, (int)GetCell(L, 1, slot)->i);
+		break;
+	case CLuaStruct::FieldType::Any:
+		lua_getiuservalue(L, 1, slot);
+		break;
+	}
+
+	return 1;
+}
+
+// __newindex(instance, key, value), upvalues: layout, slot table, instance metatable
+static int Instance_NewIndex(lua_State* L)
+{
+	CheckInstance(L);
+	WriteField(L, 1, LookupSlot(L), 3);
+	return 0;
+}
+
+// __tostring(instance), upvalues: layout
+static int Instance_ToString(lua_State* L)
+{
+	const CLuaStruct::Layout* layout = static_cast<const CLuaStruct::Layout*>(lua_touserdata(L, lua_upvalueindex(1)));
+	lua_pushfstring(L, "%s: %p", layout->mName.c_str(), lua_topointer(L, 1));
+	return 1;
+}
+
+// Layout(...) -> instance; fields are filled positionally in declaration order.
+static int Layout_Call(lua_State* L)
+{
+	const CLuaStruct::Layout* layout = CheckLayout(L, 1);
+	const int nargs = lua_gettop(L) - 1;
+
+	// the instance metatable, gone once the layout's __gc has run
+	if (lua_getiuservalue(L, 1, 1) != LUA_TTABLE)
+		return luaL_error(L, "struct layout has been collected");
+	const int metatableIdx = lua_gettop(L);
+
+	if (nargs > (int)layout->mFields.size())
+		return luaL_error(L, "struct %s takes at most %d values, got %d", layout->mName.c_str(), (int)layout->mFields.size(), nargs);
+
+	void* data = lua_newuserdatauv(L, layout->mBytes, layout->mAnyCount);
+	memset(data, 0, layout->mBytes);
+	const int ud = lua_gettop(L);
+
+	lua_pushvalue(L, metatableIdx);
+	lua_setmetatable(L, ud);
+
+	for (int i = 0; i < nargs; i++)
+		WriteField(L, ud, EncodeSlot(layout->mFields[i]), i + 2);
+
+	return 1;
+}
+
+// A script can call this one through debug.getmetatable as well, on a layout
+// still in use: it's left empty rather than destroyed, so a second call or the
+// real collection finds an object, and constructing from it is refused.
+static int Layout_Gc(lua_State* L)
+{
+	CLuaStruct::Layout* layout = CheckLayout(L, 1);
+	layout->~Layout();
+	new (layout) CLuaStruct::Layout();
+
+	lua_pushnil(L);
+	lua_setiuservalue(L, 1, 1);
+	return 0;
+}
+
+static int Layout_ToString(lua_State* L)
+{
+	const CLuaStruct::Layout* layout = CheckLayout(L, 1);
+	lua_pushfstring(L, "struct %s (%d fields, %d bytes)", layout->mName.c_str(), (int)layout->mFields.size(), (int)layout->mBytes);
+	return 1;
+}
+
+// struct.define(name, { "field[:type]", ... }) -> layout
+static int Struct_Define(lua_State* L)
+{
+	const char* name = luaL_checkstring(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+
+	const int count = (int)luaL_len(L, 2);
+	luaL_argcheck(L, count > 0, 2, "a struct needs at least one field");
+
+	CLuaStruct::Layout* layout = new (lua_newuserdatauv(L, sizeof(CLuaStruct::Layout), 1)) CLuaStruct::Layout();
+	const int layoutIdx = lua_gettop(L);
+	luaL_setmetatable(L, LAYOUT_METATABLE);
+
+	layout->mName = name;
+	layout->mBytes = 0;
+	layout->mAnyCount = 0;
+	layout->mFields.reserve(count);
+
+	lua_createtable(L, 0, count);	// slot table
+	const int slotsIdx = lua_gettop(L);
+
+	for (int i = 1; i <= count; i++)
+	{
+		lua_geti(L, 2, i);
+		size_t len = 0;
+		const char* decl = lua_tolstring(L, -1, &len);
+		if (decl == nullptr || len == 0)
+			return luaL_error(L, "struct %s: field #%d must be a non-empty string", name, i);
+
+		// Filled in place so that a raised error never skips a C++ destructor;
+		// the half built layout is reclaimed by its __gc.
+		CLuaStruct::Field& field = layout->mFields.emplace_back();
+		field.mType = CLuaStruct::FieldType::Number;
+
+		const char* colon = strchr(decl, ':');
+		if (colon != nullptr)
+		{
+			field.mName.assign(decl, colon);
+			if (!ParseFieldType(colon + 1, field.mType))
+				return luaL_error(L, "struct %s: unknown type '%s' for field '%s'", name, colon + 1, field.mName.c_str());
+		}
+		else
+			field.mName.assign(decl, len);
+		lua_pop(L, 1);
+
+		if (field.mType == CLuaStruct::FieldType::Any)
+			field.mSlot = ++layout->mAnyCount;
+		else
+		{
+			field.mSlot = (int)layout->mBytes;
+			layout->mBytes += sizeof(StructCell);
+		}
+
+		lua_pushlstring(L, field.mName.data(), field.mName.size());
+		if (lua_rawget(L, slotsIdx) != LUA_TNIL)
+			return luaL_error(L, "struct %s: duplicate field '%s'", name, field.mName.c_str());
+		lua_pop(L, 1);
+
+		lua_pushlstring(L, field.mName.data(), field.mName.size());
+		lua_pushinteger(L, EncodeSlot(field));
+		lua_rawset(L, slotsIdx);
+	}
+
+	// Instance metatable, kept alive as the layout's user value.
+	lua_createtable(L, 0, 5);
+	const int metatableIdx = lua_gettop(L);
+
+	lua_pushvalue(L, layoutIdx);
+	lua_pushvalue(L, slotsIdx);
+	lua_pushvalue(L, metatableIdx);
+	lua_pushcclosure(L, Instance_Index, 3);
+	lua_setfield(L, -2, "__index");
+
+	lua_pushvalue(L, layoutIdx);
+	lua_pushvalue(L, slotsIdx);
+	lua_pushvalue(L, metatableIdx);
+	lua_pushcclosure(L, Instance_NewIndex, 3);
+	lua_setfield(L, -2, "__newindex");
+
+	lua_pushvalue(L, layoutIdx);
+	lua_pushcclosure(L, Instance_ToString, 1);
+	lua_setfield(L, -2, "__tostring");
+
+	lua_pushstring(L, name);
+	lua_setfield(L, -2, "__name");
+
+	lua_pushstring(L, name);
+	lua_setfield(L, -2, "__metatable");	// keep scripts from swapping the accessors
+
+	lua_setiuservalue(L, layoutIdx, 1);
+	lua_pop(L, 1);	// slot table
+
+	return 1;
+}
+
+// struct.sizeof(layout) -> bytes of inline storage per instance, number of user values
+static int Struct_Sizeof(lua_State* L)
+{
+	const CLuaStruct::Layout* layout = CheckLayout(L, 1);
+	lua_pushinteger(L, (lua_Integer)layout->mBytes);
+	lua_pushinteger(L, layout->mAnyCount);
+	return 2;
+}
+
+void CLuaStruct::Register(lua_State* pLuaState)
+{
+	if (luaL_newmetatable(pLuaState, LAYOUT_METATABLE))
+	{
+		lua_pushcfunction(pLuaState, Layout_Call);
+		lua_setfield(pLuaState, -2, "__call");
+		lua_pushcfunction(pLuaState, Layout_Gc);
+		lua_setfield(pLuaState, -2, "__gc");
+		lua_pushcfunction(pLuaState, Layout_ToString);
+		lua_setfield(pLuaState, -2, "__tostring");
+		lua_pushboolean(pLuaState, 0);
+		lua_setfield(pLuaState, -2, "__metatable");
+	}
+	lua_pop(pLuaState, 1);
+
+	static const luaL_Reg functions[] = {
+		{ "define", Struct_Define },
+		{ "sizeof", Struct_Sizeof },
+		{ nullptr, nullptr }
+	};
+
+	luaL_newlib(pLuaState, functions);
+	lua_setglobal(pLuaState, "struct");
+}
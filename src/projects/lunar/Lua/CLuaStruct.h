@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct lua_State;
+
+// Host side "struct" facility for scripts.
+//
+// A script declares a record layout once:
+//
+//     local Enemy = struct.define("Enemy", { "x", "y", "hp:integer", "alive:boolean", "name:any" })
+//     local e = Enemy(10, 20, 100, true, "grunt")
+//     e.hp = e.hp - 1
+//
+// Instances are fixed-size userdata instead of tables. number/integer/boolean
+// fields live inline in the userdata block, "any" fields live in the userdata's
+// user values. Field names are resolved to precomputed slots once, at define time,
+// so instances never grow a hash part and never rehash.
+class CLuaStruct
+{
+public:
+	enum class FieldType : unsigned char
+	{
+		Number,
+		Integer,
+		Boolean,
+		Any
+	};
+
+	struct Field
+	{
+		std::string mName;
+		FieldType mType;
+		int mSlot;		// byte offset for inline fields, user value index for Any
+	};
+
+	struct Layout
+	{
+		std::string mName;
+		std::vector<Field> mFields;
+		size_t mBytes;	// size of the inline block
+		int mAnyCount;	// number of user values
+	};
+
+public:
+	void Register(lua_State* pLuaState);
+};
+
+namespace Lua { inline CLuaStruct Struct; }
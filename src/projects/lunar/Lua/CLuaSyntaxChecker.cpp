@@ -0,0 +1,135 @@
+#include "CLuaSyntaxChecker.h"
+
+#include "lua/Lua.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// "=" makes Lua use the name as is in messages: "editor:12: ..."
+static const char s_ChunkName[] = "=editor";
+
+CLuaSyntaxChecker::~CLuaSyntaxChecker()
+{
+	Stop();
+}
+
+void CLuaSyntaxChecker::Check(std::string text, unsigned long long generation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_PendingText = std::move(text);
+		m_PendingGeneration = generation;
+		m_bPending = true;
+		m_bStop = false;
+	}
+
+	if (!m_Thread.joinable())
+		m_Thread = std::thread(&CLuaSyntaxChecker::WorkerMain, this);
+	else
+		m_WakeCondition.notify_one();
+}
+
+bool CLuaSyntaxChecker::Poll(Result& result)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_bResultReady)
+		return false;
+
+	result = std::move(m_Result);
+	m_bResultReady = false;
+	return true;
+}
+
+void CLuaSyntaxChecker::Stop()
+{
+	if (!m_Thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_WakeCondition.notify_one();
+	m_Thread.join();
+}
+
+void CLuaSyntaxChecker::WorkerMain()
+{
+	lua_State* L = luaL_newstate();
+
+	std::string text;
+	Result result;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeCondition.wait(lock, [this] { return m_bPending || m_bStop; });
+			if (m_bStop)
+				break;
+
+			text.swap(m_PendingText);
+			result.mGeneration = m_PendingGeneration;
+			m_bPending = false;
+		}
+
+		// Without a verdict the last result stands, rather than clearing the markers.
+		if (!Compile(L, text, result))
+			continue;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// A newer snapshot came in while compiling, this result is already stale.
+		if (m_bPending)
+			continue;
+
+		m_Result = result;
+		m_bResultReady = true;
+	}
+
+	if (L != nullptr)
+		lua_close(L);
+}
+
+bool CLuaSyntaxChecker::Compile(lua_State* L, const std::string& text, Result& result) const
+{
+	result.mLine = 0;
+	result.mMessage.clear();
+
+	if (L == nullptr)
+		return false;
+
+	// Text only: a buffer starting with the binary signature would go to the undumper.
+	const int status = luaL_loadbufferx(L, text.data(), text.size(), s_ChunkName, "t");
+	if (status == LUA_ERRSYNTAX)
+	{
+		const char* error = lua_tostring(L, -1);
+		const size_t prefix = sizeof(s_ChunkName) - 2;	// length of the name without '='
+
+		if (error != nullptr && strncmp(error, s_ChunkName + 1, prefix) == 0 && error[prefix] == ':')
+		{
+			char* end = nullptr;
+			result.mLine = std::max(1, (int)strtol(error + prefix + 1, &end, 10));
+			result.mMessage = error;
+
+			if (*end == ':')
+			{
+				const char* message = end + 1;
+				while (*message == ' ')
+					message++;
+				result.mMessage = message;
+			}
+		}
+		else
+		{
+			result.mLine = 1;
+			result.mMessage = error != nullptr ? error : "syntax error";
+		}
+	}
+
+	// The compiled chunk or the message; either way it is garbage from here.
+	lua_settop(L, 0);
+
+	// Out of memory says nothing about the text.
+	return status == LUA_OK || status == LUA_ERRSYNTAX;
+}
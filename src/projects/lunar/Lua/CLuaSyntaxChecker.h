@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct lua_State;
+
+// Compiles editor buffers on a background thread to report syntax errors as
+// you type.
+//
+// Check() hands over a snapshot of the text tagged with the caller's edit
+// generation; the worker compiles it as text in a scratch lua_State of its
+// own (no libraries, nothing is run) and keeps the first error. A check that
+// fails for another reason, like running out of memory, reports nothing. A snapshot still waiting is replaced by a newer one, so a burst of
+// edits compiles once. The thread is started by the first Check(), never from
+// a static constructor.
+class CLuaSyntaxChecker
+{
+public:
+	struct Result
+	{
+		unsigned long long mGeneration;
+		int mLine;				// 1-based line of the error, 0 when the text compiles
+		std::string mMessage;	// without the chunk name and line prefix
+	};
+
+public:
+	~CLuaSyntaxChecker();
+
+	void Check(std::string text, unsigned long long generation);
+	// Returns true once per finished check, with the newest result.
+	bool Poll(Result& result);
+
+	void Stop();
+
+private:
+	void WorkerMain();
+	// False when the text couldn't be compiled either way, e.g. out of memory.
+	bool Compile(lua_State* L, const std::string& text, Result& result) const;
+
+private:
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+
+	std::string m_PendingText;
+	unsigned long long m_PendingGeneration = 0;
+	bool m_bPending = false;
+
+	Result m_Result;
+	bool m_bResultReady = false;
+	bool m_bStop = false;
+};
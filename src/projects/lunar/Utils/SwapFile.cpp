@@ -0,0 +1,163 @@
+#include "SwapFile.h"
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+// Bytes mapped for a new file; it doubles from there as records come in
+#define SWAP_FILE_INITIAL_SIZE (1024 * 1024)
+
+struct SwapRecordHeader
+{
+	uint32_t m_Size;
+	uint32_t m_Checksum;
+};
+
+// FNV-1a
+static uint32_t Checksum(const void* pData, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(pData);
+
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+// Records start 4-byte aligned, so the headers are
+static size_t Align(size_t offset)
+{
+	return (offset + 3) & ~(size_t)3;
+}
+
+CUtil_SwapFile::~CUtil_SwapFile()
+{
+	Close();
+}
+
+bool CUtil_SwapFile::Open(const char* szPath, bool bCreate)
+{
+	Close();
+
+	HANDLE hFile = CreateFileA(szPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, bCreate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_hFile = hFile;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || !Map(std::max((size_t)fileSize.QuadPart, (size_t)SWAP_FILE_INITIAL_SIZE)))
+	{
+		Close();
+		return false;
+	}
+
+	// the records run up to the first one that doesn't read back
+	const char* pData;
+	size_t size;
+	m_End = 0;
+	while (Next(m_End, pData, size))
+		;
+
+	return true;
+}
+
+void CUtil_SwapFile::Close()
+{
+	Unmap();
+
+	if (m_hFile != nullptr)
+	{
+		LARGE_INTEGER end;
+		end.QuadPart = (LONGLONG)m_End;
+		if (SetFilePointerEx(m_hFile, end, nullptr, FILE_BEGIN))
+			SetEndOfFile(m_hFile);
+
+		CloseHandle(m_hFile);
+		m_hFile = nullptr;
+	}
+
+	m_Capacity = 0;
+	m_End = 0;
+}
+
+bool CUtil_SwapFile::Next(size_t& offset, const char*& pData, size_t& size) const
+{
+	if (m_pView == nullptr || offset + sizeof(SwapRecordHeader) > m_Capacity)
+		return false;
+
+	SwapRecordHeader header;
+	memcpy(&header, m_pView + offset, sizeof(header));
+
+	if (header.m_Size == 0 || header.m_Size > m_Capacity - offset - sizeof(header))
+		return false;
+
+	const char* pRecord = m_pView + offset + sizeof(header);
+	if (Checksum(pRecord, header.m_Size) != header.m_Checksum)
+		return false;
+
+	pData = pRecord;
+	size = header.m_Size;
+	offset = Align(offset + sizeof(header) + header.m_Size);
+	return true;
+}
+
+bool CUtil_SwapFile::Append(const void* pData, size_t size)
+{
+	if (m_pView == nullptr || size == 0 || size > UINT32_MAX)
+		return false;
+
+	const size_t end = Align(m_End + sizeof(SwapRecordHeader) + size);
+	if (end > m_Capacity && !Map(std::max(end, m_Capacity * 2)))
+		return false;
+
+	SwapRecordHeader* pHeader = reinterpret_cast<SwapRecordHeader*>(m_pView + m_End);
+	memcpy(pHeader + 1, pData, size);
+	pHeader->m_Checksum = Checksum(pData, size);
+
+	// until the size is in, the record isn't
+	std::atomic_signal_fence(std::memory_order_release);
+	pHeader->m_Size = (uint32_t)size;
+
+	m_End = end;
+	return true;
+}
+
+bool CUtil_SwapFile::Map(size_t capacity)
+{
+	Unmap();
+
+	// a mapping bigger than the file grows the file, zero-filled
+	const unsigned long long size = capacity;
+	m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (m_hMapping == nullptr)
+		return false;
+
+	m_pView = static_cast<char*>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, capacity));
+	if (m_pView == nullptr)
+	{
+		Unmap();
+		return false;
+	}
+
+	m_Capacity = capacity;
+	return true;
+}
+
+void CUtil_SwapFile::Unmap()
+{
+	if (m_pView != nullptr)
+	{
+		UnmapViewOfFile(m_pView);
+		m_pView = nullptr;
+	}
+
+	if (m_hMapping != nullptr)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+}
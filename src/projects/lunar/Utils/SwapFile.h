@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+// Append-only file of records, mapped into memory so appending one is a copy
+// into the mapping: the OS writes the pages out on its own time, nothing is
+// flushed per record, and what was appended outlives a crash of the process.
+// Each record is its size, a checksum and the bytes. The size is stored last,
+// so a record torn by a crash mid-append reads as the end of the file, and the
+// checksum catches pages the OS didn't get to write before going down itself.
+// The file grows by doubling, mapped again each time.
+class CUtil_SwapFile
+{
+public:
+	~CUtil_SwapFile();
+
+	// Opens the file, or creates it; bCreate starts it empty either way.
+	// Next() then reads the records already in it.
+	bool Open(const char* szPath, bool bCreate = false);
+	void Close();	// cuts the file down to its records
+
+	bool IsOpen() const { return m_pView != nullptr; }
+	size_t GetSize() const { return m_End; }
+
+	// Reads the record at offset and moves offset past it; false past the last one.
+	bool Next(size_t& offset, const char*& pData, size_t& size) const;
+	bool Append(const void* pData, size_t size);
+
+private:
+	bool Map(size_t capacity);
+	void Unmap();
+
+private:
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+	char* m_pView = nullptr;
+	size_t m_Capacity = 0;
+	size_t m_End = 0;		// past the last record
+};
@@ -0,0 +1,146 @@
+#include "ThreadPool.h"
+
+CUtil_ThreadPool::~CUtil_ThreadPool()
+{
+	Stop();
+}
+
+void CUtil_ThreadPool::Start(unsigned int count)
+{
+	if (IsRunning())
+		return;
+
+	if (count == 0)
+	{
+		const unsigned int cores = std::thread::hardware_concurrency();
+		count = cores > 1 ? cores - 1 : 1;
+	}
+
+	m_bStop = false;
+	m_Queues.clear();
+	for (unsigned int i = 0; i <= count; i++)
+		m_Queues.push_back(std::make_unique<Queue>());
+
+	for (unsigned int i = 1; i <= count; i++)
+		m_Threads.emplace_back(&CUtil_ThreadPool::WorkerMain, this, (size_t)i);
+}
+
+void CUtil_ThreadPool::Stop()
+{
+	if (!IsRunning())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+
+	m_Threads.clear();
+	m_Queues.clear();
+}
+
+void CUtil_ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0)
+		return;
+
+	if (!IsRunning() || count == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_pJob = &job;
+		m_Remaining = count;
+
+		// Deal the items round-robin; stealing evens out uneven costs.
+		for (size_t i = 0; i < count; i++)
+		{
+			Queue& queue = *m_Queues[i % m_Queues.size()];
+			std::lock_guard<std::mutex> queueLock(queue.m_Mutex);
+			queue.m_Items.push_back(i);
+		}
+
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	Drain(0);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_DoneCondition.wait(lock, [this] { return m_Remaining == 0; });
+	m_pJob = nullptr;
+}
+
+void CUtil_ThreadPool::WorkerMain(size_t self)
+{
+	unsigned long long seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WakeCondition.wait(lock, [this, seen] { return m_bStop || m_Generation != seen; });
+
+			if (m_bStop)
+				return;
+
+			seen = m_Generation;
+		}
+
+		Drain(self);
+	}
+}
+
+void CUtil_ThreadPool::Drain(size_t self)
+{
+	size_t item;
+	while (Pop(self, item) || Steal(self, item))
+	{
+		(*m_pJob)(item);
+
+		if (--m_Remaining == 0)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_DoneCondition.notify_all();
+		}
+	}
+}
+
+bool CUtil_ThreadPool::Pop(size_t self, size_t& item)
+{
+	Queue& queue = *m_Queues[self];
+	std::lock_guard<std::mutex> lock(queue.m_Mutex);
+
+	if (queue.m_Items.empty())
+		return false;
+
+	item = queue.m_Items.back();
+	queue.m_Items.pop_back();
+	return true;
+}
+
+bool CUtil_ThreadPool::Steal(size_t self, size_t& item)
+{
+	for (size_t i = 1; i < m_Queues.size(); i++)
+	{
+		Queue& queue = *m_Queues[(self + i) % m_Queues.size()];
+		std::lock_guard<std::mutex> lock(queue.m_Mutex);
+
+		if (queue.m_Items.empty())
+			continue;
+
+		item = queue.m_Items.front();
+		queue.m_Items.pop_front();
+		return true;
+	}
+
+	return false;
+}
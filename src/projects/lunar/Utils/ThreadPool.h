@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool for fork/join style frame work.
+// Every participant (the workers plus the thread calling ParallelFor) owns a
+// queue; idle participants steal from the front of the others' queues.
+// Threads are only created by Start(), never from a static constructor, so the
+// pool is safe to keep as a member of objects living inside the DLL.
+class CUtil_ThreadPool
+{
+public:
+	~CUtil_ThreadPool();
+
+	void Start(unsigned int count = 0);	// 0 = one worker per core, minus the calling thread
+	void Stop();
+
+	bool IsRunning() const { return !m_Threads.empty(); }
+	unsigned int GetWorkerCount() const { return (unsigned int)m_Threads.size(); }
+
+	// Runs job(i) for every i in [0, count) and returns once all of them are done.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+private:
+	struct Queue
+	{
+		std::mutex m_Mutex;
+		std::deque<size_t> m_Items;
+	};
+
+	void WorkerMain(size_t self);
+	void Drain(size_t self);
+	bool Pop(size_t self, size_t& item);
+	bool Steal(size_t self, size_t& item);
+
+private:
+	std::vector<std::thread> m_Threads;
+	std::vector<std::unique_ptr<Queue>> m_Queues;	// [0] belongs to the calling thread
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+
+	const std::function<void(size_t)>* m_pJob = nullptr;
+	std::atomic<size_t> m_Remaining = 0;
+	unsigned long long m_Generation = 0;
+	bool m_bStop = false;
+};